@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+#include <Eigen/SparseCore>
+
+/**
+ * Graph coloring of sparsity patterns, used by the sparse jacobian
+ * drivers of both the forward mode (`forward::sparse_jacobian`) and the
+ * reverse mode (`reverse::sparse_jacobian`).
+ *
+ * Two columns of a jacobian which never have a nonzero in the same row are
+ * *structurally orthogonal*: they can be computed by the same forward pass
+ * (seeding both inputs at once) and separated afterwards, since each
+ * nonzero of the result belongs to exactly one of them. Coloring the
+ * columns so that columns of the same color are structurally orthogonal
+ * reduces the number of passes from the number of columns to the number of
+ * colors (e.g. 3 for a tridiagonal jacobian, whatever its size).
+ * The same holds for the rows and the backward passes.
+ */
+
+namespace autodiff {
+
+/**
+ * The nonzeros of a jacobian (an entry which is not in the pattern
+ * is assumed to be zero)
+ */
+using SparsityPattern = Eigen::SparseMatrix<bool>;
+
+/**
+ * Colors the columns of a sparsity pattern so that no two columns of the
+ * same color have a nonzero in the same row.
+ *
+ * The coloring is greedy (each column gets the smallest color not used by
+ * the columns it conflicts with) and visits the columns with more nonzeros
+ * first, which usually needs fewer colors.
+ *
+ * @param pattern The sparsity pattern
+ * @param n_colors (OUT) The number of colors
+ * @return The color of each column, in [0, n_colors)
+ */
+inline std::vector<size_t> color_columns(SparsityPattern const & pattern, size_t & n_colors) {
+    size_t const n_cols = pattern.cols();
+    size_t const NONE = n_cols;
+
+    // the columns of each row
+    Eigen::SparseMatrix<bool, Eigen::RowMajor> by_row = pattern;
+
+    std::vector<size_t> order(n_cols);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return pattern.col(a).nonZeros() > pattern.col(b).nonZeros();
+    });
+
+    std::vector<size_t> colors(n_cols, NONE);
+    // forbidden[c] == j <=> the color c is used by a column conflicting with j
+    std::vector<size_t> forbidden(n_cols + 1, NONE);
+    n_colors = 0;
+
+    for(size_t j: order) {
+        for(SparsityPattern::InnerIterator row(pattern, j); row; ++row) {
+            for(decltype(by_row)::InnerIterator col(by_row, row.row()); col; ++col) {
+                size_t c = colors[col.col()];
+                if(c != NONE) {
+                    forbidden[c] = j;
+                }
+            }
+        }
+
+        size_t c = 0;
+        while(forbidden[c] == j) {
+            ++c;
+        }
+        colors[j] = c;
+        n_colors = std::max(n_colors, c + 1);
+    }
+
+    return colors;
+}
+
+/**
+ * Colors the rows of a sparsity pattern so that no two rows of the
+ * same color have a nonzero in the same column (see `color_columns`)
+ *
+ * @param pattern The sparsity pattern
+ * @param n_colors (OUT) The number of colors
+ * @return The color of each row, in [0, n_colors)
+ */
+inline std::vector<size_t> color_rows(SparsityPattern const & pattern, size_t & n_colors) {
+    SparsityPattern transposed = pattern.transpose();
+    return color_columns(transposed, n_colors);
+}
+
+/**
+ * Groups the indices by color
+ *
+ * @param colors The color of each index
+ * @param n_colors The number of colors
+ * @return The indices of each color
+ */
+inline std::vector<std::vector<size_t>> color_groups(std::vector<size_t> const & colors, size_t n_colors) {
+    std::vector<std::vector<size_t>> groups(n_colors);
+    for(size_t j = 0; j < colors.size(); ++j) {
+        groups[colors[j]].push_back(j);
+    }
+    return groups;
+}
+
+}; // namespace autodiff
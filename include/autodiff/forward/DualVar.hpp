@@ -141,6 +141,7 @@ public:
     CUDA_HOST_DEVICE \
     DualVar<T> & operator*=(T const & rhs) {
         real_ = real_ * rhs;
+        inf_ = inf_ * rhs;
         return *this;
     }
 
@@ -150,7 +151,7 @@ public:
     CUDA_HOST_DEVICE \
     DualVar<T> operator/(DualVar<T> const & rhs) const {
     return DualVar<T>(real_ / rhs.real_,
-        (inf_ * rhs.real_ + real_ * rhs.inf_) / (rhs.real_ * rhs.real_));
+        (inf_ * rhs.real_ - real_ * rhs.inf_) / (rhs.real_ * rhs.real_));
     }
 
     CUDA_HOST_DEVICE \
@@ -163,7 +164,7 @@ public:
 
     CUDA_HOST_DEVICE \
     DualVar<T> & operator/=(DualVar<T> const & rhs) {
-        inf_ = (inf_ * rhs.real_ + real_ * rhs.inf_) / (rhs.real_ * rhs.real_);
+        inf_ = (inf_ * rhs.real_ - real_ * rhs.inf_) / (rhs.real_ * rhs.real_);
         real_ = real_ / rhs.real_;
         return *this;
     }
@@ -214,6 +215,12 @@ public:
     template <typename U> CUDA_HOST_DEVICE \
     friend DualVar<U> tanh(DualVar<U> const & arg);
 
+    template <typename U> CUDA_HOST_DEVICE \
+    friend DualVar<U> cosh(DualVar<U> const & arg);
+
+    template <typename U> CUDA_HOST_DEVICE \
+    friend DualVar<U> sinh(DualVar<U> const & arg);
+
     /******** Other Operators ********/
     bool operator<(DualVar<T> const & rhs) const {
         return (real_ < rhs.real_);
@@ -303,7 +310,7 @@ DualVar<T> operator*(T const & lhs, DualVar<T> const & rhs) {
 /***************************************************************/
 template <typename T> CUDA_HOST_DEVICE \
 DualVar<T> operator/(T const & lhs, DualVar<T> const & rhs) {
-    return DualVar<T> (lhs / rhs.real_, lhs * rhs.inf_ / (rhs.real_ * rhs.real_));
+    return DualVar<T> (lhs / rhs.real_, -lhs * rhs.inf_ / (rhs.real_ * rhs.real_));
 }
 
 /***************************************************************/
@@ -400,6 +407,16 @@ DualVar<T> tanh(DualVar<T> const & arg) {
     return DualVar<T>(val, deriv * arg.inf_);
 }
 
+template <typename T> CUDA_HOST_DEVICE \
+DualVar<T> cosh(DualVar<T> const & arg) {
+    return DualVar<T>(std::cosh(arg.real_), arg.inf_ * std::sinh(arg.real_));
+}
+
+template <typename T> CUDA_HOST_DEVICE \
+DualVar<T> sinh(DualVar<T> const & arg) {
+    return DualVar<T>(std::sinh(arg.real_), arg.inf_ * std::cosh(arg.real_));
+}
+
     
 }; // namespace forward
 }; // namespace autodiff
@@ -2,9 +2,14 @@
 
 #include <vector>
 #include <functional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
 #include <Eigen/Dense>
+#include <Eigen/SparseCore>
 
 #include "DualVar.hpp"
+#include "Coloring.hpp"
 
 namespace autodiff {
 namespace forward {
@@ -72,6 +77,154 @@ RealVec<T> gradient(
 
 
 
+/**
+ * @class Workspace
+ * @brief The buffers reused by the overloads of `gradient` and `jacobian`
+ * taking a workspace, so that repeated calls on inputs of the same size
+ * don't allocate.
+ *
+ * A Workspace must not be shared between threads.
+ */
+template <typename T>
+struct Workspace {
+    DualVec<T> x;       // the (seeded) inputs
+    DualVec<T> y;       // the outputs of the last evaluation
+};
+
+/**
+ * Writes `x` in the (unseeded) inputs of a workspace
+ */
+template <typename T, typename Derived>
+void set_inputs(Workspace<T> & ws, Eigen::DenseBase<Derived> const & x) {
+    if(ws.x.size() != x.size()) {
+        ws.x.resize(x.size());
+    }
+    for(int i = 0; i < x.size(); i++) {
+        ws.x[i] = DualVar<T>(x[i], 0.0);
+    }
+}
+
+/**
+ * Computes the gradient of a function along with the value of that
+ * function at the given point, without allocating (once the workspace has
+ * been used with inputs of the same size).
+ *
+ * The function can be any callable taking a `DualVec<T> const &` and
+ * returning a `DualVar<T>`: it is called directly (no `std::function`),
+ * once per input.
+ *
+ * @param f Function whose gradient is to be computed
+ * @param x The point where the function and the gradient must be evaluated
+ * @param f_x (OUT) The value of the function at the given point
+ * @param grad (OUT) The gradient of the function at the given point, it
+ * must have the size of `x`
+ * @param ws The workspace
+ */
+template <typename T, typename F>
+void gradient(
+    F && f,
+    std::type_identity_t<Eigen::Ref<RealVec<T> const>> x,
+    T & f_x,
+    std::type_identity_t<Eigen::Ref<RealVec<T>>> grad,
+    Workspace<T> & ws
+) {
+    if(grad.size() != x.size()) {
+        throw std::invalid_argument("gradient: grad must have the size of x");
+    }
+
+    set_inputs(ws, x);
+    DualVec<T> const & xd = ws.x;
+
+    if(x.size() == 0) {
+        f_x = f(xd).getReal();
+    }
+    for(int i = 0; i < x.size(); i++){
+        ws.x[i].setInf(1.0);
+        DualVar<T> res = f(xd);
+        grad[i] = res.getInf();
+        ws.x[i].setInf(0.0);
+        f_x = res.getReal();
+    }
+}
+
+/**
+ * Same as the overload above, for functions of a contiguous sequence of
+ * `DualVar`(s): the function is called with a `std::span<DualVar<T> const>`
+ * viewing the inputs of the workspace (no copy per direction).
+ */
+template <typename T, typename F>
+void gradient(
+    F && f,
+    std::type_identity_t<std::span<T const>> x,
+    T & f_x,
+    std::type_identity_t<std::span<T>> grad,
+    Workspace<T> & ws
+) {
+    if(grad.size() != x.size()) {
+        throw std::invalid_argument("gradient: grad must have the size of x");
+    }
+
+    set_inputs(ws, Eigen::Map<RealVec<T> const>(x.data(), x.size()));
+    std::span<DualVar<T> const> xd(ws.x.data(), x.size());
+
+    if(x.empty()) {
+        f_x = f(xd).getReal();
+    }
+    for(size_t i = 0; i < x.size(); i++){
+        ws.x[i].setInf(1.0);
+        DualVar<T> res = f(xd);
+        grad[i] = res.getInf();
+        ws.x[i].setInf(0.0);
+        f_x = res.getReal();
+    }
+}
+
+/**
+ * Computes the jacobian of a function along with the value of that
+ * function at the given point, reusing the buffers of a workspace.
+ *
+ * The function can be any callable taking a `DualVec<T> const &` and
+ * returning a `DualVec<T>`: it is called directly (no `std::function`),
+ * once per input. Unlike the overload without workspace, the columns
+ * are computed sequentially.
+ *
+ * @param f Function whose jacobian is to be computed
+ * @param x The point where the function and the jacobian must be evaluated
+ * @param f_x (OUT) The value of the function at the given point, it must
+ * have the size of the output
+ * @param jac (OUT) The jacobian of the function at the given point, it
+ * must already have the right size
+ * @param ws The workspace
+ */
+template <typename T, typename F>
+void jacobian(
+    F && f,
+    std::type_identity_t<Eigen::Ref<RealVec<T> const>> x,
+    std::type_identity_t<Eigen::Ref<RealVec<T>>> f_x,
+    std::type_identity_t<Eigen::Ref<JacType<T>>> jac,
+    Workspace<T> & ws
+) {
+    set_inputs(ws, x);
+    DualVec<T> const & xd = ws.x;
+
+    ws.y = f(xd);
+    if(f_x.size() != ws.y.size() || jac.rows() != ws.y.size() || jac.cols() != x.size()) {
+        throw std::invalid_argument("jacobian: f_x and jac must have the sizes of the output and of the input");
+    }
+    for (int i = 0; i < ws.y.size(); i++) {
+      f_x[i] = ws.y[i].getReal();
+    }
+
+    for (int i = 0; i < x.size(); i++) {
+      ws.x[i].setInf(1.0);
+      ws.y = f(xd);
+      for (int j = 0; j < ws.y.size(); j++) {
+        jac(j, i) = ws.y[j].getInf();
+      }
+      ws.x[i].setInf(0.0);
+    }
+}
+
 /**
  * Computes the jacobian of a function along with the value of that
  * function at the given point.
@@ -122,6 +275,75 @@ inline void jacobian(
     }
 }
 
+/**
+ * Computes a sparse jacobian (whose sparsity pattern is known) along with
+ * the value of the function at the given point.
+ *
+ * The columns are colored (see `color_columns`) and the function is
+ * evaluated once per color, seeding all the inputs of that color at once.
+ * Each nonzero of the result is then read from the evaluation of the color
+ * of its column.
+ *
+ * @param f Function whose jacobian is to be computed
+ * @param x The point where the function and the jacobian must be evaluated
+ * @param pattern The sparsity pattern of the jacobian (every nonzero of the
+ * jacobian must be in the pattern)
+ * @param f_x (OUT) The value of the function at the given point
+ * @param jac (OUT) The jacobian of the function at the given point, with
+ * the same nonzeros of `pattern`
+ */
+template <typename T>
+inline void sparse_jacobian(
+    std::function<DualVec<T>(DualVec<T>)> f,
+    RealVec<T> const & x,
+    SparsityPattern const & pattern,
+    RealVec<T> & f_x,
+    Eigen::SparseMatrix<T> & jac
+) {
+    std::size_t input_dim = x.size();
+    if(pattern.cols() != input_dim) {
+        throw std::invalid_argument("sparse_jacobian: the pattern must have a column per input");
+    }
+
+    size_t n_colors;
+    std::vector<size_t> colors = color_columns(pattern, n_colors);
+    std::vector<std::vector<size_t>> groups = color_groups(colors, n_colors);
+
+    DualVec<T> x0d(input_dim);
+    for(int i = 0; i < input_dim; i++) {
+      x0d[i] = DualVar<T>(x[i], 0.0);
+    }
+
+    DualVec<T> eval = f(x0d);
+    std::size_t output_dim = eval.size();
+    if(pattern.rows() != output_dim) {
+        throw std::invalid_argument("sparse_jacobian: the pattern must have a row per output");
+    }
+    f_x.resize(output_dim);
+    for (int i = 0; i < output_dim; i++) {
+      f_x[i] = eval[i].getReal();
+    }
+
+    jac = pattern.template cast<T>();
+    jac.makeCompressed();
+
+    // the columns of different colors are disjoint
+    #pragma omp parallel for \
+      firstprivate(x0d, eval) shared(jac, groups)
+    for (int c = 0; c < n_colors; c++) {
+      for (size_t j: groups[c]) {
+        x0d[j].setInf(1.0);
+      }
+      eval = f(x0d);
+      for (size_t j: groups[c]) {
+        for (typename Eigen::SparseMatrix<T>::InnerIterator it(jac, j); it; ++it) {
+          it.valueRef() = eval[it.row()].getInf();
+        }
+        x0d[j].setInf(0.0);
+      }
+    }
+}
+
 #ifdef __CUDACC__
 
 /**
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <memory>
 #include <new>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
 namespace autodiff {
 namespace reverse {
 
@@ -17,25 +24,50 @@ namespace reverse {
 //  1. It's not possible to reuse the same underlying memory multiple times
 // => We need a custom allocator
 
+/**
+ * @brief How an `ArenaAllocator` requests memory
+ */
+struct ArenaPolicy {
+    // Size of the first block
+    size_t block_size = 4096;
+    // Each new block is `growth` times bigger than the previous one...
+    double growth = 2.0;
+    // ...up to `max_block_size`
+    size_t max_block_size = size_t{64} << 20;
+    // Objects bigger than this get their own allocation instead of
+    //  being placed in a block
+    size_t large_object_size = size_t{1} << 20;
+    // Allocate the memory with mmap instead of operator new
+    //  (only on POSIX systems, ignored elsewhere)
+    bool use_mmap = false;
+    // Ask for transparent huge pages for the mmap-ed regions
+    //  which are big enough
+    bool huge_pages = false;
+};
+
 /**
  * @class ArenaAllocator
  * @brief Memory pool that can dynamically increase in size and that allows to reuse
  * the underlying memory multiple times
- * @tparam BLOCK_SIZE The size of the blocks that are allocated
- * 
+ *
  * EXAMPLE:
- *     Block#0                 Block#1                    Block#N             
- *     +---+-+-----+------+    +----+-------+-----+       +------------------+
- *     |   |x|     |      |    |    |       |     |       |                  |
- *     |obj|x| obj | obj  |    |obj |  obj  |     |  ...  |                  |
- *     |   |x|     |      |    |    |       |     |       |                  |
- *     +---+-+-----+------+    +----+-------+-----+       +------------------+
- *          ^                               ^             ^
- *          |                               |             |                   
- *          Unused space due to             data_         A block that is not currently
- *          alignment                                     used that was previously allocated
+ *     Block#0        Block#1                     Block#N
+ *     +---+-+----+  +----+-------+-----------+       +----------------------------+
+ *     |   |x|    |  |    |       |           |       |                            |
+ *     |obj|x|obj |  |obj |  obj  |           |  ...  |                            |
+ *     |   |x|    |  |    |       |           |       |                            |
+ *     +---+-+----+  +----+-------+-----------+       +----------------------------+
+ *          ^                     ^                   ^
+ *          |                     |                   |
+ *          Unused space due to   data_               A block that is not currently
+ *          alignment                                 used that was previously allocated
+ *
+ * The size of the blocks grows geometrically (see `ArenaPolicy`), so that
+ * big Tapes only need a few allocations. Objects bigger than
+ * `ArenaPolicy::large_object_size` are not placed in the blocks: each one
+ * gets its own allocation, which is kept (and reused) across `clear`(s)
+ * as well.
  */
-template <size_t BLOCK_SIZE = 4096>
 class ArenaAllocator {
     using Byte = std::byte;
 public:
@@ -49,31 +81,32 @@ public:
     //      contain a lot of objects
     ArenaAllocator(ArenaAllocator const &) = delete;
     ArenaAllocator& operator=(ArenaAllocator const &) = delete;
-    
+
     // Move allowed
     //  (we need to declare them because deleting the copy and
     //  copy-assignment, deletes these as well)
     ArenaAllocator(ArenaAllocator &&) = default;
     ArenaAllocator& operator=(ArenaAllocator &&) = default;
 
-    ArenaAllocator():
-        remaining_size_{BLOCK_SIZE},
-        current_block_{0}
+    explicit ArenaAllocator(ArenaPolicy const & policy = ArenaPolicy{}):
+        policy_{policy}
     {
-        // Note: by doing this we avoid memory leaks
-        auto new_block = std::make_unique<Byte[]>(BLOCK_SIZE);
-        blocks_start_.emplace_back(std::move(new_block));
-        data_ = blocks_start_.back().get();
+        if(policy_.block_size == 0 || policy_.growth < 1.0) {
+            throw std::invalid_argument("invalid arena policy");
+        }
+        blocks_.push_back(Chunk(policy_.block_size, policy_));
+        ++n_blocks_allocated_;
+        clear();
     }
 
     /**
      * Returns a pointer to a region of memory where an object of
      * size `size` and with alignment constraint `alignment`
      * can be constructed
-     * 
+     *
      * @param size The size of the object to be constructed
      * @param alignment Alignment constraint of the object
-     * 
+     *
      * alignment must be a power of 2 (if not then UB for std::align)
      */
     void * alloc(size_t const size, size_t const alignment) {
@@ -82,8 +115,8 @@ public:
             throw std::invalid_argument("alignment must be a power of 2");
         }
 
-        if(size > BLOCK_SIZE) [[unlikely]] {
-            throw std::bad_alloc();
+        if(size > policy_.large_object_size) [[unlikely]] {
+            return alloc_large(size, alignment);
         }
 
         // Align the "data_" pointer for the next allocation
@@ -93,59 +126,40 @@ public:
         //  ii) On failure => "res" is nullptr and no updates to the variables
         //      take place.
         void * res = std::align(alignment, size, data_, remaining_size_);
-        
-        if(!res) [[unlikely]] {
-
-            // The aligned object can't be allocated in the current block
-            //  => allocate new block or reuse one if it already exists
-
-            if(current_block_ + 1 < blocks_start_.size()) {
-                // reuse next block
-                data_ = blocks_start_[current_block_+1].get();
-
-            } else {
-                // allocate new block
-                // Note: by doing this we avoid memory leaks
-                auto new_block = std::make_unique<Byte[]>(BLOCK_SIZE);
-                blocks_start_.emplace_back(std::move(new_block));
-                data_ = blocks_start_.back().get();
-
-            }
 
-            ++current_block_;
-            remaining_size_ = BLOCK_SIZE;
-
-            // Now we must align the "data_" pointer wrt the "alignment"
-            //  parameter
-            // This is not strictly necessary because if we are using
-            //  a new block then "new" (malloc) has already taken care
-            //  of the alignment for us, but here we are considering an
-            //  "alignment" parameter so it must be done just to be sure.
+        // The aligned object can't be allocated in the current block
+        //  => reuse the next blocks if they already exist (and are big
+        //  enough) or allocate a new one
+        while(!res && current_block_ + 1 < blocks_.size()) {
+            next_block();
+            ++n_blocks_reused_;
+            res = std::align(alignment, size, data_, remaining_size_);
+        }
+        if(!res) {
+            size_t grown = static_cast<size_t>(blocks_.back().size * policy_.growth);
+            size_t block_size = std::max(
+                std::min(grown, policy_.max_block_size),
+                size + alignment
+            );
+            blocks_.push_back(Chunk(block_size, policy_));
+            ++n_blocks_allocated_;
+            next_block();
             res = std::align(alignment, size, data_, remaining_size_);
-
-            // This can happen if, for some strange allignment constraints,
-            //  the allocation request doesn't fit in the empty block even tough
-            //  the size of the request is <= BLOCK_SIZE.
-            //  (This is very unlikely especially given the use of the arena
-            //  allocator in this library but must be checked)
-            if(!res) {
-                throw std::bad_alloc();
-            }
         }
 
         // Move the "data_" pointer forward for the next allocation and
         //  shrink the "remaining_size_"
-        void * tmp = data_;
         data_ = reinterpret_cast<Byte*>(data_) + size;
         remaining_size_ -= size;
-        
-        return tmp;
+        high_water_mark_ = std::max(high_water_mark_, used_size());
+
+        return res;
     }
 
     /**
      * This functions deos nothing because this ArenaAllocator
      *  deallocates (i.e. returns the used memory to malloc/OS)
-     *  only when it is destroyed
+     *  only when it is released or destroyed
      */
     // void dealloc() {}
 
@@ -153,22 +167,252 @@ public:
      * Resets the arena allocator without releasing the used memory
      */
     void clear() {
-        data_ = blocks_start_[0].get();
-        remaining_size_ = BLOCK_SIZE;
+        data_ = blocks_[0].ptr;
+        remaining_size_ = blocks_[0].size;
         current_block_ = 0;
+        used_before_current_ = 0;
+
+        for(auto & chunk: large_) {
+            large_used_ -= chunk.size;
+            large_free_.push_back(std::move(chunk));
+        }
+        large_.clear();
+    }
+
+    /**
+     * The state of the arena at a given time (see `mark` and `rewind`)
+     */
+    struct Mark {
+        void * data;
+        size_t remaining_size;
+        size_t current_block;
+        size_t used_before_current;
+        size_t n_large;
+    };
+
+    /**
+     * Returns the current state of the arena: `rewind(mark())` frees every
+     * object allocated after the call to `mark`
+     */
+    Mark mark() const {
+        return Mark{data_, remaining_size_, current_block_, used_before_current_, large_.size()};
+    }
+
+    /**
+     * Frees (without releasing the memory) every object allocated after
+     * `mark` was taken, keeping the ones allocated before it. As with
+     * `clear`, the blocks and the large objects are kept for reuse.
+     *
+     * The arena must not have been cleared since `mark` was taken.
+     */
+    void rewind(Mark const & mark) {
+        data_ = mark.data;
+        remaining_size_ = mark.remaining_size;
+        current_block_ = mark.current_block;
+        used_before_current_ = mark.used_before_current;
+
+        size_t n_large = std::min(large_.size(), mark.n_large);
+        for(size_t i = n_large; i < large_.size(); ++i) {
+            large_used_ -= large_[i].size;
+            large_free_.push_back(std::move(large_[i]));
+        }
+        large_.erase(large_.begin() + n_large, large_.end());
     }
 
-    size_t n_blocks() const { return blocks_start_.size(); }
+    /**
+     * Resets the arena allocator and returns all the memory but
+     * the first block
+     */
+    void release() {
+        clear();
+        blocks_.erase(blocks_.begin() + 1, blocks_.end());
+        large_free_.clear();
+    }
+
+    /**
+     * Returns the unused memory, keeping enough blocks to hold `size`
+     * bytes (e.g. the `high_water_mark`) without new allocations.
+     * The blocks in use are never released.
+     */
+    void shrink_to(size_t size) {
+        size_t keep = current_block_ + 1;
+        size_t capacity = 0;
+        for(size_t i = 0; i < keep; ++i) {
+            capacity += blocks_[i].size;
+        }
+        while(keep < blocks_.size() && capacity < size) {
+            capacity += blocks_[keep].size;
+            ++keep;
+        }
+        blocks_.erase(blocks_.begin() + keep, blocks_.end());
+        large_free_.clear();
+    }
+
+    size_t n_blocks() const { return blocks_.size(); }
     size_t current_block() const { return current_block_; }
     size_t remaining_size() const { return remaining_size_; }
-    size_t total_size() const { return n_blocks()*BLOCK_SIZE; }
     void * data() const { return data_; }
+    ArenaPolicy const & policy() const { return policy_; }
+
+    /**
+     * Returns the number of bytes reserved by the arena (blocks and
+     * large objects)
+     */
+    size_t total_size() const {
+        size_t size = 0;
+        for(auto const & chunk: blocks_) {
+            size += chunk.size;
+        }
+        for(auto const & chunk: large_) {
+            size += chunk.size;
+        }
+        for(auto const & chunk: large_free_) {
+            size += chunk.size;
+        }
+        return size;
+    }
+
+    /**
+     * Returns the number of bytes used since the last `clear`
+     * (including the padding and the unused space at the end of the
+     * blocks which have been filled)
+     */
+    size_t used_size() const {
+        return used_before_current_ + (blocks_[current_block_].size - remaining_size_) + large_used_;
+    }
+
+    /**
+     * Returns the maximum of `used_size` over the lifetime of the arena
+     */
+    size_t high_water_mark() const { return high_water_mark_; }
+
+    /**
+     * Returns the number of objects which got their own allocation
+     * since the last `clear`
+     */
+    size_t n_large_objects() const { return large_.size(); }
+
+    /**
+     * Returns the number of blocks (and large objects) allocated, and
+     * the number of times an already allocated one has been reused,
+     * over the lifetime of the arena
+     */
+    size_t n_blocks_allocated() const { return n_blocks_allocated_; }
+    size_t n_blocks_reused() const { return n_blocks_reused_; }
+
 private:
+    /**
+     * A region of memory owned by the arena
+     */
+    struct Chunk {
+        Byte * ptr = nullptr;
+        size_t size = 0;
+        bool mapped = false;
+
+        Chunk(size_t size, ArenaPolicy const & policy): size{size} {
+#if defined(__unix__) || defined(__APPLE__)
+            if(policy.use_mmap) {
+                void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(p == MAP_FAILED) {
+                    throw std::bad_alloc();
+                }
+#ifdef MADV_HUGEPAGE
+                if(policy.huge_pages && size >= HUGE_PAGE_SIZE) {
+                    madvise(p, size, MADV_HUGEPAGE);
+                }
+#endif
+                ptr = static_cast<Byte*>(p);
+                mapped = true;
+                return;
+            }
+#endif
+            ptr = static_cast<Byte*>(::operator new(size));
+        }
+
+        Chunk(Chunk const &) = delete;
+        Chunk& operator=(Chunk const &) = delete;
+
+        Chunk(Chunk && other) noexcept:
+            ptr{std::exchange(other.ptr, nullptr)},
+            size{std::exchange(other.size, 0)},
+            mapped{other.mapped}
+        {}
+        Chunk& operator=(Chunk && other) noexcept {
+            std::swap(ptr, other.ptr);
+            std::swap(size, other.size);
+            std::swap(mapped, other.mapped);
+            return *this;
+        }
+
+        ~Chunk() {
+            if(!ptr) {
+                return;
+            }
+#if defined(__unix__) || defined(__APPLE__)
+            if(mapped) {
+                munmap(ptr, size);
+                return;
+            }
+#endif
+            ::operator delete(ptr);
+        }
+    };
+
+    static constexpr size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+
+    /**
+     * Moves to the next (already allocated) block
+     */
+    void next_block() {
+        used_before_current_ += blocks_[current_block_].size;
+        ++current_block_;
+        data_ = blocks_[current_block_].ptr;
+        remaining_size_ = blocks_[current_block_].size;
+    }
+
+    /**
+     * Allocates an object which doesn't fit in the blocks: a free large
+     * allocation is reused if possible
+     */
+    void * alloc_large(size_t const size, size_t const alignment) {
+        size_t const needed = size + alignment;
+
+        auto it = std::find_if(large_free_.begin(), large_free_.end(), [needed](Chunk const & chunk) {
+            return chunk.size >= needed;
+        });
+        if(it != large_free_.end()) {
+            large_.push_back(std::move(*it));
+            large_free_.erase(it);
+            ++n_blocks_reused_;
+        } else {
+            large_.push_back(Chunk(needed, policy_));
+            ++n_blocks_allocated_;
+        }
+        large_used_ += large_.back().size;
+        high_water_mark_ = std::max(high_water_mark_, used_size());
+
+        void * ptr = large_.back().ptr;
+        size_t space = large_.back().size;
+        return std::align(alignment, size, ptr, space);
+    }
+
+    ArenaPolicy policy_;
+
     void * data_;
     size_t remaining_size_;
-    std::vector<std::unique_ptr<Byte[]>> blocks_start_;
+    std::vector<Chunk> blocks_;
     size_t current_block_;
+
+    // Objects bigger than `policy_.large_object_size`
+    std::vector<Chunk> large_;
+    std::vector<Chunk> large_free_;
+
+    size_t used_before_current_ = 0;
+    size_t large_used_ = 0;
+    size_t high_water_mark_ = 0;
+    size_t n_blocks_allocated_ = 0;
+    size_t n_blocks_reused_ = 0;
 };
 
 }; // namespace reverse
-}; // namespace autodiff 
+}; // namespace autodiff
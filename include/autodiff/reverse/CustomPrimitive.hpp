@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Var.hpp"
+
+/**
+ * User-defined primitives of the reverse mode.
+ *
+ * A primitive is an operation with `n_inputs` scalar inputs and `n_outputs`
+ * scalar outputs which is recorded in the Tape as a single `BlockNode`
+ * (see `MatrixFunctions.hpp`), whatever it computes internally: e.g. a
+ * tabulated interpolation, a hand-optimized kernel or a call into a numerical
+ * library. Its derivatives are given by the user as a vector-Jacobian product,
+ * hence the operation itself is never traced.
+ *
+ * EXAMPLE:
+ *     // (r, phi) = polar(x, y)
+ *     auto polar = register_primitive<double>("polar", 2, 2,
+ *         [](double const * in, double * out) {
+ *             out[0] = std::hypot(in[0], in[1]);
+ *             out[1] = std::atan2(in[1], in[0]);
+ *         },
+ *         [](double const * in, double const * out, double const * out_grads, double * in_grads) {
+ *             double r2 = out[0] * out[0];
+ *             in_grads[0] = out_grads[0] * in[0] / out[0] - out_grads[1] * in[1] / r2;
+ *             in_grads[1] = out_grads[0] * in[1] / out[0] + out_grads[1] * in[0] / r2;
+ *         });
+ *     auto rphi = call_primitive(polar, {x, y});
+ *
+ * A recorded primitive is replayed by `NodeManager::forward` like any other
+ * node. As every `BlockNode`, it has no second derivatives (`hessian` throws)
+ * and it can't be saved by `save_tape`.
+ */
+
+namespace autodiff {
+namespace reverse {
+
+/**
+ * @struct Primitive
+ * @brief The definition of a user-defined primitive
+ * @tparam T The type of the underlying variables
+ */
+template <typename T>
+struct Primitive {
+    /**
+     * Computes the `n_outputs` outputs given the `n_inputs` inputs
+     */
+    using Forward = std::function<void(T const * inputs, T * outputs)>;
+
+    /**
+     * Computes the adjoints of the inputs (`input_grads`, zero-initialized)
+     * given the inputs, the outputs and the adjoints of the outputs, i.e.
+     * the product of the transposed jacobian and `output_grads`
+     */
+    using Adjoint = std::function<void(
+        T const * inputs, T const * outputs, T const * output_grads, T * input_grads
+    )>;
+
+    std::string name;
+    size_t n_inputs;
+    size_t n_outputs;
+    Forward forward;
+    Adjoint adjoint;
+};
+
+/**
+ * @class PrimitiveRegistry
+ * @brief The primitives registered for the type `T`, shared by every Tape
+ * and every thread. A registered primitive is never removed.
+ * @tparam T The type of the underlying variables
+ */
+template <typename T>
+class PrimitiveRegistry {
+public:
+    static PrimitiveRegistry & instance() {
+        static PrimitiveRegistry registry;
+        return registry;
+    }
+
+    /**
+     * Registers a primitive and returns its identifier
+     */
+    size_t add(Primitive<T> primitive) {
+        if(!primitive.forward || !primitive.adjoint) {
+            throw std::invalid_argument("register_primitive: " + primitive.name + " has no forward or adjoint function");
+        }
+        if(primitive.n_outputs == 0) {
+            throw std::invalid_argument("register_primitive: " + primitive.name + " has no outputs");
+        }
+        std::unique_lock lock(mutex_);
+        // a deque never moves its elements: the references returned by `get`
+        // stay valid while other primitives are registered
+        primitives_.push_back(std::move(primitive));
+        return primitives_.size() - 1;
+    }
+
+    /**
+     * Returns the primitive with the given identifier
+     */
+    Primitive<T> const & get(size_t id) const {
+        std::shared_lock lock(mutex_);
+        if(id >= primitives_.size()) {
+            throw std::out_of_range("unknown primitive");
+        }
+        return primitives_[id];
+    }
+
+    /**
+     * Returns the number of registered primitives
+     */
+    size_t size() const {
+        std::shared_lock lock(mutex_);
+        return primitives_.size();
+    }
+
+private:
+    PrimitiveRegistry() = default;
+
+    mutable std::shared_mutex mutex_;
+    std::deque<Primitive<T>> primitives_;
+};
+
+// The kernels of the `BlockNode` of a primitive. dims = {id, n_inputs, n_outputs}
+template <typename T>
+struct PrimitiveBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        PrimitiveRegistry<T>::instance().get(dims[0]).forward(operands, outputs);
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        PrimitiveRegistry<T>::instance().get(dims[0]).adjoint(operands, outputs, output_grads, operand_grads);
+    }
+};
+
+/**
+ * Registers a primitive (see `Primitive`)
+ *
+ * @param name The name of the primitive (used in the error messages)
+ * @param n_inputs The number of inputs
+ * @param n_outputs The number of outputs
+ * @param forward The forward function
+ * @param adjoint The vector-Jacobian product
+ * @return The identifier of the primitive, to be passed to `call_primitive`
+ */
+template <typename T>
+size_t register_primitive(
+    std::string name, size_t n_inputs, size_t n_outputs,
+    typename Primitive<T>::Forward forward,
+    typename Primitive<T>::Adjoint adjoint
+) {
+    return PrimitiveRegistry<T>::instance().add(Primitive<T>{
+        std::move(name), n_inputs, n_outputs, std::move(forward), std::move(adjoint)
+    });
+}
+
+/**
+ * Records a call to a primitive in the active Tape
+ *
+ * @param id The identifier returned by `register_primitive`
+ * @param inputs The inputs of the call
+ * @return The `Var`(s) tracking the outputs of the call
+ */
+template <typename U>
+std::vector<Var<U>> call_primitive(size_t id, std::span<Var<U> const> inputs) {
+    Primitive<U> const & primitive = PrimitiveRegistry<U>::instance().get(id);
+    if(inputs.size() != primitive.n_inputs) {
+        throw std::invalid_argument(
+            "call_primitive: " + primitive.name + " expects " + std::to_string(primitive.n_inputs) + " inputs"
+        );
+    }
+
+    std::vector<NodeIdx> args;
+    args.reserve(inputs.size());
+    for(auto const & input: inputs) {
+        args.push_back(static_cast<NodeIdx>(input.index()));
+    }
+
+    std::array<NodeIdx, 3> dims = {
+        static_cast<NodeIdx>(id), static_cast<NodeIdx>(primitive.n_inputs), static_cast<NodeIdx>(primitive.n_outputs)
+    };
+    size_t first = new_block<U>(
+        args.data(), args.size(), primitive.n_outputs, dims,
+        &PrimitiveBlock<U>::forward, &PrimitiveBlock<U>::backward
+    );
+
+    std::vector<Var<U>> outputs;
+    outputs.reserve(primitive.n_outputs);
+    for(size_t j = 0; j < primitive.n_outputs; ++j) {
+        outputs.push_back(Var<U>::from_index(first + j));
+    }
+    return outputs;
+}
+
+template <typename U>
+std::vector<Var<U>> call_primitive(size_t id, std::vector<Var<U>> const & inputs) {
+    return call_primitive(id, std::span<Var<U> const>(inputs));
+}
+
+template <typename U>
+std::vector<Var<U>> call_primitive(size_t id, std::initializer_list<Var<U>> inputs) {
+    return call_primitive(id, std::span<Var<U> const>(inputs.begin(), inputs.size()));
+}
+
+}; // namespace reverse
+}; // namespace autodiff
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+
+#include "DualVar.hpp"
+#include "NodeManager.hpp"
+#include "Functions.hpp"
+
+/**
+ * Expression templates for reverse mode.
+ *
+ * The operators of `Var` don't record anything in the Tape: they return
+ * lightweight expression objects whose type describes the whole right-hand
+ * side of a statement (e.g. `a*b + c*d - e`). The Tape is only touched when
+ * the expression is converted to a `Var`:
+ *  - an expression made of a single operation whose operands are `Var`(s)
+ *    (e.g. `a*b`, `sin(a)`, `2.0*a`) is recorded as the corresponding node
+ *  - any other expression is recorded as a single `StatementNode`, whose
+ *    arguments are the `Var`(s) of the statement and whose local partials
+ *    are computed with a (compile-time unrolled) reverse sweep over the
+ *    expression (statement-level preaccumulation)
+ *
+ * Every expression type provides:
+ *  - `n_nodes`, `n_leaves`, `n_constants`: the number of operations + leaves,
+ *    of leaves and of constant operands of the expression
+ *  - `gather(args, constants)`: writes the indices of its leaves and its
+ *    constants, in depth-first order
+ *  - `static forward(values, args, constants, locals)`: evaluates the
+ *    expression given the values of the nodes of the Tape; the value of each
+ *    sub-expression is stored in `locals` (post-order, the last one is
+ *    the value of the expression)
+ *  - `static reverse(locals, constants, adjoint, partials)`: writes the
+ *    derivative of the statement wrt each one of the leaves of the expression
+ *  - `record()`: records the expression in the active Tape and returns the
+ *    index of the resulting node
+ *
+ * `forward` and `reverse` are templated on the type of the values, so that
+ * the same expression can also be differentiated with dual numbers (see
+ * `hessian_statement`).
+ *
+ * Since the sub-expressions (and the `Var`(s), which are just indices) are
+ * stored by value, an expression never refers to a temporary.
+ *
+ * NOTE: `auto z = a*b + c;` holds an expression, not a `Var`. It is recorded
+ * the first time it is used as a whole (conversion to `Var`, `index()`,
+ * `backward()`, `grad()`, comparisons) and that node is reused afterwards,
+ * so `z` behaves like a `Var` of the Tape which was active at that time.
+ * When `z` appears inside a larger expression, its operations are fused in
+ * the statement of that expression instead.
+ */
+
+namespace autodiff {
+namespace reverse {
+
+/**
+ * Concept satisfied by the expression types defined in this file
+ */
+template <typename E>
+concept Expression = std::remove_cvref_t<E>::is_expression;
+
+template <typename E>
+typename E::Scalar expression_value(E const & expr);
+
+/**
+ * @class LeafExpr
+ * @brief A `Var` appearing in an expression
+ * @tparam T The type of the underlying variables
+ */
+template <typename T>
+struct LeafExpr {
+    using Scalar = T;
+    static constexpr bool is_expression = true;
+    static constexpr std::size_t n_nodes = 1;
+    static constexpr std::size_t n_leaves = 1;
+    static constexpr std::size_t n_constants = 0;
+
+    NodeIdx idx;
+
+    void gather(NodeIdx * args, T *) const {
+        args[0] = idx;
+    }
+    template <typename S>
+    static void forward(S const * values, NodeIdx const * args, S const *, S * locals) {
+        locals[0] = values[args[0]];
+    }
+    template <typename S>
+    static void reverse(S const *, S const *, S const & adjoint, S * partials) {
+        partials[0] = adjoint;
+    }
+    size_t record() const {
+        return idx;
+    }
+    T value() const {
+        return expression_value(*this);
+    }
+};
+
+/**
+ * @class UnaryExpr
+ * @brief Expression for a `UnaryNode` applied to a sub-expression
+ * @tparam Op The `UnaryNode`
+ * @tparam A The type of the argument
+ */
+template <template <typename> class Op, typename A>
+struct UnaryExpr {
+    using Scalar = typename A::Scalar;
+    using T = Scalar;
+    static constexpr bool is_expression = true;
+    static constexpr std::size_t n_nodes = A::n_nodes + 1;
+    static constexpr std::size_t n_leaves = A::n_leaves;
+    static constexpr std::size_t n_constants = A::n_constants;
+
+    A arg;
+    // the node of the expression once recorded (0: not recorded yet)
+    mutable size_t node = 0;
+
+    void gather(NodeIdx * args, T * constants) const {
+        arg.gather(args, constants);
+    }
+    template <typename S>
+    static void forward(S const * values, NodeIdx const * args, S const * constants, S * locals) {
+        A::forward(values, args, constants, locals);
+        locals[n_nodes-1] = Op<S>::forward(locals[A::n_nodes-1]);
+    }
+    template <typename S>
+    static void reverse(S const * locals, S const * constants, S const & adjoint, S * partials) {
+        S d_arg = Op<S>::partial(locals[n_nodes-1], locals[A::n_nodes-1]);
+        A::reverse(locals, constants, adjoint * d_arg, partials);
+    }
+    size_t record() const {
+        if(node == 0) {
+            if constexpr (A::n_nodes == 1) {
+                node = new_node<Op, T>(arg.idx);
+            } else {
+                node = new_statement(*this);
+            }
+        }
+        return node;
+    }
+    size_t index() const {
+        return record();
+    }
+    void backward() const {
+        NodeManager<T>::instance().backward(record());
+    }
+    T grad() const {
+        return NodeManager<T>::instance().get_node_grad(record());
+    }
+    T value() const {
+        return expression_value(*this);
+    }
+};
+
+/**
+ * @class ScalarExpr
+ * @brief Expression for a `ScalarNode` applied to a sub-expression
+ * @tparam Op The `ScalarNode`
+ * @tparam A The type of the argument
+ */
+template <template <typename> class Op, typename A>
+struct ScalarExpr {
+    using Scalar = typename A::Scalar;
+    using T = Scalar;
+    static constexpr bool is_expression = true;
+    static constexpr std::size_t n_nodes = A::n_nodes + 1;
+    static constexpr std::size_t n_leaves = A::n_leaves;
+    static constexpr std::size_t n_constants = A::n_constants + 1;
+
+    A arg;
+    T constant;
+    // the node of the expression once recorded (0: not recorded yet)
+    mutable size_t node = 0;
+
+    void gather(NodeIdx * args, T * constants) const {
+        arg.gather(args, constants);
+        constants[A::n_constants] = constant;
+    }
+    template <typename S>
+    static void forward(S const * values, NodeIdx const * args, S const * constants, S * locals) {
+        A::forward(values, args, constants, locals);
+        locals[n_nodes-1] = Op<S>::forward(locals[A::n_nodes-1], constants[A::n_constants]);
+    }
+    template <typename S>
+    static void reverse(S const * locals, S const * constants, S const & adjoint, S * partials) {
+        S d_arg = Op<S>::partial(locals[n_nodes-1], locals[A::n_nodes-1], constants[A::n_constants]);
+        A::reverse(locals, constants, adjoint * d_arg, partials);
+    }
+    size_t record() const {
+        if(node == 0) {
+            if constexpr (A::n_nodes == 1) {
+                node = new_node<Op, T>(arg.idx, constant);
+            } else {
+                node = new_statement(*this);
+            }
+        }
+        return node;
+    }
+    size_t index() const {
+        return record();
+    }
+    void backward() const {
+        NodeManager<T>::instance().backward(record());
+    }
+    T grad() const {
+        return NodeManager<T>::instance().get_node_grad(record());
+    }
+    T value() const {
+        return expression_value(*this);
+    }
+};
+
+/**
+ * @class BinaryExpr
+ * @brief Expression for a `BinaryNode` applied to two sub-expressions
+ * @tparam Op The `BinaryNode`
+ * @tparam A The type of the first argument
+ * @tparam B The type of the second argument
+ */
+template <template <typename> class Op, typename A, typename B>
+struct BinaryExpr {
+    using Scalar = typename A::Scalar;
+    using T = Scalar;
+    static constexpr bool is_expression = true;
+    static constexpr std::size_t n_nodes = A::n_nodes + B::n_nodes + 1;
+    static constexpr std::size_t n_leaves = A::n_leaves + B::n_leaves;
+    static constexpr std::size_t n_constants = A::n_constants + B::n_constants;
+
+    A first;
+    B second;
+    // the node of the expression once recorded (0: not recorded yet)
+    mutable size_t node = 0;
+
+    void gather(NodeIdx * args, T * constants) const {
+        first.gather(args, constants);
+        second.gather(args + A::n_leaves, constants + A::n_constants);
+    }
+    template <typename S>
+    static void forward(S const * values, NodeIdx const * args, S const * constants, S * locals) {
+        A::forward(values, args, constants, locals);
+        B::forward(values, args + A::n_leaves, constants + A::n_constants, locals + A::n_nodes);
+        locals[n_nodes-1] = Op<S>::forward(locals[A::n_nodes-1], locals[A::n_nodes + B::n_nodes - 1]);
+    }
+    template <typename S>
+    static void reverse(S const * locals, S const * constants, S const & adjoint, S * partials) {
+        S d_first, d_second;
+        Op<S>::partials(
+            locals[n_nodes-1], locals[A::n_nodes-1], locals[A::n_nodes + B::n_nodes - 1],
+            d_first, d_second
+        );
+        A::reverse(locals, constants, adjoint * d_first, partials);
+        B::reverse(
+            locals + A::n_nodes, constants + A::n_constants,
+            adjoint * d_second, partials + A::n_leaves
+        );
+    }
+    size_t record() const {
+        if(node == 0) {
+            if constexpr (A::n_nodes == 1 && B::n_nodes == 1) {
+                node = new_node<Op, T>(first.idx, second.idx);
+            } else {
+                node = new_statement(*this);
+            }
+        }
+        return node;
+    }
+    size_t index() const {
+        return record();
+    }
+    void backward() const {
+        NodeManager<T>::instance().backward(record());
+    }
+    T grad() const {
+        return NodeManager<T>::instance().get_node_grad(record());
+    }
+    T value() const {
+        return expression_value(*this);
+    }
+};
+
+/**
+ * Computes the value and the local partials of a statement
+ * (see `NodeManager::StatementFn`)
+ *
+ * @tparam E The type of the expression of the statement
+ */
+template <typename E>
+void eval_statement(
+    typename E::Scalar const * values, NodeIdx const * args, typename E::Scalar const * constants,
+    typename E::Scalar & value, typename E::Scalar * partials
+) {
+    using T = typename E::Scalar;
+
+    std::array<T, E::n_nodes> locals;
+    E::forward(values, args, constants, locals.data());
+    value = locals[E::n_nodes-1];
+    E::reverse(locals.data(), constants, T{1.0}, partials);
+}
+
+/**
+ * Computes the local second derivatives of a statement wrt its leaves
+ * (see `NodeManager::StatementHessianFn`) by forward-over-reverse
+ * differentiation of the expression: one dual sweep per leaf.
+ *
+ * @tparam E The type of the expression of the statement
+ */
+template <typename E>
+void hessian_statement(
+    typename E::Scalar const * values, NodeIdx const * args, typename E::Scalar const * constants,
+    typename E::Scalar * hessian
+) {
+    using T = typename E::Scalar;
+    using Dual = forward::DualVar<T>;
+    constexpr std::size_t n = E::n_leaves;
+
+    // the leaves are read from `leaves` in order
+    std::array<Dual, n> leaves;
+    std::array<NodeIdx, n> local_args;
+    for(std::size_t k = 0; k < n; ++k) {
+        leaves[k] = Dual(values[args[k]]);
+        local_args[k] = static_cast<NodeIdx>(k);
+    }
+    std::array<Dual, E::n_constants> dual_constants;
+    for(std::size_t k = 0; k < E::n_constants; ++k) {
+        dual_constants[k] = Dual(constants[k]);
+    }
+
+    std::array<Dual, E::n_nodes> locals;
+    std::array<Dual, n> partials;
+    for(std::size_t l = 0; l < n; ++l) {
+        leaves[l].setInf(T{1.0});
+        E::forward(leaves.data(), local_args.data(), dual_constants.data(), locals.data());
+        E::reverse(locals.data(), dual_constants.data(), Dual(T{1.0}), partials.data());
+        for(std::size_t k = 0; k < n; ++k) {
+            hessian[l*n + k] = partials[k].getInf();
+        }
+        leaves[l].setInf(T{0.0});
+    }
+}
+
+/**
+ * Returns the `hessian_statement` of the expression (only for Tapes of
+ * floating point values)
+ */
+template <typename E>
+constexpr auto hessian_fn() {
+    using U = typename E::Scalar;
+    if constexpr (std::is_floating_point_v<U>) {
+        return &hessian_statement<E>;
+    } else {
+        return typename NodeManager<U>::StatementHessianFn{nullptr};
+    }
+}
+
+template <typename E>
+size_t new_statement(E const & expr) {
+    using U = typename E::Scalar;
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    size_t args = manager.nary_args_.size();
+    size_t constants = manager.constants_.size();
+    manager.nary_args_.resize(args + E::n_leaves);
+    manager.nary_partials_.resize(args + E::n_leaves);
+    manager.constants_.resize(constants + E::n_constants);
+
+    expr.gather(manager.nary_args_.data() + args, manager.constants_.data() + constants);
+
+    U value;
+    eval_statement<E>(
+        manager.values_.data(), manager.nary_args_.data() + args,
+        manager.constants_.data() + constants,
+        value, manager.nary_partials_.data() + args
+    );
+
+    manager.statements_.push_back(typename NodeManager<U>::Statement{
+        static_cast<NodeIdx>(args),
+        static_cast<NodeIdx>(E::n_leaves),
+        static_cast<NodeIdx>(constants),
+        &eval_statement<E>,
+        hessian_fn<E>()
+    });
+
+    return manager.intern(manager.push_node(
+        OpCode::Statement,
+        static_cast<NodeIdx>(manager.statements_.size()-1),
+        0,
+        value
+    ));
+}
+
+template <typename E>
+typename E::Scalar expression_value(E const & expr) {
+    using U = typename E::Scalar;
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    std::array<NodeIdx, E::n_leaves> args;
+    std::array<U, E::n_constants> constants;
+    std::array<U, E::n_nodes> locals;
+    expr.gather(args.data(), constants.data());
+    E::forward(manager.values_.data(), args.data(), constants.data(), locals.data());
+
+    return locals[E::n_nodes-1];
+}
+
+}; // namespace reverse
+}; // namespace autodiff
@@ -4,8 +4,14 @@
 #include <cmath>
 
 /**
- * The actual definition for all the functions that inherit from the
- *  `Node` class goes here.
+ * The actual definition for all the functions that can be recorded
+ *  in the Tape goes here.
+ *
+ * Each `NodeType` is a stateless description of an operation: its value
+ *  (`forward`), its local derivatives (`partial`/`partials`) and its local
+ *  second derivatives (`second_partial`/`second_partials`, used by
+ *  `NodeManager::hessian`). The chain rule itself is applied by the
+ *  `NodeManager` during the backward pass.
  */
 
 namespace autodiff {
@@ -13,193 +19,472 @@ namespace reverse {
 
 /******* Binary Operators *******/
 template <typename T>
-class AddNode : public BinaryNode<T> {
-public:
-    AddNode(NodePtr<T> first, NodePtr<T> second):
-     BinaryNode<T>(first->value()+second->value(), first, second) {}
+struct AddNode : public BinaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Add;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_);
-        this->second_->update_grad(this->grad_);
-    } 
-}; 
+    static T forward(T const & first, T const & second) {
+        return first + second;
+    }
+    static void partials(T const &, T const &, T const &, T & d_first, T & d_second) {
+        d_first = T{1.0};
+        d_second = T{1.0};
+    }
+    static void second_partials(T const &, T const &, T const &, T & d_ff, T & d_fs, T & d_ss) {
+        d_ff = d_fs = d_ss = T{0.0};
+    }
+};
 
 template <typename T>
-class SubNode : public BinaryNode<T> {
-public:
-    SubNode(NodePtr<T> first, NodePtr<T> second):
-     BinaryNode<T>(first->value()-second->value(), first, second) {}
+struct SubNode : public BinaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Sub;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_);
-        this->second_->update_grad(-(this->grad_));
-    } 
+    static T forward(T const & first, T const & second) {
+        return first - second;
+    }
+    static void partials(T const &, T const &, T const &, T & d_first, T & d_second) {
+        d_first = T{1.0};
+        d_second = T{-1.0};
+    }
+    static void second_partials(T const &, T const &, T const &, T & d_ff, T & d_fs, T & d_ss) {
+        d_ff = d_fs = d_ss = T{0.0};
+    }
 };
 
 template <typename T>
-class ProdNode : public BinaryNode<T> {
-public:
-    ProdNode(NodePtr<T> first, NodePtr<T> second):
-     BinaryNode<T>(first->value()*second->value(), first, second) {}
+struct ProdNode : public BinaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Prod;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_ * this->second_->value());
-        this->second_->update_grad(this->grad_ * this->first_->value());
+    static T forward(T const & first, T const & second) {
+        return first * second;
+    }
+    static void partials(T const &, T const & first, T const & second, T & d_first, T & d_second) {
+        d_first = second;
+        d_second = first;
+    }
+    static void second_partials(T const &, T const &, T const &, T & d_ff, T & d_fs, T & d_ss) {
+        d_ff = T{0.0};
+        d_fs = T{1.0};
+        d_ss = T{0.0};
     }
 };
 
 template <typename T>
-class DivNode : public BinaryNode<T> {
-public:
-    DivNode(NodePtr<T> first, NodePtr<T> second):
-     BinaryNode<T>(first->value()/second->value(), first, second) {}
+struct DivNode : public BinaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Div;
 
-    void backward() override {
-        auto den = this->second_->value();
-        this->first_->update_grad(this->grad_ * (1.0/den));
+    static T forward(T const & first, T const & second) {
+        return first / second;
+    }
+    static void partials(T const &, T const & first, T const & second, T & d_first, T & d_second) {
+        auto den = second;
+        d_first = 1.0/den;
         den *= den;
-        this->second_->update_grad(this->grad_ * (-this->first_->value()/den));
+        d_second = -first/den;
+    }
+    static void second_partials(T const &, T const & first, T const & second, T & d_ff, T & d_fs, T & d_ss) {
+        auto den = second*second;
+        d_ff = T{0.0};
+        d_fs = -1.0/den;
+        d_ss = 2.0*first/(den*second);
     }
 };
 
 template <typename T>
-class PowNode : public BinaryNode<T> {
-public:
-    PowNode(NodePtr<T> first, NodePtr<T> second):
-     BinaryNode<T>(std::pow(first->value(),second->value()), first, second) {}
+struct PowNode : public BinaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Pow;
 
-    void backward() override {
-        auto val1 = this->first_->value();
-        auto val2 = this->second_->value();
-        this->first_->update_grad(
-            this->grad_ *
-            val2*std::pow(val1, val2-1)
-        );
-        this->second_->update_grad(
-            this->grad_ *
-            this->value()*std::log(val1)
-        );
+    static T forward(T const & first, T const & second) {
+        using std::pow;
+        return pow(first, second);
+    }
+    static void partials(T const & value, T const & first, T const & second, T & d_first, T & d_second) {
+        using std::pow;
+        using std::log;
+        d_first = second*pow(first, second-1);
+        d_second = value*log(first);
+    }
+    static void second_partials(T const & value, T const & first, T const & second, T & d_ff, T & d_fs, T & d_ss) {
+        using std::pow;
+        using std::log;
+        auto log_first = log(first);
+        d_ff = second*(second-1.0)*pow(first, second-2.0);
+        d_fs = pow(first, second-1.0)*(1.0 + second*log_first);
+        d_ss = value*log_first*log_first;
     }
 };
 
 /******* Unary Operators *******/
 template <typename T>
-class NegNode : public UnaryNode<T> {
-public:
-    NegNode(NodePtr<T> first):
-     UnaryNode<T>(-(first->value()), first) {}
+struct NegNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Neg;
 
-    void backward() override {
-        this->first_->update_grad(-(this->grad_));
+    static T forward(T const & first) {
+        return -first;
+    }
+    static T partial(T const &, T const &) {
+        return T{-1.0};
+    }
+    static T second_partial(T const &, T const &) {
+        return T{0.0};
     }
 };
 
 // TODO: maybe this one needs some checks
 template <typename T>
-class AbsNode : public UnaryNode<T> {
-public:
-    AbsNode(NodePtr<T> first):
-     UnaryNode<T>(std::abs(first->value()), first) {}
+struct AbsNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Abs;
 
-    void backward() override {
-        int sign = (this->first_->value() >= 0) ? 1 : -1;
-        this->first_->update_grad(this->grad_ * sign);
+    static T forward(T const & first) {
+        using std::abs;
+        return abs(first);
+    }
+    static T partial(T const &, T const & first) {
+        return (first >= 0) ? T{1.0} : T{-1.0};
+    }
+    static T second_partial(T const &, T const &) {
+        return T{0.0};
     }
 };
 
 template <typename T>
-class CosNode : public UnaryNode<T> {
-public:
-    CosNode(NodePtr<T> first):
-     UnaryNode<T>(std::cos(first->value()), first) {}
+struct CosNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Cos;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_ * (-std::sin(this->first_->value())));
+    static T forward(T const & first) {
+        using std::cos;
+        return cos(first);
+    }
+    static T partial(T const &, T const & first) {
+        using std::sin;
+        return -sin(first);
+    }
+    static T second_partial(T const & value, T const &) {
+        return -value;
     }
 };
 
 template <typename T>
-class SinNode : public UnaryNode<T> {
-public:
-    SinNode(NodePtr<T> first):
-     UnaryNode<T>(std::sin(first->value()), first) {}
+struct SinNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Sin;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_ * std::cos(this->first_->value()));
+    static T forward(T const & first) {
+        using std::sin;
+        return sin(first);
+    }
+    static T partial(T const &, T const & first) {
+        using std::cos;
+        return cos(first);
+    }
+    static T second_partial(T const & value, T const &) {
+        return -value;
     }
 };
 
 template <typename T>
-class TanNode : public UnaryNode<T> {
-public:
-    TanNode(NodePtr<T> first):
-     UnaryNode<T>(std::tan(first->value()), first) {}
+struct TanNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Tan;
 
-    void backward() override {
-        auto den = std::cos(this->first_->value());
+    static T forward(T const & first) {
+        using std::tan;
+        return tan(first);
+    }
+    static T partial(T const &, T const & first) {
+        using std::cos;
+        auto den = cos(first);
         den *= den;
-        this->first_->update_grad(this->grad_ * (1.0/den));
+        return 1.0/den;
+    }
+    static T second_partial(T const & value, T const &) {
+        return 2.0*value*(1.0 + value*value);
     }
 };
 
 template <typename T>
-class LogNode : public UnaryNode<T> {
-public:
-    LogNode(NodePtr<T> first):
-     UnaryNode<T>(std::log(first->value()), first) {}
+struct LogNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Log;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_ * (1.0/this->first_->value()));
+    static T forward(T const & first) {
+        using std::log;
+        return log(first);
+    }
+    static T partial(T const &, T const & first) {
+        return 1.0/first;
+    }
+    static T second_partial(T const &, T const & first) {
+        return -1.0/(first*first);
     }
 };
 
 template <typename T>
-class ReluNode : public UnaryNode<T> {
-public:
-    ReluNode(NodePtr<T> first):
-     UnaryNode<T>((first->value() > 0.0) ? first->value() : 0.0, first) {}
+struct ReluNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Relu;
 
-    void backward() override {
-        auto der = (this->first_->value() > 0.0) ? 1.0 : 0.0;
-        this->first_->update_grad(this->grad_ * der);
+    static T forward(T const & first) {
+        return (first > 0.0) ? first : T{0.0};
+    }
+    static T partial(T const &, T const & first) {
+        return (first > 0.0) ? T{1.0} : T{0.0};
+    }
+    static T second_partial(T const &, T const &) {
+        return T{0.0};
     }
 };
 
 template <typename T>
-class TanhNode : public UnaryNode<T> {
-public:
-    TanhNode(NodePtr<T> first):
-     UnaryNode<T>(std::tanh(first->value()), first) {}
+struct TanhNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Tanh;
 
-    void backward() override {
-        auto den = std::cosh(this->first_->value());
+    static T forward(T const & first) {
+        using std::tanh;
+        return tanh(first);
+    }
+    static T partial(T const &, T const & first) {
+        using std::cosh;
+        auto den = cosh(first);
         den *= den;
-        this->first_->update_grad(this->grad_ * (1.0/den));
+        return 1.0/den;
+    }
+    static T second_partial(T const & value, T const &) {
+        return -2.0*value*(1.0 - value*value);
     }
 };
 
 template <typename T>
-class ExpNode : public UnaryNode<T> {
-public:
-    ExpNode(NodePtr<T> first):
-     UnaryNode<T>(std::exp(first->value()), first) {}
+struct ExpNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Exp;
 
-    void backward() override {
-        this->first_->update_grad(this->grad_ * this->value());
+    static T forward(T const & first) {
+        using std::exp;
+        return exp(first);
+    }
+    static T partial(T const & value, T const &) {
+        return value;
+    }
+    static T second_partial(T const & value, T const &) {
+        return value;
     }
 };
 
 template <typename T>
-class SqrtNode : public UnaryNode<T> {
-public:
-    SqrtNode(NodePtr<T> first):
-     UnaryNode<T>(std::sqrt(first->value()), first) {}
+struct SqrtNode : public UnaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Sqrt;
 
-    void backward() override {
-        T der = 1.0/(2.0*this->value());
-        this->first_->update_grad(this->grad_ * der);
+    static T forward(T const & first) {
+        using std::sqrt;
+        return sqrt(first);
+    }
+    static T partial(T const & value, T const &) {
+        return 1.0/(2.0*value);
+    }
+    static T second_partial(T const & value, T const &) {
+        return -1.0/(4.0*value*value*value);
     }
 };
 
+/******* Unary Operators with a constant operand *******/
+// x + c (and x - c)
+template <typename T>
+struct AddConstNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::AddConst;
+
+    static T forward(T const & first, T const & constant) {
+        return first + constant;
+    }
+    static T partial(T const &, T const &, T const &) {
+        return T{1.0};
+    }
+    static T second_partial(T const &, T const &, T const &) {
+        return T{0.0};
+    }
+};
+
+// c - x
+template <typename T>
+struct ConstSubNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::ConstSub;
+
+    static T forward(T const & first, T const & constant) {
+        return constant - first;
+    }
+    static T partial(T const &, T const &, T const &) {
+        return T{-1.0};
+    }
+    static T second_partial(T const &, T const &, T const &) {
+        return T{0.0};
+    }
+};
+
+// x * c
+template <typename T>
+struct ScaleNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::Scale;
+
+    static T forward(T const & first, T const & constant) {
+        return first * constant;
+    }
+    static T partial(T const &, T const &, T const & constant) {
+        return constant;
+    }
+    static T second_partial(T const &, T const &, T const &) {
+        return T{0.0};
+    }
+};
+
+// x / c
+template <typename T>
+struct DivConstNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::DivConst;
+
+    static T forward(T const & first, T const & constant) {
+        return first / constant;
+    }
+    static T partial(T const &, T const &, T const & constant) {
+        return 1.0/constant;
+    }
+    static T second_partial(T const &, T const &, T const &) {
+        return T{0.0};
+    }
+};
+
+// c / x
+template <typename T>
+struct ConstDivNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::ConstDiv;
+
+    static T forward(T const & first, T const & constant) {
+        return constant / first;
+    }
+    static T partial(T const &, T const & first, T const & constant) {
+        return -constant/(first*first);
+    }
+    static T second_partial(T const &, T const & first, T const & constant) {
+        return 2.0*constant/(first*first*first);
+    }
+};
+
+// x ^ c
+template <typename T>
+struct PowConstNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::PowConst;
+
+    static T forward(T const & first, T const & constant) {
+        using std::pow;
+        return pow(first, constant);
+    }
+    static T partial(T const &, T const & first, T const & constant) {
+        using std::pow;
+        return constant*pow(first, constant-1);
+    }
+    static T second_partial(T const &, T const & first, T const & constant) {
+        using std::pow;
+        return constant*(constant-1.0)*pow(first, constant-2.0);
+    }
+};
+
+// c ^ x
+template <typename T>
+struct ConstPowNode : public ScalarNode<T> {
+    static constexpr OpCode opcode = OpCode::ConstPow;
+
+    static T forward(T const & first, T const & constant) {
+        using std::pow;
+        return pow(constant, first);
+    }
+    static T partial(T const & value, T const &, T const & constant) {
+        using std::log;
+        return value*log(constant);
+    }
+    static T second_partial(T const & value, T const &, T const & constant) {
+        using std::log;
+        auto log_constant = log(constant);
+        return value*log_constant*log_constant;
+    }
+};
+
+/******* N-ary Operators *******/
+/**
+ * A whole statement (e.g. `a*b + c*d - e`) recorded as a single node
+ * (see `Expression.hpp`).
+ *
+ * Its arguments are the `Var`(s) appearing in the statement and its local
+ * partials are computed once, when the statement is recorded (or replayed),
+ * by a function generated from the type of the expression.
+ */
+template <typename T>
+struct StatementNode : public NaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Statement;
+};
+
+/**
+ * An array-level operation (e.g. a matrix product) recorded as a single
+ * node (see `MatrixFunctions.hpp`).
+ *
+ * The values of its arguments are copied in a contiguous block of the Tape
+ * and its `n` outputs are the `OutputNode`(s) that immediately follow it.
+ * The forward and backward passes are computed on the whole block by
+ * the kernels of the operation.
+ */
+template <typename T>
+struct BlockNode : public NaryNode<T> {
+    static constexpr OpCode opcode = OpCode::Block;
+};
+
+/**
+ * An output of a `BlockNode`: its first argument is the `BlockNode` and
+ * its adjoint is consumed by the `BlockNode` itself
+ */
+template <typename T>
+struct OutputNode {
+    static constexpr std::size_t arity = 0;
+    static constexpr bool with_constant = false;
+    static constexpr OpCode opcode = OpCode::Output;
+};
+
+/******* Dispatch *******/
+/**
+ * Maps a runtime `OpCode` to the corresponding `NodeType` and invokes
+ * `f.template operator()<NodeType<T>>()`.
+ *
+ * This is the only place where the mapping between `OpCode`(s) and
+ * `NodeType`(s) is defined: every sweep over the Tape goes through here,
+ * so adding a new node only requires a new `OpCode` and a new case.
+ *
+ * @tparam T The type of the underlying variables
+ * @param op The operation to dispatch on
+ * @param f A callable with a templated call operator (e.g. a templated lambda)
+ */
+template <typename T, typename F>
+inline decltype(auto) visit_node(OpCode op, F && f) {
+    switch(op) {
+        case OpCode::Add:  return f.template operator()<AddNode<T>>();
+        case OpCode::Sub:  return f.template operator()<SubNode<T>>();
+        case OpCode::Prod: return f.template operator()<ProdNode<T>>();
+        case OpCode::Div:  return f.template operator()<DivNode<T>>();
+        case OpCode::Pow:  return f.template operator()<PowNode<T>>();
+        case OpCode::Neg:  return f.template operator()<NegNode<T>>();
+        case OpCode::Abs:  return f.template operator()<AbsNode<T>>();
+        case OpCode::Cos:  return f.template operator()<CosNode<T>>();
+        case OpCode::Sin:  return f.template operator()<SinNode<T>>();
+        case OpCode::Tan:  return f.template operator()<TanNode<T>>();
+        case OpCode::Log:  return f.template operator()<LogNode<T>>();
+        case OpCode::Relu: return f.template operator()<ReluNode<T>>();
+        case OpCode::Tanh: return f.template operator()<TanhNode<T>>();
+        case OpCode::Exp:  return f.template operator()<ExpNode<T>>();
+        case OpCode::Sqrt: return f.template operator()<SqrtNode<T>>();
+        case OpCode::AddConst: return f.template operator()<AddConstNode<T>>();
+        case OpCode::ConstSub: return f.template operator()<ConstSubNode<T>>();
+        case OpCode::Scale:    return f.template operator()<ScaleNode<T>>();
+        case OpCode::DivConst: return f.template operator()<DivConstNode<T>>();
+        case OpCode::ConstDiv: return f.template operator()<ConstDivNode<T>>();
+        case OpCode::PowConst: return f.template operator()<PowConstNode<T>>();
+        case OpCode::ConstPow: return f.template operator()<ConstPowNode<T>>();
+        case OpCode::Statement: return f.template operator()<StatementNode<T>>();
+        case OpCode::Block:     return f.template operator()<BlockNode<T>>();
+        case OpCode::Output:    return f.template operator()<OutputNode<T>>();
+        case OpCode::Ind:
+        default:           return f.template operator()<IndNode<T>>();
+    }
+}
+
 }; // namespace reverse
-}; // namespace autodiff 
+}; // namespace autodiff
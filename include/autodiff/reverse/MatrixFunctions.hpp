@@ -0,0 +1,606 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/Cholesky>
+
+#include "Var.hpp"
+#include "ReverseEigenSupport.hpp"
+
+/**
+ * Array-level operations on Eigen matrices of `Var`(s).
+ *
+ * Evaluating, for example, an Eigen product of two `Matrix<Var>` records
+ * every scalar product and sum in the Tape (O(n^3) nodes). The functions
+ * in this file record the whole operation as a single `BlockNode` instead:
+ * the values of the operands are copied in a contiguous block and both
+ * the forward and the backward passes are computed by plain Eigen kernels
+ * on that block (e.g. dA = dC * B^T for a matrix product).
+ *
+ * No node is needed for transpositions (or any other Eigen view): they only
+ * rearrange the `Var`(s) passed to these functions.
+ *
+ * The linear solves and the log-determinant factorize the matrix on plain
+ * values. The factorization is kept as extra (hidden) outputs of the block,
+ * so that the backward kernel reuses it instead of factorizing again
+ * (e.g. dB = A^-T dX for X = A^-1 B is two triangular solves).
+ */
+
+namespace autodiff {
+namespace reverse {
+
+template <typename T>
+using BlockMatrix = Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>;
+
+template <typename T>
+using ConstBlockMatrix = Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> const>;
+
+template <typename T>
+using BlockVector = Eigen::Map<Eigen::Vector<T, Eigen::Dynamic>>;
+
+template <typename T>
+using ConstBlockVector = Eigen::Map<Eigen::Vector<T, Eigen::Dynamic> const>;
+
+/******* Kernels *******/
+// Every operand is stored column-major (see `NodeManager::BlockForward`)
+
+// C = A * B, with A (m x k) and B (k x n). dims = {m, k, n}
+template <typename T>
+struct MatMulBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[1]);
+        ConstBlockMatrix<T> B(operands + dims[0]*dims[1], dims[1], dims[2]);
+        BlockMatrix<T> C(outputs, dims[0], dims[2]);
+        C.noalias() = A * B;
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const *,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[1]);
+        ConstBlockMatrix<T> B(operands + dims[0]*dims[1], dims[1], dims[2]);
+        ConstBlockMatrix<T> dC(output_grads, dims[0], dims[2]);
+        BlockMatrix<T> dA(operand_grads, dims[0], dims[1]);
+        BlockMatrix<T> dB(operand_grads + dims[0]*dims[1], dims[1], dims[2]);
+        dA.noalias() = dC * B.transpose();
+        dB.noalias() = A.transpose() * dC;
+    }
+};
+
+// y = A * x, with A (m x n). dims = {m, n}
+template <typename T>
+struct MatVecBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[1]);
+        ConstBlockVector<T> x(operands + dims[0]*dims[1], dims[1]);
+        BlockVector<T> y(outputs, dims[0]);
+        y.noalias() = A * x;
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const *,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[1]);
+        ConstBlockVector<T> x(operands + dims[0]*dims[1], dims[1]);
+        ConstBlockVector<T> dy(output_grads, dims[0]);
+        BlockMatrix<T> dA(operand_grads, dims[0], dims[1]);
+        BlockVector<T> dx(operand_grads + dims[0]*dims[1], dims[1]);
+        dA.noalias() = dy * x.transpose();
+        dx.noalias() = A.transpose() * dy;
+    }
+};
+
+// y = f(x) element-wise, where f is a `UnaryNode`. dims = {size}
+template <template <typename> class Op, typename T>
+struct MapBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        for(NodeIdx j = 0; j < dims[0]; ++j) {
+            outputs[j] = Op<T>::forward(operands[j]);
+        }
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        for(NodeIdx j = 0; j < dims[0]; ++j) {
+            operand_grads[j] = output_grads[j] * Op<T>::partial(outputs[j], operands[j]);
+        }
+    }
+};
+
+// s = sum(x). dims = {size}
+template <typename T>
+struct SumBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        outputs[0] = ConstBlockVector<T>(operands, dims[0]).sum();
+    }
+    static void backward(
+        NodeIdx const * dims, T const *, T const *,
+        T const * output_grads, T * operand_grads
+    ) {
+        BlockVector<T>(operand_grads, dims[0]).setConstant(output_grads[0]);
+    }
+};
+
+// s = a . b. dims = {size}
+template <typename T>
+struct DotBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockVector<T> a(operands, dims[0]);
+        ConstBlockVector<T> b(operands + dims[0], dims[0]);
+        outputs[0] = a.dot(b);
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const *,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockVector<T> a(operands, dims[0]);
+        ConstBlockVector<T> b(operands + dims[0], dims[0]);
+        BlockVector<T>(operand_grads, dims[0]) = output_grads[0] * b;
+        BlockVector<T>(operand_grads + dims[0], dims[0]) = output_grads[0] * a;
+    }
+};
+
+// s = ||x||^2. dims = {size}
+template <typename T>
+struct SquaredNormBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        outputs[0] = ConstBlockVector<T>(operands, dims[0]).squaredNorm();
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const *,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockVector<T> x(operands, dims[0]);
+        BlockVector<T>(operand_grads, dims[0]) = (2.0 * output_grads[0]) * x;
+    }
+};
+
+// s = ||x||. dims = {size}
+template <typename T>
+struct NormBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        outputs[0] = ConstBlockVector<T>(operands, dims[0]).norm();
+    }
+    static void backward(
+        NodeIdx const * dims, T const * operands, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockVector<T> x(operands, dims[0]);
+        BlockVector<T>(operand_grads, dims[0]) = (output_grads[0] / outputs[0]) * x;
+    }
+};
+
+// Helpers of the kernels based on an LU factorization with partial pivoting
+// (P A = L U), stored as the n x n matrix LU followed by the n indices of P
+template <typename T>
+void store_lu(Eigen::PartialPivLU<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> const & lu, T * factorization) {
+    Eigen::Index n = lu.matrixLU().rows();
+    BlockMatrix<T>(factorization, n, n) = lu.matrixLU();
+    auto const & indices = lu.permutationP().indices();
+    for(Eigen::Index i = 0; i < n; ++i) {
+        factorization[n*n + i] = static_cast<T>(indices(i));
+    }
+}
+
+// G <- A^-T G, given the factorization stored by `store_lu`
+template <typename T>
+void lu_transpose_solve(T const * factorization, Eigen::Index n, BlockMatrix<T> G) {
+    ConstBlockMatrix<T> LU(factorization, n, n);
+    // A^T = U^T L^T P
+    LU.transpose().template triangularView<Eigen::Lower>().solveInPlace(G);
+    LU.transpose().template triangularView<Eigen::UnitUpper>().solveInPlace(G);
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> P(n);
+    for(Eigen::Index i = 0; i < n; ++i) {
+        P.indices()(i) = static_cast<int>(factorization[n*n + i]);
+    }
+    G = P.transpose() * G;
+}
+
+// X = A^-1 B, with A (n x n) and B (n x m). dims = {n, m}
+// outputs = {X, LU, P} (see `store_lu`)
+template <typename T>
+struct SolveBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[0]);
+        ConstBlockMatrix<T> B(operands + dims[0]*dims[0], dims[0], dims[1]);
+        Eigen::PartialPivLU<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> lu(A);
+        BlockMatrix<T>(outputs, dims[0], dims[1]) = lu.solve(B);
+        store_lu(lu, outputs + dims[0]*dims[1]);
+    }
+    static void backward(
+        NodeIdx const * dims, T const *, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockMatrix<T> X(outputs, dims[0], dims[1]);
+        BlockMatrix<T> dA(operand_grads, dims[0], dims[0]);
+        BlockMatrix<T> dB(operand_grads + dims[0]*dims[0], dims[0], dims[1]);
+        // dB = A^-T dX, dA = -dB X^T
+        dB = ConstBlockMatrix<T>(output_grads, dims[0], dims[1]);
+        lu_transpose_solve(outputs + dims[0]*dims[1], dims[0], dB);
+        dA.noalias() = -dB * X.transpose();
+    }
+};
+
+// X = A^-1 B, with A (n x n) symmetric positive definite and B (n x m),
+// only the lower triangle of A is read. dims = {n, m}
+// outputs = {X, L} with A = L L^T
+template <typename T>
+struct CholeskySolveBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[0]);
+        ConstBlockMatrix<T> B(operands + dims[0]*dims[0], dims[0], dims[1]);
+        Eigen::LLT<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> llt(A);
+        BlockMatrix<T> X(outputs, dims[0], dims[1]);
+        BlockMatrix<T> L(outputs + dims[0]*dims[1], dims[0], dims[0]);
+        if(llt.info() != Eigen::Success) {
+            // not positive definite
+            X.setConstant(std::numeric_limits<T>::quiet_NaN());
+            L.setConstant(std::numeric_limits<T>::quiet_NaN());
+            return;
+        }
+        X = llt.solve(B);
+        L = llt.matrixL();
+    }
+    static void backward(
+        NodeIdx const * dims, T const *, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        ConstBlockMatrix<T> X(outputs, dims[0], dims[1]);
+        ConstBlockMatrix<T> L(outputs + dims[0]*dims[1], dims[0], dims[0]);
+        BlockMatrix<T> dA(operand_grads, dims[0], dims[0]);
+        BlockMatrix<T> dB(operand_grads + dims[0]*dims[0], dims[0], dims[1]);
+        // dB = A^-1 dX and G = -dB X^T is the adjoint of a general A. Only the
+        // lower triangle is read: A(i, j) (i > j) stands for both A(i, j)
+        // and A(j, i), and the strict upper triangle has no effect
+        dB = ConstBlockMatrix<T>(output_grads, dims[0], dims[1]);
+        L.template triangularView<Eigen::Lower>().solveInPlace(dB);
+        L.transpose().template triangularView<Eigen::Upper>().solveInPlace(dB);
+        dA.noalias() = -dB * X.transpose();
+        for(NodeIdx j = 0; j < dims[0]; ++j) {
+            for(NodeIdx i = j + 1; i < dims[0]; ++i) {
+                dA(i, j) += dA(j, i);
+                dA(j, i) = T{0.0};
+            }
+        }
+    }
+};
+
+// s = log|det(A)|, with A (n x n). dims = {n}
+// outputs = {s, LU, P} (see `store_lu`)
+template <typename T>
+struct LogDetBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[0]);
+        Eigen::PartialPivLU<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> lu(A);
+        outputs[0] = lu.matrixLU().diagonal().array().abs().log().sum();
+        store_lu(lu, outputs + 1);
+    }
+    static void backward(
+        NodeIdx const * dims, T const *, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        // dA = ds A^-T
+        BlockMatrix<T> dA(operand_grads, dims[0], dims[0]);
+        dA.setIdentity();
+        lu_transpose_solve(outputs + 1, dims[0], dA);
+        dA *= output_grads[0];
+    }
+};
+
+// C = A^-1, with A (n x n). dims = {n}
+template <typename T>
+struct InverseBlock {
+    static void forward(NodeIdx const * dims, T const * operands, T * outputs) {
+        ConstBlockMatrix<T> A(operands, dims[0], dims[0]);
+        BlockMatrix<T>(outputs, dims[0], dims[0]) = A.partialPivLu().inverse();
+    }
+    static void backward(
+        NodeIdx const * dims, T const *, T const * outputs,
+        T const * output_grads, T * operand_grads
+    ) {
+        // dA = -C^T dC C^T
+        ConstBlockMatrix<T> C(outputs, dims[0], dims[0]);
+        ConstBlockMatrix<T> dC(output_grads, dims[0], dims[0]);
+        BlockMatrix<T>(operand_grads, dims[0], dims[0]).noalias() = -C.transpose() * dC * C.transpose();
+    }
+};
+
+/******* Recording *******/
+template <typename V>
+struct var_value;
+
+template <typename U>
+struct var_value<Var<U>> {
+    using type = U;
+};
+
+template <typename V>
+using var_value_t = typename var_value<V>::type;
+
+template <typename V>
+using VarMatrix = Eigen::Matrix<V, Eigen::Dynamic, Eigen::Dynamic>;
+
+template <typename V>
+using VarVector = Eigen::Vector<V, Eigen::Dynamic>;
+
+/**
+ * Appends the indices of the `Var`(s) of `m` (column-major) to `args`
+ */
+template <typename Derived>
+void append_indices(Eigen::MatrixBase<Derived> const & m, std::vector<NodeIdx> & args) {
+    for(Eigen::Index j = 0; j < m.cols(); ++j) {
+        for(Eigen::Index i = 0; i < m.rows(); ++i) {
+            args.push_back(static_cast<NodeIdx>(m(i, j).index()));
+        }
+    }
+}
+
+/**
+ * Records a `BlockNode` whose operands are the `Var`(s) of `args`
+ * and returns the index of its first output
+ */
+template <template <typename> class Kernel, typename U>
+size_t record_block(std::vector<NodeIdx> const & args, size_t n_outputs, std::array<NodeIdx, 3> const & dims) {
+    return new_block<U>(
+        args.data(), args.size(), n_outputs, dims,
+        &Kernel<U>::forward, &Kernel<U>::backward
+    );
+}
+
+/**
+ * Returns the (rows x cols) matrix of `Var`(s) tracking the outputs of a block
+ */
+template <typename V>
+VarMatrix<V> block_outputs(size_t first, Eigen::Index rows, Eigen::Index cols) {
+    VarMatrix<V> res(rows, cols);
+    for(Eigen::Index j = 0; j < cols; ++j) {
+        for(Eigen::Index i = 0; i < rows; ++i) {
+            res(i, j) = V::from_index(first + j*rows + i);
+        }
+    }
+    return res;
+}
+
+/**
+ * Matrix product (GEMM) recorded as a single node
+ */
+template <typename DerivedA, typename DerivedB>
+VarMatrix<typename DerivedA::Scalar> matmul(
+    Eigen::MatrixBase<DerivedA> const & A,
+    Eigen::MatrixBase<DerivedB> const & B
+) {
+    using V = typename DerivedA::Scalar;
+    if(A.cols() != B.rows()) {
+        throw std::invalid_argument("matmul: the inner dimensions don't match");
+    }
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size() + B.size());
+    append_indices(A, args);
+    append_indices(B, args);
+
+    std::array<NodeIdx, 3> dims = {
+        static_cast<NodeIdx>(A.rows()), static_cast<NodeIdx>(A.cols()), static_cast<NodeIdx>(B.cols())
+    };
+    size_t first = record_block<MatMulBlock, var_value_t<V>>(args, A.rows()*B.cols(), dims);
+    return block_outputs<V>(first, A.rows(), B.cols());
+}
+
+/**
+ * Matrix-vector product (GEMV) recorded as a single node
+ */
+template <typename DerivedA, typename DerivedX>
+VarVector<typename DerivedA::Scalar> matvec(
+    Eigen::MatrixBase<DerivedA> const & A,
+    Eigen::MatrixBase<DerivedX> const & x
+) {
+    using V = typename DerivedA::Scalar;
+    if(A.cols() != x.size()) {
+        throw std::invalid_argument("matvec: the inner dimensions don't match");
+    }
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size() + x.size());
+    append_indices(A, args);
+    append_indices(x, args);
+
+    std::array<NodeIdx, 3> dims = {
+        static_cast<NodeIdx>(A.rows()), static_cast<NodeIdx>(A.cols()), 1
+    };
+    size_t first = record_block<MatVecBlock, var_value_t<V>>(args, A.rows(), dims);
+    return block_outputs<V>(first, A.rows(), 1);
+}
+
+/**
+ * Applies the `UnaryNode` `Op` element-wise (e.g. `map<TanhNode>(X)`),
+ * recorded as a single node
+ */
+template <template <typename> class Op, typename Derived>
+VarMatrix<typename Derived::Scalar> map(Eigen::MatrixBase<Derived> const & X) {
+    using V = typename Derived::Scalar;
+    using U = var_value_t<V>;
+
+    std::vector<NodeIdx> args;
+    args.reserve(X.size());
+    append_indices(X, args);
+
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(X.size()), 0, 0};
+    size_t first = new_block<U>(
+        args.data(), args.size(), X.size(), dims,
+        &MapBlock<Op, U>::forward, &MapBlock<Op, U>::backward
+    );
+    return block_outputs<V>(first, X.rows(), X.cols());
+}
+
+/**
+ * Sum of the coefficients, recorded as a single node
+ */
+template <typename Derived>
+typename Derived::Scalar sum(Eigen::MatrixBase<Derived> const & X) {
+    using V = typename Derived::Scalar;
+
+    std::vector<NodeIdx> args;
+    args.reserve(X.size());
+    append_indices(X, args);
+
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(X.size()), 0, 0};
+    return V::from_index(record_block<SumBlock, var_value_t<V>>(args, 1, dims));
+}
+
+/**
+ * Dot product, recorded as a single node
+ */
+template <typename DerivedA, typename DerivedB>
+typename DerivedA::Scalar dot(
+    Eigen::MatrixBase<DerivedA> const & a,
+    Eigen::MatrixBase<DerivedB> const & b
+) {
+    using V = typename DerivedA::Scalar;
+    if(a.size() != b.size()) {
+        throw std::invalid_argument("dot: the sizes don't match");
+    }
+
+    std::vector<NodeIdx> args;
+    args.reserve(a.size() + b.size());
+    append_indices(a, args);
+    append_indices(b, args);
+
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(a.size()), 0, 0};
+    return V::from_index(record_block<DotBlock, var_value_t<V>>(args, 1, dims));
+}
+
+/**
+ * Squared (Frobenius) norm, recorded as a single node
+ */
+template <typename Derived>
+typename Derived::Scalar squared_norm(Eigen::MatrixBase<Derived> const & X) {
+    using V = typename Derived::Scalar;
+
+    std::vector<NodeIdx> args;
+    args.reserve(X.size());
+    append_indices(X, args);
+
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(X.size()), 0, 0};
+    return V::from_index(record_block<SquaredNormBlock, var_value_t<V>>(args, 1, dims));
+}
+
+/**
+ * (Frobenius) norm, recorded as a single node
+ */
+template <typename Derived>
+typename Derived::Scalar norm(Eigen::MatrixBase<Derived> const & X) {
+    using V = typename Derived::Scalar;
+
+    std::vector<NodeIdx> args;
+    args.reserve(X.size());
+    append_indices(X, args);
+
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(X.size()), 0, 0};
+    return V::from_index(record_block<NormBlock, var_value_t<V>>(args, 1, dims));
+}
+
+/**
+ * Checks that `A` is square and, if `rows` is given, that `A` has `rows` rows
+ */
+template <typename DerivedA>
+void check_square(char const * name, Eigen::MatrixBase<DerivedA> const & A, Eigen::Index rows = -1) {
+    if(A.rows() != A.cols()) {
+        throw std::invalid_argument(std::string(name) + ": the matrix is not square");
+    }
+    if(rows >= 0 && rows != A.rows()) {
+        throw std::invalid_argument(std::string(name) + ": the dimensions don't match");
+    }
+}
+
+/**
+ * Solution X of the linear system A X = B (LU factorization with partial
+ * pivoting), recorded as a single node. A must be invertible.
+ */
+template <typename DerivedA, typename DerivedB>
+VarMatrix<typename DerivedA::Scalar> solve(
+    Eigen::MatrixBase<DerivedA> const & A,
+    Eigen::MatrixBase<DerivedB> const & B
+) {
+    using V = typename DerivedA::Scalar;
+    check_square("solve", A, B.rows());
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size() + B.size());
+    append_indices(A, args);
+    append_indices(B, args);
+
+    Eigen::Index n = A.rows();
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(n), static_cast<NodeIdx>(B.cols()), 0};
+    size_t first = record_block<SolveBlock, var_value_t<V>>(args, B.size() + n*n + n, dims);
+    return block_outputs<V>(first, n, B.cols());
+}
+
+/**
+ * Solution X of the linear system A X = B, with A symmetric positive definite
+ * (Cholesky factorization), recorded as a single node. Only the lower triangle
+ * of A is read. The result is NaN if A is not positive definite.
+ */
+template <typename DerivedA, typename DerivedB>
+VarMatrix<typename DerivedA::Scalar> llt_solve(
+    Eigen::MatrixBase<DerivedA> const & A,
+    Eigen::MatrixBase<DerivedB> const & B
+) {
+    using V = typename DerivedA::Scalar;
+    check_square("llt_solve", A, B.rows());
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size() + B.size());
+    append_indices(A, args);
+    append_indices(B, args);
+
+    Eigen::Index n = A.rows();
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(n), static_cast<NodeIdx>(B.cols()), 0};
+    size_t first = record_block<CholeskySolveBlock, var_value_t<V>>(args, B.size() + n*n, dims);
+    return block_outputs<V>(first, n, B.cols());
+}
+
+/**
+ * Logarithm of the absolute value of the determinant, recorded as a single node
+ */
+template <typename Derived>
+typename Derived::Scalar log_det(Eigen::MatrixBase<Derived> const & A) {
+    using V = typename Derived::Scalar;
+    check_square("log_det", A);
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size());
+    append_indices(A, args);
+
+    Eigen::Index n = A.rows();
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(n), 0, 0};
+    return V::from_index(record_block<LogDetBlock, var_value_t<V>>(args, 1 + n*n + n, dims));
+}
+
+/**
+ * Inverse of a square matrix, recorded as a single node. Prefer `solve`
+ * when the inverse is only multiplied by other matrices.
+ */
+template <typename Derived>
+VarMatrix<typename Derived::Scalar> inverse(Eigen::MatrixBase<Derived> const & A) {
+    using V = typename Derived::Scalar;
+    check_square("inverse", A);
+
+    std::vector<NodeIdx> args;
+    args.reserve(A.size());
+    append_indices(A, args);
+
+    Eigen::Index n = A.rows();
+    std::array<NodeIdx, 3> dims = {static_cast<NodeIdx>(n), 0, 0};
+    size_t first = record_block<InverseBlock, var_value_t<V>>(args, n*n, dims);
+    return block_outputs<V>(first, n, n);
+}
+
+}; // namespace reverse
+}; // namespace autodiff
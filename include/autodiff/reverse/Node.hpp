@@ -1,109 +1,198 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 namespace autodiff {
 namespace reverse {
 
-template <typename T> class Node;
-template <typename T> class IndNode;
-template <typename T> class UnaryNode;
-template <typename T> class BinaryNode;
-
-template <typename T>
-using NodePtr = Node<T> * const;
-
-// TODO: (maybe) forward() function for lazy evaluation
 /**
- * @class Node
- * @brief An abstract class which represents a generic node in the computational graph
- * @tparam T The type of the underlying variable
+ * Type used to refer to a node in the Tape.
+ * 32 bits are enough for tapes with ~4 billion nodes and halve the
+ * size of the argument columns wrt `size_t`.
  */
-template <typename T>
-class Node {
-public:
-    /**
-     * Creates a new node from a given value
-     * 
-     * @param value The value of the node
-     */
-    Node(T const & value): value_(value), grad_() {}
+using NodeIdx = std::uint32_t;
 
-    virtual void backward() = 0;
-    virtual ~Node() = default;
+/**
+ * @brief The operation performed by a node of the computational graph
+ *
+ * The Tape doesn't store polymorphic objects: each node is described
+ * by its `OpCode` plus (at most) two argument indices. The actual math
+ * of each operation lives in the corresponding `NodeType` (see `Functions.hpp`)
+ * and is selected with a switch during the sweeps over the Tape.
+ */
+enum class OpCode : std::uint8_t {
+    // Leaves
+    Ind,
+    // Binary operators
+    Add,
+    Sub,
+    Prod,
+    Div,
+    Pow,
+    // Unary operators
+    Neg,
+    Abs,
+    Cos,
+    Sin,
+    Tan,
+    Log,
+    Relu,
+    Tanh,
+    Exp,
+    Sqrt,
+    // Unary operators with a constant operand
+    AddConst,
+    ConstSub,
+    Scale,
+    DivConst,
+    ConstDiv,
+    PowConst,
+    ConstPow,
+    // N-ary operators
+    Statement,
+    Block,
+    Output
+};
 
-    T value() const {
-        return value_;
-    }
-    T grad() const {
-        return grad_;
-    }
+/**
+ * The number of `OpCode`(s)
+ */
+constexpr std::size_t N_OPCODES = static_cast<std::size_t>(OpCode::Output) + 1;
 
-    /**
-     * A function that simplifies the update of the derivative
-     * of the node during the backward pass
-     */
-    void update_grad(T const & grad) {
-        grad_ += grad;
-    }
-    void clear_grad() {
-        grad_ = 0;
+/**
+ * Returns the name of the `NodeType` of an `OpCode`
+ */
+inline char const * to_string(OpCode op) {
+    switch(op) {
+        case OpCode::Ind:       return "IndNode";
+        case OpCode::Add:       return "AddNode";
+        case OpCode::Sub:       return "SubNode";
+        case OpCode::Prod:      return "ProdNode";
+        case OpCode::Div:       return "DivNode";
+        case OpCode::Pow:       return "PowNode";
+        case OpCode::Neg:       return "NegNode";
+        case OpCode::Abs:       return "AbsNode";
+        case OpCode::Cos:       return "CosNode";
+        case OpCode::Sin:       return "SinNode";
+        case OpCode::Tan:       return "TanNode";
+        case OpCode::Log:       return "LogNode";
+        case OpCode::Relu:      return "ReluNode";
+        case OpCode::Tanh:      return "TanhNode";
+        case OpCode::Exp:       return "ExpNode";
+        case OpCode::Sqrt:      return "SqrtNode";
+        case OpCode::AddConst:  return "AddConstNode";
+        case OpCode::ConstSub:  return "ConstSubNode";
+        case OpCode::Scale:     return "ScaleNode";
+        case OpCode::DivConst:  return "DivConstNode";
+        case OpCode::ConstDiv:  return "ConstDivNode";
+        case OpCode::PowConst:  return "PowConstNode";
+        case OpCode::ConstPow:  return "ConstPowNode";
+        case OpCode::Statement: return "StatementNode";
+        case OpCode::Block:     return "BlockNode";
+        case OpCode::Output:    return "OutputNode";
     }
+    return "UnknownNode";
+}
 
-protected:
-    T value_;
-    T grad_;
+/**
+ * @brief A comparison between the values of two nodes (or of a node and
+ * a constant) which has been recorded in the Tape
+ *
+ * Comparisons are not differentiable, but they determine the control flow
+ * of the function that generated the Tape. Hence, when the Tape is re-evaluated
+ * at a new point, the recorded comparisons act as guards: if any of them
+ * gives a different result, the Tape is no longer valid for that point.
+ */
+enum class CmpOp : std::uint8_t {
+    Lt,
+    Gt,
+    Eq,
+    Ne,
+    Le,
+    Ge
 };
 
 /**
  * @class IndNode
- * @brief A class which represents variables or constants in the computational graph.
+ * @brief Represents variables or constants in the computational graph.
  * @tparam T The type of the underlying variable
  *
  * IndNode stands for Independent Node, i.e. the leaf nodes of the computational graph
  */
 template <typename T>
-class IndNode : public Node<T> {
-public:
-    IndNode(T const & value): Node<T>(value) {}
-    
-    // backward on a leaf node does nothing
-    void backward() override {}
+struct IndNode {
+    static constexpr std::size_t arity = 0;
+    static constexpr bool with_constant = false;
+    static constexpr OpCode opcode = OpCode::Ind;
 };
 
-
 /**
  * @class UnaryNode
- * @brief An abstract class which represents functions taking only one input.
+ * @brief Base for functions taking only one input.
  * @tparam T The type of the underlying variable
+ *
+ * A `UnaryNode` must provide:
+ *  - `static T forward(T const & first)`: the value of the function
+ *  - `static T partial(T const & value, T const & first)`: the derivative of
+ *     the function wrt its argument, given the value of the node (`value`)
+ *     and the value of the argument (`first`)
  */
 template <typename T>
-class UnaryNode : public Node<T> {
-public:
-    UnaryNode(T const & value, NodePtr<T> first):
-     Node<T>(value), first_(first) {}
+struct UnaryNode {
+    static constexpr std::size_t arity = 1;
+    static constexpr bool with_constant = false;
+};
 
-    // virtual void backward() = 0;
-protected:
-    NodePtr<T> first_;
+/**
+ * @class ScalarNode
+ * @brief Base for functions taking one input and a constant operand.
+ * @tparam T The type of the underlying variable
+ *
+ * The constant is stored inline in the Tape, hence mixed `Var`/scalar
+ * expressions (e.g. `2.0 * x`) don't need an `IndNode` for the scalar.
+ *
+ * A `ScalarNode` must provide:
+ *  - `static T forward(T const & first, T const & constant)`
+ *  - `static T partial(T const & value, T const & first, T const & constant)`
+ */
+template <typename T>
+struct ScalarNode {
+    static constexpr std::size_t arity = 1;
+    static constexpr bool with_constant = true;
 };
 
 /**
  * @class BinaryNode
- * @brief An abstract class which represents functions taking 2 inputs.
+ * @brief Base for functions taking 2 inputs.
  * @tparam T The type of the underlying variable
+ *
+ * A `BinaryNode` must provide:
+ *  - `static T forward(T const & first, T const & second)`
+ *  - `static void partials(T const & value, T const & first, T const & second,
+ *     T & d_first, T & d_second)`
  */
 template <typename T>
-class BinaryNode: public Node<T> {
-public:
-    BinaryNode(T const & value, NodePtr<T> first, NodePtr<T> second):
-     Node<T>(value), first_(first), second_(second) {}
+struct BinaryNode {
+    static constexpr std::size_t arity = 2;
+    static constexpr bool with_constant = false;
+};
 
-    // virtual void backward() = 0;
-protected:
-    NodePtr<T> first_;
-    NodePtr<T> second_;
+/**
+ * @class NaryNode
+ * @brief Base for nodes with an arbitrary number of arguments.
+ * @tparam T The type of the underlying variable
+ *
+ * The arguments and the local partials of an `NaryNode` don't fit in the
+ * `first`/`second` columns of the Tape: they are stored in side arrays
+ * of the `NodeManager` and the backward pass simply accumulates
+ * `grad * partial` into each argument (see `StatementNode`).
+ */
+template <typename T>
+struct NaryNode {
+    static constexpr std::size_t arity = 0;
+    static constexpr bool with_constant = false;
 };
 
 }; // namespace reverse
-}; // namespace autodiff 
+}; // namespace autodiff
@@ -1,56 +1,104 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 
 #include "Node.hpp"
+#include "Functions.hpp"
 #include "ArenaAllocator.hpp"
+#include "TapeStats.hpp"
 
 namespace autodiff {
 namespace reverse {
 
 /**
  * @class NodeManager
- * @brief A middle-end class between the actual `Node`(s) of the computational graph
- * and the `Var`(s) in the front-end
+ * @brief A middle-end class between the actual nodes of the computational graph
+ * (the Tape) and the `Var`(s) in the front-end
  * @tparam T The type of the underlying variables
  *
  * The main reason why this class exists is to avoid the need for explicitly computing
  * a topological ordering of the nodes of the computationl graph before the
  * backward pass.
  * In fact, as expressions involving `Var` instances are evaluated, the corresponding
- * computational graph nodes are automatically created and inserted in a
- * memory pool (arena allocator) in the order of their creation (which naturally forms a valid 
+ * computational graph nodes are automatically appended to the Tape
+ * in the order of their creation (which naturally forms a valid
  * topological order of the computational graph).
- * 
- * The class is a singleton in order to force all the allocations to be made in a single
- * memory pool.
+ *
+ * The Tape is stored as a struct of arrays: the i-th node is described by
+ * `ops_[i]`, `first_[i]`, `second_[i]`, `values_[i]` and `grads_[i]`.
+ * Compared to an array of pointers to polymorphic nodes this:
+ *  1. Avoids a virtual call (and a pointer chase) per node in the backward pass
+ *  2. Roughly halves the number of bytes per node
+ *  3. Makes every sweep over the Tape a linear scan over contiguous memory
+ *
+ * Each `NodeManager` is an independent Tape (see the `Tape` alias below).
+ * `Var`(s) always record into the *active* Tape of the calling thread,
+ * which is returned by `instance()`:
+ *  - by default it is a thread-local Tape, so that independent threads
+ *    never share (and corrupt) the same Tape
+ *  - an explicit Tape can be made active for the current thread with
+ *    an `ActiveTape` object
  */
 template <typename T>
 class NodeManager {
 public:
     // No copy or move allowed
+    //  (the indices stored in the `Var`(s) refer to a specific Tape)
     NodeManager(NodeManager const &) = delete;
     NodeManager& operator=(NodeManager const &) = delete;
     NodeManager(NodeManager &&) = delete;
     NodeManager& operator=(NodeManager &&) = delete;
 
+    /**
+     * Creates a new, empty, Tape
+     *
+     * @param policy How the arena of the Tape (which holds the operands
+     * of the `BlockNode`(s)) requests memory
+     */
+    explicit NodeManager(ArenaPolicy const & policy = ArenaPolicy{}):
+        arena_{policy}
+    {
+        // allocate a first dummy node
+        push_node(OpCode::Ind, 0, 0, T{0.0});
+    }
+
+    ~NodeManager() {
+        destroy_operands();
+    }
+
+    /**
+     * Returns the Tape which is currently active on the calling thread
+     */
     static NodeManager& instance() {
-        static NodeManager instance;
-        return instance;
+        return *active();
     }
 
+    template <typename U>
+    friend class ActiveTape;
+
     // *********** Templated factory functions ***********
     // Thanks to templates we can add a new node to the tape
     //  without the need to explicitly define a factory method
     //  for that specific node.
     // The only thing that must be done is to use the appropriate
-    //  method based on the general type of node (IndNode/UnaryNode/BinaryNode)
-    
+    //  method based on the general type of node (IndNode/UnaryNode/ScalarNode/BinaryNode)
+
     /**
      * Factory function for IndNode(s)
-     * 
+     *
      * @tparam U The type of the underlying variables
      * @param value The value of the `Node`
      */
@@ -59,7 +107,7 @@ public:
 
     /**
      * Factory function for `UnaryNode`(s)
-     * 
+     *
      * @tparam NodeType The type of the actual `UnaryNode` to create
      * @tparam U The type of the underlying variables
      * @param first The index of the first (and only) argument `Node` of the
@@ -70,7 +118,7 @@ public:
 
     /**
      * Factory function for `BinaryNode`(s)
-     * 
+     *
      * @tparam NodeType The type of the actual `BinaryNode` to create
      * @tparam U The type of the underlying variables
      * @param first The index of the first argument `Node` of the
@@ -81,139 +129,2301 @@ public:
     template <template <typename> class NodeType, typename U>
     friend size_t new_node(size_t first, size_t second);
 
+    /**
+     * Factory function for `ScalarNode`(s)
+     *
+     * @tparam NodeType The type of the actual `ScalarNode` to create
+     * @tparam U The type of the underlying variables
+     * @param first The index of the (only) argument `Node` of the
+     * function the new `Node` represents
+     * @param constant The constant operand, stored inline in the Tape
+     */
+    template <template <typename> class NodeType, typename U>
+    friend size_t new_node(size_t first, U const & constant);
+
+    /**
+     * Factory function for `StatementNode`(s)
+     *
+     * @tparam E The type of the expression (see `Expression.hpp`)
+     * @param expr The right-hand side of the statement
+     */
+    template <typename E>
+    friend size_t new_statement(E const & expr);
+
+    /**
+     * Evaluates an expression without recording it
+     */
+    template <typename E>
+    friend typename E::Scalar expression_value(E const & expr);
+
+    /**
+     * Computes the value and the local partials of a `StatementNode`
+     * given the values of the nodes of the Tape (`values`), the indices
+     * of its arguments (`args`) and its constant operands (`constants`).
+     * One such function is generated for each type of expression.
+     */
+    using StatementFn = void (*)(
+        T const * values, NodeIdx const * args, T const * constants,
+        T & value, T * partials
+    );
+
+    /**
+     * Computes the local second derivatives of a `StatementNode` wrt its
+     * arguments (`hessian` is a row-major n_args x n_args matrix), given
+     * the same inputs of a `StatementFn`
+     */
+    using StatementHessianFn = void (*)(
+        T const * values, NodeIdx const * args, T const * constants,
+        T * hessian
+    );
+
+    /**
+     * Kernels of a `BlockNode` (see `MatrixFunctions.hpp`):
+     *  - `BlockForward` computes the values of the outputs given the
+     *    (contiguous) values of the operands
+     *  - `BlockBackward` computes the adjoints of the operands given the
+     *    adjoints of the outputs. `operand_grads` is zero-initialized
+     *
+     * `dims` are the (up to 3) dimensions the block has been recorded with.
+     */
+    using BlockForward = void (*)(
+        NodeIdx const * dims, T const * operands, T * outputs
+    );
+    using BlockBackward = void (*)(
+        NodeIdx const * dims, T const * operands, T const * outputs,
+        T const * output_grads, T * operand_grads
+    );
+
+    /**
+     * Factory function for `BlockNode`(s)
+     *
+     * Appends a `BlockNode` followed by its `n_outputs` `OutputNode`(s).
+     *
+     * @tparam U The type of the underlying variables
+     * @param args The indices of the operands of the block
+     * @param n_args The number of operands
+     * @param n_outputs The number of outputs
+     * @param dims The dimensions passed to the kernels
+     * @param forward The forward kernel
+     * @param backward The backward kernel
+     * @return The index of the first `OutputNode`
+     */
+    template <typename U>
+    friend size_t new_block(
+        NodeIdx const * args, size_t n_args, size_t n_outputs,
+        std::array<NodeIdx, 3> const & dims,
+        typename NodeManager<U>::BlockForward forward,
+        typename NodeManager<U>::BlockBackward backward
+    );
+
+    // *********** Serialization (see `TapeIO.hpp`) ***********
+    template <typename U>
+    friend void save_tape(NodeManager<U> const & tape, std::string const & path);
+
+    template <typename U>
+    friend void load_tape(NodeManager<U> & tape, std::string const & path);
+
+    // *********** Optimization passes (see `TapePasses.hpp`) ***********
+    template <typename U>
+    friend class TapeOptimization;
+
     // *********** Derivatives computation/update/access ***********
+    /**
+     * A list of node indices in decreasing order, i.e. in the order in
+     * which they are visited by the backward pass (see `cone`)
+     */
+    using Cone = std::vector<NodeIdx>;
+
+    /**
+     * Computes the output cone of the given roots, i.e. the indices
+     * of all the nodes that (at least) one of the roots depends on
+     * (roots included).
+     *
+     * The backward pass only needs to visit these nodes: all the others
+     * would receive a null adjoint. Since the cone only depends on the
+     * structure of the Tape, it can be computed once and reused by
+     * multiple backward passes (e.g. when the Tape is replayed).
+     *
+     * @param roots The indices of the roots
+     * @param n_roots The number of roots
+     * @param cone (OUT) The indices of the nodes in the cone, in decreasing order
+     */
+    void cone(size_t const * roots, size_t n_roots, Cone & cone) {
+        cone.clear();
+        // `marks_` is all zeros between calls
+        marks_.resize(ops_.size(), 0);
+
+        size_t top = 0;
+        for(size_t k = 0; k < n_roots; ++k) {
+            marks_[roots[k]] = 1;
+            top = std::max(top, roots[k]);
+        }
+
+        for(size_t i = top + 1; i-- > 0;) {
+            if(!marks_[i]) {
+                continue;
+            }
+            marks_[i] = 0;
+            cone.push_back(static_cast<NodeIdx>(i));
+
+            for_each_arg(i, [&](NodeIdx arg) {
+                marks_[arg] = 1;
+            });
+        }
+    }
+
+    /**
+     * Computes the sparsity pattern of the jacobian of the `outputs`
+     * wrt the `inputs`, i.e. which outputs depend on which inputs,
+     * without computing any derivative.
+     *
+     * The sets of inputs each node depends on are propagated with a
+     * forward sweep over the output cone of the `outputs`. The pattern is
+     * structural: an entry whose derivative happens to be zero at the
+     * recorded point (e.g. `x*0`) is still reported, and the pattern holds
+     * for the branches taken during the recording (see `forward`).
+     *
+     * @param inputs The indices of the input nodes (the columns)
+     * @param n_inputs The number of inputs
+     * @param outputs The indices of the output nodes (the rows)
+     * @param n_outputs The number of outputs
+     * @return For each output, the positions in `inputs` of the inputs
+     * it depends on (in increasing order)
+     */
+    std::vector<std::vector<NodeIdx>> sparsity(size_t const * inputs, size_t n_inputs, size_t const * outputs, size_t n_outputs) {
+        end_recording();
+        cone(outputs, n_outputs, cone_);
+
+        // the (sorted) inputs each node depends on
+        std::vector<std::vector<NodeIdx>> deps(ops_.size());
+        for(size_t k = 0; k < n_inputs; ++k) {
+            deps[inputs[k]].push_back(static_cast<NodeIdx>(k));
+        }
+
+        std::vector<NodeIdx> merged;
+        for(size_t n = cone_.size(); n-- > 0;) {
+            NodeIdx i = cone_[n];
+            if(ops_[i] == OpCode::Ind) {
+                continue;
+            }
+            for_each_arg(i, [&](NodeIdx arg) {
+                merged.clear();
+                std::set_union(
+                    deps[i].begin(), deps[i].end(), deps[arg].begin(), deps[arg].end(),
+                    std::back_inserter(merged)
+                );
+                deps[i].swap(merged);
+            });
+        }
+
+        std::vector<std::vector<NodeIdx>> rows(n_outputs);
+        for(size_t k = 0; k < n_outputs; ++k) {
+            rows[k] = deps[outputs[k]];
+        }
+        return rows;
+    }
+
+    /**
+     * A nonzero of a hessian computed by `hessian`: the second derivative
+     * wrt the nodes `row` and `col`
+     */
+    struct HessianEntry {
+        NodeIdx row;
+        NodeIdx col;
+        T value;
+    };
+
+    /**
+     * Computes the hessian of the `Node` `root` wrt the leaf nodes it
+     * depends on, with a single reverse sweep over its cone (edge pushing).
+     *
+     * Along with the adjoints, the sweep keeps the symmetric matrix `W` of
+     * the second-order interactions between the nodes which have not been
+     * visited yet. Visiting a node `i` with arguments `a_j`, local partials
+     * `d_j` and local second partials `d_jk`:
+     *  1. pushes the interactions of `i` to its arguments
+     *     (`W[a_j][p] += d_j*W[i][p]` and `W[a_j][a_k] += d_j*d_k*W[i][i]`)
+     *  2. creates the interactions of its arguments
+     *     (`W[a_j][a_k] += adjoint(i)*d_jk`)
+     *  3. propagates its adjoint (as `backward` does)
+     * and removes `i` from `W`. What is left in `W` when the leaves are
+     * reached is the hessian. Only the nonzero pattern of the hessian (and
+     * of the intermediate interactions) is ever stored.
+     *
+     * The gradient is accumulated in the adjoints, as with `backward(root)`.
+     *
+     * @param root The index of a `Node`
+     * @return The nonzeros of the hessian (both triangles), indexed by
+     * the leaf nodes
+     */
+    std::vector<HessianEntry> hessian(size_t root) {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, backward_time_);
+        ++n_backward_;
+
+        cone(&root, 1, cone_);
+        grads_[root] += T{1.0};
+
+        // the interactions are stored per position in the cone:
+        //  W(i)[p] == W(p)[i] for the nodes not visited yet
+        hessian_pos_.resize(ops_.size());
+        for(size_t k = 0; k < cone_.size(); ++k) {
+            hessian_pos_[cone_[k]] = static_cast<NodeIdx>(k);
+        }
+        if(hessian_W_.size() < cone_.size()) {
+            hessian_W_.resize(cone_.size());
+        }
+        for(size_t k = 0; k < cone_.size(); ++k) {
+            hessian_W_[k].clear();
+        }
+        auto W = [&](NodeIdx i) -> std::unordered_map<NodeIdx, T> & {
+            return hessian_W_[hessian_pos_[i]];
+        };
+
+        std::vector<NodeIdx> args;
+        std::vector<T> d;
+        std::vector<T> d2;
+
+        for(NodeIdx i: cone_) {
+            if(ops_[i] == OpCode::Ind) {
+                continue;
+            }
+            local_derivatives(i, args, d, d2);
+            size_t const n = args.size();
+            T const adjoint = grads_[i];
+            auto & W_i = W(i);
+
+            // 1. pushing
+            for(auto const & [p, w]: W_i) {
+                if(p == i) {
+                    for(size_t j = 0; j < n; ++j) {
+                        for(size_t k = 0; k < n; ++k) {
+                            W(args[j])[args[k]] += d[j] * d[k] * w;
+                        }
+                    }
+                } else {
+                    for(size_t j = 0; j < n; ++j) {
+                        W(args[j])[p] += d[j] * w;
+                        W(p)[args[j]] += d[j] * w;
+                    }
+                }
+            }
+
+            // 2. creating
+            for(size_t j = 0; j < n; ++j) {
+                for(size_t k = 0; k < n; ++k) {
+                    if(d2[j*n + k] != T{0.0}) {
+                        W(args[j])[args[k]] += adjoint * d2[j*n + k];
+                    }
+                }
+            }
+
+            // 3. adjoints
+            for(size_t j = 0; j < n; ++j) {
+                grads_[args[j]] += adjoint * d[j];
+            }
+
+            for(auto const & [p, w]: W_i) {
+                if(p != i) {
+                    W(p).erase(i);
+                }
+            }
+            W_i.clear();
+        }
+
+        touch(cone_);
+
+        std::vector<HessianEntry> entries;
+        for(NodeIdx i: cone_) {
+            for(auto const & [p, w]: W(i)) {
+                entries.push_back({i, p, w});
+            }
+        }
+        return entries;
+    }
+
     /**
      * Computes the derivative of the `Node` whose index is specified
      * as an argument wrt all the input `Node`(s)
-     * 
+     *
+     * Only the nodes `root` depends on are visited (see `cone`).
+     *
      * @param root The index of a `Node`
      */
     void backward(size_t root) {
+        cone(&root, 1, cone_);
+        backward(root, cone_);
+    }
+
+    /**
+     * Same as `backward(root)` but with a precomputed cone
+     *
+     * @param root The index of a `Node`
+     * @param cone The output cone of `root` (see `cone`)
+     */
+    void backward(size_t root, Cone const & cone) {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, backward_time_);
+        ++n_backward_;
+
         // Set root node's gradient to default value
-        nodes_[root]->update_grad(T{1.0});
+        grads_[root] += T{1.0};
 
         // Nodes are already in topological order
-        auto iter = nodes_.rbegin() + (nodes_.size() - root - 1);
-        for(; iter != nodes_.rend(); ++iter) {
-            (*iter)->backward();
+        sweep(cone, [&](NodeIdx i) {
+            visit_node<T>(ops_[i], [&]<typename NodeType>() {
+                propagate<NodeType>(i);
+            });
+        });
+
+        touch(cone);
+    }
+
+    /**
+     * The nodes of a cone grouped by level: the level of a node is the
+     * length of the longest path from the root to it. Since every argument
+     * of a node is at a higher level than the node itself, the nodes of a
+     * level don't depend on each other and their adjoints are final once
+     * the previous levels have been propagated.
+     */
+    struct Schedule {
+        std::vector<NodeIdx> nodes;     // the nodes of the cone sorted by level
+        std::vector<size_t> levels;     // the nodes of the l-th level are [levels[l], levels[l+1])
+    };
+
+    /**
+     * Levels narrower than this are propagated by a single thread
+     */
+    static constexpr size_t MIN_PARALLEL_LEVEL = 256;
+
+    /**
+     * Groups the nodes of a cone by level (see `Schedule`)
+     *
+     * Like the cone, the schedule only depends on the structure of the Tape
+     * and can be reused by multiple backward passes.
+     *
+     * @param cone The output cone of a single root (see `cone`)
+     * @param schedule (OUT) The levels of the cone
+     */
+    void schedule(Cone const & cone, Schedule & schedule) {
+        schedule.nodes.clear();
+        schedule.levels.clear();
+        depths_.resize(ops_.size());
+
+        // the cone is in decreasing order: the depth of a node is final
+        //  before its arguments are visited
+        NodeIdx n_levels = 0;
+        for(NodeIdx i: cone) {
+            depths_[i] = 0;
+        }
+        for(NodeIdx i: cone) {
+            NodeIdx depth = depths_[i];
+            n_levels = std::max(n_levels, depth + 1);
+            for_each_arg(i, [&](NodeIdx arg) {
+                depths_[arg] = std::max(depths_[arg], depth + 1);
+            });
+        }
+
+        // counting sort by depth
+        schedule.levels.assign(n_levels + 1, 0);
+        for(NodeIdx i: cone) {
+            ++schedule.levels[depths_[i] + 1];
+        }
+        for(size_t l = 0; l < n_levels; ++l) {
+            schedule.levels[l+1] += schedule.levels[l];
+        }
+        schedule.nodes.resize(cone.size());
+        std::vector<size_t> next(schedule.levels.begin(), schedule.levels.end() - 1);
+        for(NodeIdx i: cone) {
+            schedule.nodes[next[depths_[i]]++] = i;
+        }
+    }
+
+    /**
+     * Same as `backward(root)`, but the nodes of each level (see `Schedule`)
+     * are propagated in parallel by the OpenMP threads. Wide Tapes (e.g. a
+     * loss summed over a large batch) have many independent nodes per level.
+     * Note that a sum accumulated in a loop is a chain, i.e. a single node
+     * per level: reduce the terms pairwise (or in a single expression) to
+     * expose their independence.
+     *
+     * The adjoints shared by the nodes of a level (fan-in) are accumulated
+     * atomically. `BlockNode`(s) are propagated by a single thread, after
+     * the other nodes of their level. Tapes of non floating point values
+     * are propagated sequentially (in level order). The backward profiler
+     * is not supported.
+     *
+     * Without OpenMP the result is the same of `backward(root)`.
+     *
+     * @param root The index of a `Node`
+     */
+    void parallel_backward(size_t root) {
+        cone(&root, 1, cone_);
+        schedule(cone_, schedule_);
+        parallel_backward(root, schedule_);
+    }
+
+    /**
+     * Same as `parallel_backward(root)` but with a precomputed schedule
+     *
+     * @param root The index of a `Node`
+     * @param schedule The levels of the output cone of `root` (see `schedule`)
+     */
+    void parallel_backward(size_t root, Schedule const & schedule) {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, backward_time_);
+        ++n_backward_;
+
+        grads_[root] += T{1.0};
+
+        std::vector<NodeIdx> const & nodes = schedule.nodes;
+        for(size_t l = 0; l + 1 < schedule.levels.size(); ++l) {
+            std::ptrdiff_t begin = schedule.levels[l];
+            std::ptrdiff_t end = schedule.levels[l+1];
+
+            // the atomic updates need floating point adjoints: the other
+            //  types are always propagated sequentially
+            if constexpr (std::is_floating_point_v<T>) {
+                if(end - begin >= static_cast<std::ptrdiff_t>(MIN_PARALLEL_LEVEL)) {
+                    parallel_level(begin, end, nodes);
+                    continue;
+                }
+            }
+            for(std::ptrdiff_t k = begin; k < end; ++k) {
+                visit_node<T>(ops_[nodes[k]], [&]<typename NodeType>() {
+                    propagate<NodeType>(nodes[k]);
+                });
+            }
+        }
+
+        touch(schedule.nodes);
+    }
+
+    /**
+     * Default number of lanes of `batch_gradient`: 8 doubles fill an AVX-512
+     * register (or two AVX2 registers)
+     */
+    static constexpr size_t BATCH_LANES = 8;
+
+    /**
+     * Batched (across samples) evaluation: computes the value and the
+     * gradient of `root` wrt the `inputs` at many points by replaying the
+     * Tape, which is recorded once (at any point).
+     *
+     * The points are processed `K` at a time: each node holds `K` values and
+     * `K` adjoints (one lane per point, stored contiguously), hence each node
+     * is dispatched once per `K` points and its lanes are updated by
+     * fixed-size loops which the compiler vectorizes. The `StatementNode`(s)
+     * and the `BlockNode`(s) are evaluated one lane at a time.
+     *
+     * Only the nodes `root` (and the recorded comparisons) depend on are
+     * evaluated. The values and the adjoints of the scalar passes are left
+     * unchanged. Each group of `K` points counts as one replay in `stats`.
+     *
+     * @tparam K The number of lanes
+     * @param root The index of the `Node` to differentiate
+     * @param inputs The indices of the input nodes
+     * @param n_inputs The number of inputs
+     * @param points The points, column-major (n_inputs x n_points): the
+     * values of the inputs at a point are contiguous
+     * @param n_points The number of points
+     * @param values (OUT) The value of `root` at each point
+     * @param gradients (OUT) The gradient of `root` at each point,
+     * column-major (n_inputs x n_points)
+     * @return `true` if every point takes the branches taken during the
+     * recording (see `forward`): the results at the other points are not
+     * meaningful
+     */
+    template <size_t K = BATCH_LANES>
+    bool batch_gradient(
+        size_t root, size_t const * inputs, size_t n_inputs,
+        T const * points, size_t n_points, T * values, T * gradients
+    ) {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, replay_time_);
+
+        // evaluated nodes: the cone of the root and of the guards
+        batch_roots_.assign(1, root);
+        for(auto const & guard: guards_) {
+            batch_roots_.push_back(guard.lhs);
+            if(!guard.rhs_is_constant) {
+                batch_roots_.push_back(guard.rhs);
+            }
+        }
+        cone(batch_roots_.data(), batch_roots_.size(), batch_cone_);
+        cone(&root, 1, cone_);
+
+        batch_values_.resize(ops_.size() * K);
+        batch_grads_.resize(ops_.size() * K);
+        batch_partials_.resize(nary_partials_.size() * K);
+        // the leaves which are not inputs keep their value in every lane
+        for(NodeIdx i: batch_cone_) {
+            std::fill_n(&batch_values_[i*K], K, values_[i]);
+        }
+
+        bool valid = true;
+        for(size_t begin = 0; begin < n_points; begin += K) {
+            ++n_replays_;
+            // the unused lanes (of the last group) repeat the last point
+            size_t n_lanes = std::min(K, n_points - begin);
+            for(size_t j = 0; j < n_inputs; ++j) {
+                T * lanes = &batch_values_[inputs[j]*K];
+                for(size_t k = 0; k < K; ++k) {
+                    lanes[k] = points[(begin + std::min(k, n_lanes-1))*n_inputs + j];
+                }
+            }
+
+            for(size_t c = batch_cone_.size(); c-- > 0;) {
+                NodeIdx i = batch_cone_[c];
+                visit_node<T>(ops_[i], [&]<typename NodeType>() {
+                    evaluate_lanes<NodeType, K>(i);
+                });
+            }
+            for(auto const & guard: guards_) {
+                for(size_t k = 0; k < n_lanes; ++k) {
+                    T const & rhs = guard.rhs_is_constant ? guard.constant : batch_values_[guard.rhs*K + k];
+                    if(eval_cmp(guard.op, batch_values_[guard.lhs*K + k], rhs) != guard.result) {
+                        valid = false;
+                    }
+                }
+            }
+
+            for(NodeIdx i: cone_) {
+                std::fill_n(&batch_grads_[i*K], K, T{0.0});
+                // a block reads the adjoints of all its outputs, also the
+                //  ones outside the cone
+                if(ops_[i] == OpCode::Block) {
+                    std::fill_n(&batch_grads_[(i+1)*K], blocks_[first_[i]].n_outputs*K, T{0.0});
+                }
+            }
+            for(size_t j = 0; j < n_inputs; ++j) {
+                std::fill_n(&batch_grads_[inputs[j]*K], K, T{0.0});
+            }
+            std::fill_n(&batch_grads_[root*K], K, T{1.0});
+            for(NodeIdx i: cone_) {
+                visit_node<T>(ops_[i], [&]<typename NodeType>() {
+                    propagate_batch<NodeType, K>(i);
+                });
+            }
+
+            for(size_t k = 0; k < n_lanes; ++k) {
+                values[begin + k] = batch_values_[root*K + k];
+                for(size_t j = 0; j < n_inputs; ++j) {
+                    gradients[(begin + k)*n_inputs + j] = batch_grads_[inputs[j]*K + k];
+                }
+            }
+        }
+
+        // the operands of the blocks hold the values of the last lane:
+        //  restore the ones of the scalar passes
+        for(auto & block: blocks_) {
+            for(NodeIdx j = 0; j < block.n_args; ++j) {
+                block.operands[j] = values_[block_args_[block.args + j]];
+            }
+        }
+        return valid;
+    }
+
+    /**
+     * Vector-mode backward pass: computes the derivatives of up to `K`
+     * `Node`(s) wrt all the input `Node`(s) with a single sweep over the Tape.
+     *
+     * Each node carries `K` adjoints (one per lane), stored contiguously
+     * so that the update of the lanes of a node is a fixed-size loop which the
+     * compiler can vectorize. The local partials of each node are computed
+     * only once per sweep and shared by all the lanes.
+     *
+     * The adjoints are stored separately from the ones of the scalar `backward`
+     * and can be read with `get_node_grad(idx, lane)` until the next
+     * vector-mode backward pass.
+     *
+     * @tparam K The number of lanes
+     * @param roots The indices of the `Node`(s) to differentiate: the adjoint
+     * of `roots[k]` is seeded in lane `k`
+     * @param n_roots The number of roots (<= `K`). Unused lanes are left to 0
+     */
+    template <size_t K>
+    void backward(size_t const * roots, size_t n_roots) {
+        cone(roots, n_roots, cone_);
+        backward<K>(roots, n_roots, cone_);
+    }
+
+    /**
+     * Same as `backward<K>(roots, n_roots)` but with a precomputed cone
+     *
+     * @param cone The output cone of `roots` (see `cone`)
+     */
+    template <size_t K>
+    void backward(size_t const * roots, size_t n_roots, Cone const & cone) {
+        backward<K>(roots, nullptr, n_roots, cone);
+    }
+
+    /**
+     * Same as `backward<K>(roots, n_roots, cone)` but the adjoint of
+     * `roots[k]` is seeded in lane `lanes[k]` (in lane `k` if `lanes` is null).
+     *
+     * Multiple roots can share a lane: the lane then holds the sum of their
+     * derivatives (e.g. the compressed rows of a sparse jacobian, see
+     * `sparse_jacobian`).
+     *
+     * @param lanes The lane (< `K`) of each root
+     */
+    template <size_t K>
+    void backward(size_t const * roots, size_t const * lanes, size_t n_roots, Cone const & cone) {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, backward_time_);
+        ++n_backward_;
+
+        if(n_lanes_ != K || lane_grads_.size() != ops_.size() * K) {
+            n_lanes_ = K;
+            lane_grads_.assign(ops_.size() * K, T{0.0});
+        } else {
+            // only the adjoints touched by the previous pass must be reset
+            for(NodeIdx i: lanes_touched_) {
+                std::fill_n(&lane_grads_[i*K], K, T{0.0});
+            }
+        }
+
+        for(size_t k = 0; k < n_roots; ++k) {
+            lane_grads_[roots[k]*K + (lanes ? lanes[k] : k)] += T{1.0};
         }
+
+        sweep(cone, [&](NodeIdx i) {
+            visit_node<T>(ops_[i], [&]<typename NodeType>() {
+                propagate_lanes<NodeType, K>(i);
+            });
+        });
+
+        lanes_touched_.assign(cone.begin(), cone.end());
+    }
+
+    /**
+     * Returns the adjoint of a `Node` in the given lane of the last
+     * vector-mode backward pass
+     */
+    T get_node_grad(size_t idx, size_t lane) const {
+        assert(lane < n_lanes_ && idx*n_lanes_ + lane < lane_grads_.size());
+        return lane_grads_[idx*n_lanes_ + lane];
     }
 
     /**
      * Sets the `grad` field of each `Node` to 0
+     *
+     * Only the adjoints touched by the backward passes since the last
+     * call are actually reset.
      */
     void clear_grad() {
-        for(auto & node: nodes_) {
-            node->clear_grad();
+        if(all_touched_) {
+            std::fill(grads_.begin(), grads_.end(), T{0.0});
+        } else {
+            for(NodeIdx i: touched_) {
+                grads_[i] = T{0.0};
+            }
         }
+        touched_.clear();
+        all_touched_ = false;
     }
 
     T get_node_grad(size_t idx) {
-        return nodes_[idx]->grad();
+        assert(idx < grads_.size());
+        return grads_[idx];
     }
     T get_node_value(size_t idx) {
-        return nodes_[idx]->value();
+        return values_[idx];
     }
 
-    // *********** Utility functions ***********
     /**
-     * Resets both the vector and the arena allocator without
-     * releasing the used memory
+     * Sets the value of a leaf `Node`.
+     * The values of the nodes which depend on it are updated only
+     * after a call to `forward`
      */
-    void clear() {
-        // resets the vector without modifying the capacity
-        nodes_.clear();
-        
-        // resets the arena allocator without releasing the used memory
-        arena_.clear();
+    void set_node_value(size_t idx, T const & value) {
+        values_[idx] = value;
+    }
 
-        // allocate a first dummy node
-        void * ptr = arena_.alloc(sizeof(IndNode<T>), alignof(IndNode<T>));
-        IndNode<T> * node_ptr = new (ptr) IndNode<T>{T{0.0}};
-        nodes_.emplace_back(node_ptr);
+    // *********** Replay ***********
+    /**
+     * Re-evaluates the value of every non-leaf `Node` of the Tape given
+     * the current values of the leaves.
+     *
+     * This allows to evaluate the recorded function at a new point
+     * (see `set_node_value`) without re-running the user code and without
+     * growing the Tape.
+     *
+     * @return `true` if every recorded comparison still gives the result it gave
+     * during the recording (i.e. the Tape is valid for the new point), `false`
+     * otherwise (i.e. the function must be recorded again)
+     */
+    bool forward() {
+        end_recording();
+        Stopwatch stopwatch(instrumented_, replay_time_);
+        ++n_replays_;
+
+        for(size_t i = 1; i < ops_.size(); ++i) {
+            visit_node<T>(ops_[i], [&]<typename NodeType>() {
+                evaluate<NodeType>(i);
+            });
+        }
+
+        return check_guards();
     }
 
-    // TODO: return memory from both the arena and the vector
-    // void release() {
-    // }
+    /**
+     * Compares the values of two nodes and records the comparison
+     * as a guard of the Tape
+     */
+    bool compare(CmpOp op, size_t lhs, size_t rhs) {
+        bool result = eval_cmp(op, values_[lhs], values_[rhs]);
+        guards_.push_back(Guard{
+            op, result, false,
+            static_cast<NodeIdx>(lhs), static_cast<NodeIdx>(rhs), T{0.0}
+        });
+        return result;
+    }
 
-    // TODO: delete?
-    // void reserve(size_t n_nodes) {
-    //     nodes_.reserve(n_nodes);
-    // }
+    /**
+     * Compares the value of a node with a constant and records the comparison
+     * as a guard of the Tape
+     */
+    bool compare(CmpOp op, size_t lhs, T const & rhs) {
+        bool result = eval_cmp(op, values_[lhs], rhs);
+        guards_.push_back(Guard{
+            op, result, true,
+            static_cast<NodeIdx>(lhs), 0, rhs
+        });
+        return result;
+    }
 
     /**
-     * Returns the number of nodes in the Tape
+     * Returns `true` if every recorded comparison gives the same result
+     * with the current values of the nodes
      */
-    size_t size() const {
-        return nodes_.size();
+    bool check_guards() const {
+        for(auto const & guard: guards_) {
+            T const & rhs = guard.rhs_is_constant ? guard.constant : values_[guard.rhs];
+            if(eval_cmp(guard.op, values_[guard.lhs], rhs) != guard.result) {
+                return false;
+            }
+        }
+        return true;
     }
 
-private:
-    NodeManager() {
+    /**
+     * Returns the number of comparisons recorded in the Tape
+     */
+    size_t n_guards() const {
+        return guards_.size();
+    }
+
+    // *********** Utility functions ***********
+    /**
+     * Resets the Tape without releasing the used memory
+     */
+    void clear() {
+        peak_size_ = std::max(peak_size_, ops_.size());
+        ++n_clears_;
+        ++generation_;
+        start_recording();
+        destroy_operands();
+        arena_.clear();
+
+        // resets the columns without modifying their capacity
+        ops_.clear();
+        first_.clear();
+        second_.clear();
+        values_.clear();
+        grads_.clear();
+        constants_.clear();
+        statements_.clear();
+        nary_args_.clear();
+        nary_partials_.clear();
+        blocks_.clear();
+        block_args_.clear();
+        guards_.clear();
+        touched_.clear();
+        all_touched_ = false;
+        lane_grads_.clear();
+        lanes_touched_.clear();
+        region_ranges_.clear();
+        open_regions_.clear();
+        clear_cse_table();
+
         // allocate a first dummy node
-        void * ptr = arena_.alloc(sizeof(IndNode<T>), alignof(IndNode<T>));
-        IndNode<T> * node_ptr = new (ptr) IndNode<T>{T{0.0}};
-        nodes_.emplace_back(node_ptr);
+        push_node(OpCode::Ind, 0, 0, T{0.0});
     }
 
-    // TODO: manage exceptions
-    ArenaAllocator<4096> arena_;
-    std::vector<Node<T>*> nodes_;
-};
+    /**
+     * The size of the Tape at a given time (see `mark` and `rewind`)
+     */
+    struct Mark {
+        // `clear` and `compact` invalidate the marks taken before them
+        size_t generation;
+        size_t n_nodes;
+        size_t n_constants;
+        size_t n_statements;
+        size_t n_nary_args;
+        size_t n_blocks;
+        size_t n_block_args;
+        size_t n_guards;
+        size_t n_regions;
+        ArenaAllocator::Mark arena;
+    };
 
-// [1] No need for std::launder because we are using
-//      the return value of placement new.
-//      source: https://youtu.be/5HXCbLilIzs?t=150
+    /**
+     * Returns the current size of the Tape: `rewind(mark())` removes every
+     * node recorded after the call to `mark`
+     */
+    Mark mark() const {
+        return Mark{
+            generation_, ops_.size(), constants_.size(), statements_.size(), nary_args_.size(),
+            blocks_.size(), block_args_.size(), guards_.size(), region_ranges_.size(),
+            arena_.mark()
+        };
+    }
 
-template <typename U>
-size_t new_node(U const & value) {
-    NodeManager<U> & manager = NodeManager<U>::instance();
+    /**
+     * Removes the nodes (and the guards) recorded after `mark` was taken,
+     * without releasing their memory: the nodes recorded before the mark
+     * (e.g. the parameters of a model) keep their indices and their values,
+     * while the memory of the others is reused by the next recording.
+     * The adjoints are reset (as by `clear_grad`).
+     *
+     * The Tape must not have been cleared (nor compacted) since `mark`
+     * was taken, and the regions opened after the mark must be closed:
+     * otherwise `std::logic_error` is thrown (see `can_rewind`).
+     *
+     * @param mark A mark of this Tape
+     */
+    void rewind(Mark const & mark) {
+        if(mark.generation != generation_) {
+            throw std::logic_error("rewind: the Tape was cleared or compacted after the mark");
+        }
+        if(!within(mark)) {
+            throw std::logic_error("rewind: the mark is past the end of the Tape");
+        }
+        if(!open_regions_.empty() && open_regions_.back() >= mark.n_regions) {
+            throw std::logic_error("rewind: a region opened after the mark is still open");
+        }
+        clear_grad();
+        peak_size_ = std::max(peak_size_, ops_.size());
+        start_recording();
 
-    void * ptr =
-        manager.arena_.alloc(sizeof(IndNode<U>), alignof(IndNode<U>));
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for(size_t b = mark.n_blocks; b < blocks_.size(); ++b) {
+                std::destroy_n(blocks_[b].operands, blocks_[b].n_args);
+            }
+        }
+        arena_.rewind(mark.arena);
 
-    // see [1]
-    IndNode<U> * node_ptr = new (ptr) IndNode<U>{value};
+        // keeps the capacity of the columns
+        ops_.resize(mark.n_nodes);
+        first_.resize(mark.n_nodes);
+        second_.resize(mark.n_nodes);
+        values_.resize(mark.n_nodes);
+        grads_.resize(mark.n_nodes);
+        constants_.resize(mark.n_constants);
+        statements_.resize(mark.n_statements);
+        nary_args_.resize(mark.n_nary_args);
+        nary_partials_.resize(mark.n_nary_args);
+        blocks_.resize(mark.n_blocks);
+        block_args_.resize(mark.n_block_args);
+        guards_.resize(mark.n_guards);
+        lane_grads_.clear();
+        n_lanes_ = 0;
+        lanes_touched_.clear();
+        region_ranges_.resize(mark.n_regions);
+        for(auto & range: region_ranges_) {
+            range.end = std::min<NodeIdx>(range.end, static_cast<NodeIdx>(mark.n_nodes));
+        }
 
-    manager.nodes_.emplace_back(node_ptr);
+        if(hash_consing_) {
+            rebuild_cse_table();
+        }
+    }
 
-    return manager.nodes_.size()-1;
-}
+    /**
+     * Returns whether `rewind(mark)` can be called, i.e. whether it
+     * wouldn't throw
+     */
+    bool can_rewind(Mark const & mark) const {
+        return mark.generation == generation_ && within(mark)
+            && (open_regions_.empty() || open_regions_.back() < mark.n_regions);
+    }
 
-template <template <typename> class NodeType, typename U>
-size_t new_node(size_t first) {
-    NodeManager<U> & manager = NodeManager<U>::instance();
+    /**
+     * Resets the Tape and returns the memory used by its columns
+     * and by its arena
+     */
+    void release() {
+        clear();
+        for_each_column(*this, [](auto & column) {
+            column.shrink_to_fit();
+        });
+        arena_.release();
+    }
+
+    /**
+     * Returns the memory which is not needed to record `n_nodes` nodes
+     * (e.g. the `high_water_mark`) without reallocating the node columns.
+     * The arena keeps enough memory for its own high water mark.
+     */
+    void shrink_to(size_t n_nodes) {
+        n_nodes = std::max(n_nodes, ops_.size());
+        shrink_column(ops_, n_nodes);
+        shrink_column(first_, n_nodes);
+        shrink_column(second_, n_nodes);
+        shrink_column(values_, n_nodes);
+        shrink_column(grads_, n_nodes);
+        arena_.shrink_to(arena_.high_water_mark());
+    }
 
-    void * ptr =
-        manager.arena_.alloc(sizeof(NodeType<U>), alignof(NodeType<U>));
+    /**
+     * Returns the maximum number of nodes the Tape has held
+     * (across `clear`(s))
+     */
+    size_t high_water_mark() const {
+        return std::max(peak_size_, ops_.size());
+    }
 
-    // see [1]
-    NodeType<U> * node_ptr = new (ptr) NodeType<U>{
-        manager.nodes_[first]
-    };
+    // *********** Instrumentation ***********
+    /**
+     * Enables (or disables) the collection of the times reported by
+     * `stats`. The other counters are always available.
+     */
+    void instrument(bool enabled = true) {
+        instrumented_ = enabled;
+        start_recording();
+    }
 
-    manager.nodes_.emplace_back(node_ptr);
+    /**
+     * Returns the size and the composition of the Tape, its memory usage
+     * and the activity since its creation (or since `reset_stats`)
+     */
+    TapeStats stats() const {
+        TapeStats stats;
+        stats.n_nodes = ops_.size();
+        stats.peak_nodes = high_water_mark();
+        for(OpCode op: ops_) {
+            ++stats.nodes_by_type[static_cast<size_t>(op)];
+        }
+        stats.n_guards = guards_.size();
 
-    return manager.nodes_.size()-1;
-}
+        for_each_column(*this, [&](auto const & column) {
+            using Value = typename std::remove_cvref_t<decltype(column)>::value_type;
+            stats.columns_used += column.size() * sizeof(Value);
+            stats.columns_reserved += column.capacity() * sizeof(Value);
+        });
+        stats.arena_used = arena_.used_size();
+        stats.arena_reserved = arena_.total_size();
+        stats.arena_high_water_mark = arena_.high_water_mark();
+        stats.arena_blocks_allocated = arena_.n_blocks_allocated();
+        stats.arena_blocks_reused = arena_.n_blocks_reused();
 
-template <template <typename> class NodeType, typename U>
-size_t new_node(size_t first, size_t second) {
-    NodeManager<U> & manager = NodeManager<U>::instance();
+        stats.n_clears = n_clears_;
+        stats.n_backward = n_backward_;
+        stats.n_replays = n_replays_;
+        stats.n_cse_hits = n_cse_hits_;
+        stats.recording_time = recording_time_;
+        stats.backward_time = backward_time_;
+        stats.replay_time = replay_time_;
+        return stats;
+    }
 
-    void * ptr =
-        manager.arena_.alloc(sizeof(NodeType<U>), alignof(NodeType<U>));
+    /**
+     * Resets the activity counters reported by `stats`
+     */
+    void reset_stats() {
+        n_clears_ = n_backward_ = n_replays_ = n_cse_hits_ = 0;
+        recording_time_ = backward_time_ = replay_time_ = 0.0;
+        start_recording();
+    }
 
-    // see [1]
-    NodeType<U> * node_ptr = new (ptr) NodeType<U>{
-        manager.nodes_[first],
-        manager.nodes_[second]
-    };
+    // *********** Hash-consing ***********
+    /**
+     * Enables (or disables) hash-consing: while enabled, recording a node
+     * equal to a node already in the Tape (same type, same arguments and
+     * same constants) returns the index of the existing node instead of
+     * appending a new one, i.e. the common subexpressions are recorded
+     * only once. Both the elementary nodes and the `StatementNode`(s) are
+     * looked up (the latter by expression type, arguments and constants);
+     * leaves and `BlockNode`(s) are always appended.
+     *
+     * Since the nodes only depend on their arguments, sharing them doesn't
+     * change any value nor any derivative, while it makes the Tape (and
+     * every sweep over it) shorter when the recorded code repeats terms.
+     * The lookup costs a hash and a probe of an open-addressing table
+     * per recorded node.
+     */
+    void hash_consing(bool enabled = true) {
+        if(enabled && !hash_consing_) {
+            // the nodes recorded so far become visible to the lookups
+            rebuild_cse_table();
+        }
+        hash_consing_ = enabled;
+    }
+
+    // *********** Profiling ***********
+    /**
+     * Enables (or disables) the backward profiler: while enabled, every
+     * node visited by a backward pass is timed and its time is attributed
+     * to its type and to its region (see `ProfileRegion`).
+     *
+     * Reading the clock once per node makes the backward passes
+     * considerably slower, hence the profiler is meant for diagnosis only.
+     */
+    void profile(bool enabled = true) {
+        profiling_ = enabled;
+    }
+
+    /**
+     * Returns the profile of the backward passes since the profiler was
+     * enabled (or since `reset_profile`)
+     */
+    BackwardProfile const & backward_profile() const {
+        return profile_;
+    }
+
+    /**
+     * Resets the counters of the backward profiler (the regions of the
+     * Tape are kept)
+     */
+    void reset_profile() {
+        profile_.n_sweeps = 0;
+        profile_.calls.fill(0);
+        profile_.time.fill(0.0);
+        for(auto & region: profile_.regions) {
+            region.calls = 0;
+            region.time = 0.0;
+        }
+    }
+
+    /**
+     * Starts a labelled region: the nodes recorded until the matching
+     * `end_region` belong to it. Regions can be nested and
+     * the same label can be used for multiple regions.
+     *
+     * @return The slot of the region (see `is_innermost_region`)
+     */
+    size_t begin_region(std::string const & name) {
+        auto it = std::find_if(profile_.regions.begin(), profile_.regions.end(), [&](auto const & region) {
+            return region.name == name;
+        });
+        size_t id = it - profile_.regions.begin();
+        if(it == profile_.regions.end()) {
+            profile_.regions.push_back({name});
+        }
+        open_regions_.push_back(region_ranges_.size());
+        region_ranges_.push_back({
+            static_cast<NodeIdx>(ops_.size()), NO_REGION, static_cast<NodeIdx>(id)
+        });
+        return open_regions_.back();
+    }
+
+    /**
+     * Ends the innermost open region
+     */
+    void end_region() {
+        if(open_regions_.empty()) {
+            throw std::logic_error("end_region without a matching begin_region");
+        }
+        region_ranges_[open_regions_.back()].end = static_cast<NodeIdx>(ops_.size());
+        open_regions_.pop_back();
+    }
+
+    /**
+     * Returns whether the region in `slot` (see `begin_region`) is the
+     * innermost open region: `clear` closes every region
+     */
+    bool is_innermost_region(size_t slot) const {
+        return !open_regions_.empty() && open_regions_.back() == slot;
+    }
+
+    /**
+     * Returns the arena of the Tape
+     */
+    ArenaAllocator const & arena() const {
+        return arena_;
+    }
+
+    /**
+     * Reserves space for `n_nodes` nodes in each column of the Tape
+     */
+    void reserve(size_t n_nodes) {
+        ops_.reserve(n_nodes);
+        first_.reserve(n_nodes);
+        second_.reserve(n_nodes);
+        values_.reserve(n_nodes);
+        grads_.reserve(n_nodes);
+    }
+
+    /**
+     * Returns the number of nodes in the Tape
+     */
+    size_t size() const {
+        return ops_.size();
+    }
+
+    /**
+     * Returns the number of leaves (`IndNode`(s)) in the Tape,
+     * the dummy first node excluded
+     */
+    size_t n_leaves() const {
+        if(ops_.empty()) {
+            return 0;
+        }
+        return std::count(ops_.begin() + 1, ops_.end(), OpCode::Ind);
+    }
+
+private:
+    /**
+     * Returns a reference to the pointer to the active Tape of the
+     * calling thread. Each thread starts with its own default Tape.
+     */
+    static NodeManager*& active() {
+        thread_local NodeManager default_tape;
+        thread_local NodeManager * active_tape = &default_tape;
+        return active_tape;
+    }
+
+    /**
+     * Appends a node to the Tape and returns its index
+     */
+    size_t push_node(OpCode op, NodeIdx first, NodeIdx second, T const & value) {
+        ops_.push_back(op);
+        first_.push_back(first);
+        second_.push_back(second);
+        values_.push_back(value);
+        grads_.push_back(T{0.0});
+
+        return ops_.size()-1;
+    }
+
+    /**
+     * Empties the hash-consing table
+     */
+    void clear_cse_table() {
+        std::fill(cse_slots_.begin(), cse_slots_.end(), 0);
+        cse_size_ = 0;
+    }
+
+    /**
+     * Returns whether every column of the Tape is at least as long as at the
+     * time `mark` was taken, so that `rewind` only shrinks them
+     */
+    bool within(Mark const & mark) const {
+        return mark.n_nodes <= ops_.size() && mark.n_constants <= constants_.size()
+            && mark.n_statements <= statements_.size() && mark.n_nary_args <= nary_args_.size()
+            && mark.n_blocks <= blocks_.size() && mark.n_block_args <= block_args_.size()
+            && mark.n_guards <= guards_.size() && mark.n_regions <= region_ranges_.size();
+    }
+
+    /**
+     * Rebuilds the hash-consing table from the nodes of the Tape (growing it
+     * if needed). A node equal to a previous one (e.g. in a Tape recorded
+     * without hash-consing) is not inserted: lookups return the first one.
+     */
+    void rebuild_cse_table() {
+        size_t n_slots = std::max<size_t>(cse_slots_.size(), 1024);
+        while(n_slots < 4 * ops_.size()) {
+            n_slots *= 2;
+        }
+        cse_slots_.assign(n_slots, 0);
+        cse_size_ = 0;
+
+        size_t mask = n_slots - 1;
+        for(size_t i = 1; i < ops_.size(); ++i) {
+            OpCode op = ops_[i];
+            if(op == OpCode::Ind || op == OpCode::Block || op == OpCode::Output) {
+                continue;
+            }
+            size_t slot = cse_hash(i) & mask;
+            bool duplicate = false;
+            while(cse_slots_[slot] != 0 && !duplicate) {
+                duplicate = cse_equal(i, cse_slots_[slot]);
+                slot = (slot + 1) & mask;
+            }
+            if(!duplicate) {
+                cse_slots_[slot] = static_cast<NodeIdx>(i);
+                ++cse_size_;
+            }
+        }
+    }
+
+    /**
+     * If hash-consing is enabled and the last node of the Tape (`i`) is
+     * equal to an existing node, removes it and returns the index of the
+     * existing node. Otherwise returns `i`.
+     */
+    size_t intern(size_t i) {
+        if(!hash_consing_) {
+            return i;
+        }
+
+        size_t mask = cse_slots_.size() - 1;
+        for(size_t slot = cse_hash(i) & mask;; slot = (slot + 1) & mask) {
+            NodeIdx j = cse_slots_[slot];
+            if(j == 0) {
+                cse_slots_[slot] = static_cast<NodeIdx>(i);
+                if(2 * ++cse_size_ > cse_slots_.size()) {
+                    rebuild_cse_table();
+                }
+                return i;
+            }
+            if(cse_equal(i, j)) {
+                pop_node();
+                ++n_cse_hits_;
+                return j;
+            }
+        }
+    }
+
+    /**
+     * Removes the last node of the Tape (along with its constants
+     * and its statement)
+     */
+    void pop_node() {
+        visit_node<T>(ops_.back(), [&]<typename NodeType>() {
+            if constexpr (NodeType::opcode == OpCode::Statement) {
+                Statement const & statement = statements_.back();
+                nary_args_.resize(statement.args);
+                nary_partials_.resize(statement.args);
+                constants_.resize(statement.constants);
+                statements_.pop_back();
+            } else if constexpr (NodeType::arity == 1 && NodeType::with_constant) {
+                constants_.pop_back();
+            }
+        });
+        ops_.pop_back();
+        first_.pop_back();
+        second_.pop_back();
+        values_.pop_back();
+        grads_.pop_back();
+    }
+
+    static size_t hash_combine(size_t h, size_t v) {
+        return (h ^ v) * 0x9E3779B97F4A7C15ull + (h >> 29);
+    }
+
+    /**
+     * Hashes the type and the arguments of the i-th node (the constants
+     * are only compared, see `cse_equal`)
+     */
+    size_t cse_hash(size_t i) const {
+        size_t h = hash_combine(0, static_cast<size_t>(ops_[i]));
+        if(ops_[i] == OpCode::Statement) {
+            Statement const & statement = statements_[first_[i]];
+            h = hash_combine(h, reinterpret_cast<std::uintptr_t>(statement.eval));
+            for(NodeIdx k = 0; k < statement.n_args; ++k) {
+                h = hash_combine(h, nary_args_[statement.args + k]);
+            }
+            return hash_combine(h, statement.n_args);
+        }
+        visit_node<T>(ops_[i], [&]<typename NodeType>() {
+            if constexpr (NodeType::arity >= 1) {
+                h = hash_combine(h, first_[i]);
+            }
+            if constexpr (NodeType::arity >= 2) {
+                h = hash_combine(h, second_[i]);
+            }
+        });
+        return hash_combine(h, 0);
+    }
+
+    /**
+     * Returns `true` if the constants are the same (bitwise for
+     * floating point values: `0.0` and `-0.0` are different constants)
+     */
+    static bool same_constant(T const & a, T const & b) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return std::memcmp(&a, &b, sizeof(T)) == 0;
+        } else {
+            return a == b;
+        }
+    }
+
+    /**
+     * Returns `true` if the i-th and the j-th nodes compute the same
+     * function of the same arguments (`i` must be the last node)
+     */
+    bool cse_equal(size_t i, size_t j) const {
+        if(ops_[i] != ops_[j]) {
+            return false;
+        }
+        bool equal = true;
+        visit_node<T>(ops_[i], [&]<typename NodeType>() {
+            if constexpr (NodeType::opcode == OpCode::Statement) {
+                Statement const & a = statements_[first_[i]];
+                Statement const & b = statements_[first_[j]];
+                equal = a.eval == b.eval && a.n_args == b.n_args
+                    && std::equal(&nary_args_[a.args], &nary_args_[a.args] + a.n_args, &nary_args_[b.args]);
+                // the constants of the last statement are at the end of
+                //  `constants_`, and the same expression type has the same
+                //  number of constants
+                for(size_t k = a.constants; equal && k < constants_.size(); ++k) {
+                    equal = same_constant(constants_[k], constants_[b.constants + k - a.constants]);
+                }
+            } else if constexpr (NodeType::arity == 1 && NodeType::with_constant) {
+                equal = first_[i] == first_[j] && same_constant(constants_[second_[i]], constants_[second_[j]]);
+            } else if constexpr (NodeType::arity == 1) {
+                equal = first_[i] == first_[j];
+            } else if constexpr (NodeType::arity == 2) {
+                equal = first_[i] == first_[j] && second_[i] == second_[j];
+            } else {
+                equal = false;
+            }
+        });
+        return equal;
+    }
+
+    /**
+     * Calls `f` on each column of the Tape (i.e. on every container whose
+     * size depends on the recorded function)
+     */
+    template <typename Self, typename F>
+    static void for_each_column(Self & self, F && f) {
+        f(self.ops_); f(self.first_); f(self.second_); f(self.values_); f(self.grads_);
+        f(self.constants_); f(self.statements_); f(self.nary_args_); f(self.nary_partials_);
+        f(self.blocks_); f(self.block_args_); f(self.block_grads_); f(self.block_output_grads_);
+        f(self.guards_); f(self.touched_); f(self.lane_grads_); f(self.lanes_touched_);
+        f(self.marks_); f(self.cone_); f(self.hessian_pos_); f(self.hessian_W_); f(self.region_ranges_); f(self.node_regions_);
+        f(self.depths_); f(self.schedule_.nodes); f(self.schedule_.levels); f(self.cse_slots_);
+        f(self.batch_values_); f(self.batch_grads_); f(self.batch_partials_); f(self.batch_scratch_);
+        f(self.batch_iota_); f(self.batch_roots_); f(self.batch_cone_);
+    }
+
+    /**
+     * Starts measuring the time spent recording the Tape
+     */
+    void start_recording() {
+        recording_ = true;
+        if(instrumented_) {
+            recording_start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    /**
+     * Stops measuring the time spent recording the Tape (at the first
+     * sweep over the Tape after a `clear`)
+     */
+    void end_recording() {
+        if(recording_ && instrumented_) {
+            auto elapsed = std::chrono::steady_clock::now() - recording_start_;
+            recording_time_ += std::chrono::duration<double>(elapsed).count();
+        }
+        recording_ = false;
+    }
+
+    /**
+     * Reduces the capacity of `column` to (at most) `n` elements
+     */
+    template <typename Column>
+    static void shrink_column(Column & column, size_t n) {
+        if(column.capacity() > n) {
+            Column tmp;
+            tmp.reserve(n);
+            tmp.assign(column.begin(), column.end());
+            column.swap(tmp);
+        }
+    }
+
+    /**
+     * Destroys the operands of the `BlockNode`(s), which live in the arena
+     */
+    void destroy_operands() {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for(auto const & block: blocks_) {
+                std::destroy_n(block.operands, block.n_args);
+            }
+        }
+    }
+
+    /**
+     * Writes the arguments of the i-th node along with its local partials
+     * and its local second partials (row-major)
+     */
+    void local_derivatives(size_t i, std::vector<NodeIdx> & args, std::vector<T> & d, std::vector<T> & d2) const {
+        visit_node<T>(ops_[i], [&]<typename NodeType>() {
+            if constexpr (NodeType::opcode == OpCode::Block || NodeType::opcode == OpCode::Output) {
+                throw std::logic_error("hessian: BlockNode(s) are not supported");
+
+            } else if constexpr (NodeType::opcode == OpCode::Statement) {
+                Statement const & statement = statements_[first_[i]];
+                if(!statement.hessian) {
+                    throw std::logic_error("hessian: the Tape has statements without second derivatives");
+                }
+                NodeIdx const * first = &nary_args_[statement.args];
+                args.assign(first, first + statement.n_args);
+                T const * partials = &nary_partials_[statement.args];
+                d.assign(partials, partials + statement.n_args);
+                d2.resize(statement.n_args * statement.n_args);
+                statement.hessian(values_.data(), first, &constants_[statement.constants], d2.data());
+
+            } else if constexpr (NodeType::arity == 1) {
+                args.assign(1, first_[i]);
+                d.assign(1, unary_partial<NodeType>(i));
+                if constexpr (NodeType::with_constant) {
+                    d2.assign(1, NodeType::second_partial(values_[i], values_[first_[i]], constants_[second_[i]]));
+                } else {
+                    d2.assign(1, NodeType::second_partial(values_[i], values_[first_[i]]));
+                }
+
+            } else if constexpr (NodeType::arity == 2) {
+                args.assign({first_[i], second_[i]});
+                d.resize(2);
+                d2.resize(4);
+                T const & first = values_[first_[i]];
+                T const & second = values_[second_[i]];
+                NodeType::partials(values_[i], first, second, d[0], d[1]);
+                NodeType::second_partials(values_[i], first, second, d2[0], d2[1], d2[3]);
+                d2[2] = d2[1];
+
+            } else {
+                args.clear();
+                d.clear();
+                d2.clear();
+            }
+        });
+    }
+
+    /**
+     * Calls `f(arg)` on each argument of the i-th node
+     * (the argument of an `OutputNode` is its `BlockNode`)
+     */
+    template <typename F>
+    void for_each_arg(size_t i, F && f) const {
+        for_each_arg(*this, i, f);
+    }
+
+    /**
+     * Same as above, but `f` can modify the arguments (it receives
+     * a `NodeIdx &`)
+     */
+    template <typename F>
+    void for_each_arg(size_t i, F && f) {
+        for_each_arg(*this, i, f);
+    }
+
+    template <typename Self, typename F>
+    static void for_each_arg(Self & self, size_t i, F & f) {
+        visit_node<T>(self.ops_[i], [&]<typename NodeType>() {
+            if constexpr (NodeType::opcode == OpCode::Statement) {
+                auto const & statement = self.statements_[self.first_[i]];
+                for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                    f(self.nary_args_[statement.args + j]);
+                }
+            } else if constexpr (NodeType::opcode == OpCode::Block) {
+                auto const & block = self.blocks_[self.first_[i]];
+                for(NodeIdx j = 0; j < block.n_args; ++j) {
+                    f(self.block_args_[block.args + j]);
+                }
+            } else if constexpr (NodeType::opcode == OpCode::Output) {
+                f(self.first_[i]);
+            }
+            if constexpr (NodeType::arity >= 1) {
+                f(self.first_[i]);
+            }
+            if constexpr (NodeType::arity >= 2) {
+                f(self.second_[i]);
+            }
+        });
+    }
+
+    /**
+     * Calls `visit(i)` on each node of `cone`, timing each call
+     * if the profiler is enabled
+     */
+    template <typename F>
+    void sweep(Cone const & cone, F && visit) {
+        if(!profiling_) [[likely]] {
+            for(NodeIdx i: cone) {
+                visit(i);
+            }
+            return;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        map_regions();
+        ++profile_.n_sweeps;
+
+        auto last = Clock::now();
+        for(NodeIdx i: cone) {
+            visit(i);
+            auto now = Clock::now();
+            double elapsed = std::chrono::duration<double>(now - last).count();
+            last = now;
+
+            size_t op = static_cast<size_t>(ops_[i]);
+            ++profile_.calls[op];
+            profile_.time[op] += elapsed;
+            if(!node_regions_.empty() && node_regions_[i] != NO_REGION) {
+                auto & region = profile_.regions[node_regions_[i]];
+                ++region.calls;
+                region.time += elapsed;
+            }
+        }
+    }
+
+    /**
+     * Computes the innermost region of each node (if any)
+     */
+    void map_regions() {
+        node_regions_.clear();
+        if(region_ranges_.empty()) {
+            return;
+        }
+        node_regions_.assign(ops_.size(), NO_REGION);
+        // The ranges are sorted by begin, hence the inner ranges
+        //  overwrite the outer ones
+        for(auto const & range: region_ranges_) {
+            size_t end = std::min<size_t>(range.end, ops_.size());
+            std::fill(node_regions_.begin() + range.begin, node_regions_.begin() + end, range.region);
+        }
+    }
+
+    /**
+     * Keeps track of the adjoints touched by a backward pass
+     */
+    void touch(Cone const & cone) {
+        if(all_touched_) {
+            return;
+        }
+        if(touched_.size() + cone.size() > ops_.size()) {
+            // cheaper to reset everything
+            all_touched_ = true;
+            touched_.clear();
+            return;
+        }
+        touched_.insert(touched_.end(), cone.begin(), cone.end());
+    }
+
+    /**
+     * Returns the local partial of the i-th node, which must be a
+     * `UnaryNode` or a `ScalarNode`
+     */
+    template <typename NodeType>
+    T unary_partial(size_t i) const {
+        if constexpr (NodeType::with_constant) {
+            return NodeType::partial(values_[i], values_[first_[i]], constants_[second_[i]]);
+        } else {
+            return NodeType::partial(values_[i], values_[first_[i]]);
+        }
+    }
+
+    /**
+     * Propagates the adjoints of the nodes [begin, end) of a level of a
+     * `Schedule` in parallel (see `parallel_backward`). Floating point
+     * adjoints only
+     */
+    void parallel_level(std::ptrdiff_t begin, std::ptrdiff_t end, std::vector<NodeIdx> const & nodes) {
+        static_assert(std::is_floating_point_v<T>, "atomic updates need floating point adjoints");
+
+        bool has_blocks = false;
+        #pragma omp parallel for schedule(static) reduction(||: has_blocks)
+        for(std::ptrdiff_t k = begin; k < end; ++k) {
+            visit_node<T>(ops_[nodes[k]], [&]<typename NodeType>() {
+                if constexpr (NodeType::opcode == OpCode::Block) {
+                    has_blocks = true;
+                } else {
+                    propagate<NodeType, true>(nodes[k]);
+                }
+            });
+        }
+
+        // the kernels of the blocks share their buffers
+        for(std::ptrdiff_t k = begin; has_blocks && k < end; ++k) {
+            if(ops_[nodes[k]] == OpCode::Block) {
+                visit_node<T>(OpCode::Block, [&]<typename NodeType>() {
+                    propagate<NodeType>(nodes[k]);
+                });
+            }
+        }
+    }
+
+    /**
+     * `target += value`, performed atomically if `Atomic`
+     * (floating point values only)
+     */
+    template <bool Atomic>
+    static void accumulate(T & target, T value) {
+        if constexpr (Atomic) {
+            #pragma omp atomic
+            target += value;
+        } else {
+            target += value;
+        }
+    }
+
+    /**
+     * Applies the chain rule for the i-th node, i.e. updates the `grad`
+     * of its arguments given its own `grad`.
+     *
+     * @tparam Atomic Whether the updates must be atomic (see `parallel_backward`)
+     */
+    template <typename NodeType, bool Atomic = false>
+    void propagate(size_t i) {
+        if constexpr (NodeType::opcode == OpCode::Block) {
+            Block const & block = blocks_[first_[i]];
+            block_backward(i, &grads_[i+1]);
+            for(NodeIdx j = 0; j < block.n_args; ++j) {
+                grads_[block_args_[block.args + j]] += block_grads_[j];
+            }
+
+        } else if constexpr (NodeType::opcode == OpCode::Statement) {
+            Statement const & statement = statements_[first_[i]];
+            NodeIdx const * args = &nary_args_[statement.args];
+            T const * partials = &nary_partials_[statement.args];
+            for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                accumulate<Atomic>(grads_[args[j]], grads_[i] * partials[j]);
+            }
+
+        } else if constexpr (NodeType::arity == 1) {
+            NodeIdx first = first_[i];
+            accumulate<Atomic>(grads_[first], grads_[i] * unary_partial<NodeType>(i));
+
+        } else if constexpr (NodeType::arity == 2) {
+            NodeIdx first = first_[i];
+            NodeIdx second = second_[i];
+            T d_first, d_second;
+            NodeType::partials(values_[i], values_[first], values_[second], d_first, d_second);
+            accumulate<Atomic>(grads_[first], grads_[i] * d_first);
+            accumulate<Atomic>(grads_[second], grads_[i] * d_second);
+        }
+        // backward on a leaf node (or on an `OutputNode`, whose adjoint is
+        //  consumed by its `BlockNode`) does nothing
+    }
+
+    /**
+     * Vector-mode version of `propagate`: the local partials are computed
+     * once and applied to all the `K` lanes
+     */
+    template <typename NodeType, size_t K>
+    void propagate_lanes(size_t i) {
+        T const * grad = &lane_grads_[i*K];
+
+        if constexpr (NodeType::opcode == OpCode::Block) {
+            // one lane at a time: the kernels work on contiguous adjoints
+            Block const & block = blocks_[first_[i]];
+            block_output_grads_.resize(block.n_outputs);
+            for(size_t k = 0; k < K; ++k) {
+                for(NodeIdx j = 0; j < block.n_outputs; ++j) {
+                    block_output_grads_[j] = lane_grads_[(i+1+j)*K + k];
+                }
+                block_backward(i, block_output_grads_.data());
+                for(NodeIdx j = 0; j < block.n_args; ++j) {
+                    lane_grads_[block_args_[block.args + j]*K + k] += block_grads_[j];
+                }
+            }
+
+        } else if constexpr (NodeType::opcode == OpCode::Statement) {
+            Statement const & statement = statements_[first_[i]];
+            for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                T d_arg = nary_partials_[statement.args + j];
+                T * grad_arg = &lane_grads_[nary_args_[statement.args + j]*K];
+                #pragma omp simd
+                for(size_t k = 0; k < K; ++k) {
+                    grad_arg[k] += grad[k] * d_arg;
+                }
+            }
+
+        } else if constexpr (NodeType::arity == 1) {
+            NodeIdx first = first_[i];
+            T d_first = unary_partial<NodeType>(i);
+            T * grad_first = &lane_grads_[first*K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                grad_first[k] += grad[k] * d_first;
+            }
+
+        } else if constexpr (NodeType::arity == 2) {
+            NodeIdx first = first_[i];
+            NodeIdx second = second_[i];
+            T d_first, d_second;
+            NodeType::partials(values_[i], values_[first], values_[second], d_first, d_second);
+            T * grad_first = &lane_grads_[first*K];
+            T * grad_second = &lane_grads_[second*K];
+            // Note: first and second may be the same node (e.g. x*x)
+            //  => two separate loops
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                grad_first[k] += grad[k] * d_first;
+            }
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                grad_second[k] += grad[k] * d_second;
+            }
+        }
+    }
+
+    /**
+     * Batched version of `evaluate`: recomputes the `K` lanes of the i-th
+     * node (see `batch_gradient`)
+     */
+    template <typename NodeType, size_t K>
+    void evaluate_lanes(size_t i) {
+        if constexpr (NodeType::opcode == OpCode::Block) {
+            Block const & block = blocks_[first_[i]];
+            batch_scratch_.resize(block.n_outputs);
+            for(size_t k = 0; k < K; ++k) {
+                for(NodeIdx j = 0; j < block.n_args; ++j) {
+                    block.operands[j] = batch_values_[block_args_[block.args + j]*K + k];
+                }
+                block.forward(block.dims.data(), block.operands, batch_scratch_.data());
+                for(NodeIdx j = 0; j < block.n_outputs; ++j) {
+                    batch_values_[(i+1+j)*K + k] = batch_scratch_[j];
+                }
+            }
+
+        } else if constexpr (NodeType::opcode == OpCode::Statement) {
+            // the statement reads its arguments from a contiguous copy
+            //  (the arguments of the copy are 0, 1, ...)
+            Statement const & statement = statements_[first_[i]];
+            if(!statement.eval) [[unlikely]] {
+                throw std::logic_error("the statements of a loaded Tape cannot be replayed");
+            }
+            if(batch_iota_.size() < statement.n_args) {
+                size_t n = batch_iota_.size();
+                batch_iota_.resize(statement.n_args);
+                for(; n < batch_iota_.size(); ++n) {
+                    batch_iota_[n] = static_cast<NodeIdx>(n);
+                }
+            }
+            batch_scratch_.resize(2 * statement.n_args);
+            T * args = batch_scratch_.data();
+            T * partials = args + statement.n_args;
+            T * value = &batch_values_[i*K];
+            for(size_t k = 0; k < K; ++k) {
+                for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                    args[j] = batch_values_[nary_args_[statement.args + j]*K + k];
+                }
+                statement.eval(args, batch_iota_.data(), constants_.data() + statement.constants, value[k], partials);
+                for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                    batch_partials_[(statement.args + j)*K + k] = partials[j];
+                }
+            }
+
+        } else if constexpr (NodeType::arity == 1 && NodeType::with_constant) {
+            T const * first = &batch_values_[first_[i]*K];
+            T const constant = constants_[second_[i]];
+            T * value = &batch_values_[i*K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                value[k] = NodeType::forward(first[k], constant);
+            }
+
+        } else if constexpr (NodeType::arity == 1) {
+            T const * first = &batch_values_[first_[i]*K];
+            T * value = &batch_values_[i*K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                value[k] = NodeType::forward(first[k]);
+            }
+
+        } else if constexpr (NodeType::arity == 2) {
+            T const * first = &batch_values_[first_[i]*K];
+            T const * second = &batch_values_[second_[i]*K];
+            T * value = &batch_values_[i*K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                value[k] = NodeType::forward(first[k], second[k]);
+            }
+        }
+        // leaves keep their values
+    }
+
+    /**
+     * Batched version of `propagate`: the local partials are computed
+     * lane by lane, from the values of the lanes (see `batch_gradient`)
+     */
+    template <typename NodeType, size_t K>
+    void propagate_batch(size_t i) {
+        T const * grad = &batch_grads_[i*K];
+
+        if constexpr (NodeType::opcode == OpCode::Block) {
+            Block const & block = blocks_[first_[i]];
+            batch_scratch_.resize(block.n_outputs);
+            block_output_grads_.resize(block.n_outputs);
+            for(size_t k = 0; k < K; ++k) {
+                for(NodeIdx j = 0; j < block.n_args; ++j) {
+                    block.operands[j] = batch_values_[block_args_[block.args + j]*K + k];
+                }
+                for(NodeIdx j = 0; j < block.n_outputs; ++j) {
+                    batch_scratch_[j] = batch_values_[(i+1+j)*K + k];
+                    block_output_grads_[j] = batch_grads_[(i+1+j)*K + k];
+                }
+                block_grads_.assign(block.n_args, T{0.0});
+                block.backward(
+                    block.dims.data(), block.operands, batch_scratch_.data(),
+                    block_output_grads_.data(), block_grads_.data()
+                );
+                for(NodeIdx j = 0; j < block.n_args; ++j) {
+                    batch_grads_[block_args_[block.args + j]*K + k] += block_grads_[j];
+                }
+            }
+
+        } else if constexpr (NodeType::opcode == OpCode::Statement) {
+            Statement const & statement = statements_[first_[i]];
+            for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                T const * d_arg = &batch_partials_[(statement.args + j)*K];
+                T * grad_arg = &batch_grads_[nary_args_[statement.args + j]*K];
+                #pragma omp simd
+                for(size_t k = 0; k < K; ++k) {
+                    grad_arg[k] += grad[k] * d_arg[k];
+                }
+            }
+
+        } else if constexpr (NodeType::arity == 1) {
+            T const * value = &batch_values_[i*K];
+            T const * first = &batch_values_[first_[i]*K];
+            T * grad_first = &batch_grads_[first_[i]*K];
+            if constexpr (NodeType::with_constant) {
+                T const constant = constants_[second_[i]];
+                #pragma omp simd
+                for(size_t k = 0; k < K; ++k) {
+                    grad_first[k] += grad[k] * NodeType::partial(value[k], first[k], constant);
+                }
+            } else {
+                #pragma omp simd
+                for(size_t k = 0; k < K; ++k) {
+                    grad_first[k] += grad[k] * NodeType::partial(value[k], first[k]);
+                }
+            }
+
+        } else if constexpr (NodeType::arity == 2) {
+            T const * value = &batch_values_[i*K];
+            T const * first = &batch_values_[first_[i]*K];
+            T const * second = &batch_values_[second_[i]*K];
+            T d_first[K], d_second[K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                NodeType::partials(value[k], first[k], second[k], d_first[k], d_second[k]);
+            }
+            // first and second may be the same node (e.g. x*x)
+            T * grad_first = &batch_grads_[first_[i]*K];
+            T * grad_second = &batch_grads_[second_[i]*K];
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                grad_first[k] += grad[k] * d_first[k];
+            }
+            #pragma omp simd
+            for(size_t k = 0; k < K; ++k) {
+                grad_second[k] += grad[k] * d_second[k];
+            }
+        }
+    }
+
+    /**
+     * Recomputes the value of the i-th node from the values of its arguments
+     */
+    template <typename NodeType>
+    void evaluate(size_t i) {
+        if constexpr (NodeType::opcode == OpCode::Block) {
+            // the outputs are the nodes that follow the block
+            Block const & block = blocks_[first_[i]];
+            for(NodeIdx j = 0; j < block.n_args; ++j) {
+                block.operands[j] = values_[block_args_[block.args + j]];
+            }
+            block.forward(block.dims.data(), block.operands, &values_[i+1]);
+
+        } else if constexpr (NodeType::opcode == OpCode::Statement) {
+            // the local partials are recomputed as well
+            Statement const & statement = statements_[first_[i]];
+            if(!statement.eval) [[unlikely]] {
+                throw std::logic_error("the statements of a loaded Tape cannot be replayed");
+            }
+            statement.eval(
+                values_.data(), &nary_args_[statement.args], constants_.data() + statement.constants,
+                values_[i], &nary_partials_[statement.args]
+            );
+
+        } else if constexpr (NodeType::arity == 1 && NodeType::with_constant) {
+            values_[i] = NodeType::forward(values_[first_[i]], constants_[second_[i]]);
+
+        } else if constexpr (NodeType::arity == 1) {
+            values_[i] = NodeType::forward(values_[first_[i]]);
+
+        } else if constexpr (NodeType::arity == 2) {
+            values_[i] = NodeType::forward(values_[first_[i]], values_[second_[i]]);
+        }
+        // leaves keep their value
+    }
+
+    /**
+     * Runs the backward kernel of the `BlockNode` `i` given the adjoints of
+     * its outputs. The adjoints of the operands are left in `block_grads_`
+     */
+    void block_backward(size_t i, T const * output_grads) {
+        Block const & block = blocks_[first_[i]];
+        block_grads_.assign(block.n_args, T{0.0});
+        block.backward(
+            block.dims.data(), block.operands, &values_[i+1],
+            output_grads, block_grads_.data()
+        );
+    }
+
+    static bool eval_cmp(CmpOp op, T const & lhs, T const & rhs) {
+        switch(op) {
+            case CmpOp::Lt: return lhs < rhs;
+            case CmpOp::Gt: return lhs > rhs;
+            case CmpOp::Eq: return lhs == rhs;
+            case CmpOp::Ne: return lhs != rhs;
+            case CmpOp::Le: return lhs <= rhs;
+            case CmpOp::Ge: return lhs >= rhs;
+        }
+        return false;
+    }
+
+    /**
+     * The arguments of a `StatementNode`, referenced by `first_`
+     */
+    struct Statement {
+        NodeIdx args;       // offset in `nary_args_` and `nary_partials_`
+        NodeIdx n_args;
+        NodeIdx constants;  // offset in `constants_`
+        StatementFn eval;
+        StatementHessianFn hessian;  // null for Tapes of non floating point values
+    };
+
+    /**
+     * The arguments and the kernels of a `BlockNode`, referenced by `first_`
+     */
+    struct Block {
+        NodeIdx args;       // offset in `block_args_`
+        NodeIdx n_args;
+        NodeIdx n_outputs;
+        std::array<NodeIdx, 3> dims;
+        T * operands;       // contiguous copy of the values of the args (in `arena_`)
+        BlockForward forward;
+        BlockBackward backward;
+    };
+
+    /**
+     * A recorded comparison (see `CmpOp`)
+     */
+    struct Guard {
+        CmpOp op;
+        bool result;
+        bool rhs_is_constant;
+        NodeIdx lhs;
+        NodeIdx rhs;
+        T constant;
+    };
+
+    std::vector<OpCode> ops_;
+    std::vector<NodeIdx> first_;
+    std::vector<NodeIdx> second_;
+    std::vector<T> values_;
+    std::vector<T> grads_;
+
+    // Constant operands of the `ScalarNode`(s), referenced by `second_`
+    std::vector<T> constants_;
+
+    // Arguments and local partials of the `StatementNode`(s)
+    std::vector<Statement> statements_;
+    std::vector<NodeIdx> nary_args_;
+    std::vector<T> nary_partials_;
+
+    // Arguments of the `BlockNode`(s)
+    std::vector<Block> blocks_;
+    std::vector<NodeIdx> block_args_;
+    // Memory for the operands of the `BlockNode`(s)
+    ArenaAllocator arena_;
+    // Maximum size of the Tape before a `clear`
+    size_t peak_size_ = 0;
+    // Incremented by `clear` and `compact` (see `Mark`), never reset
+    size_t generation_ = 0;
+
+    // Instrumentation (see `stats`)
+    bool instrumented_ = false;
+    bool recording_ = true;
+    std::chrono::steady_clock::time_point recording_start_;
+    size_t n_clears_ = 0;
+    size_t n_backward_ = 0;
+    size_t n_replays_ = 0;
+    double recording_time_ = 0.0;
+    double backward_time_ = 0.0;
+    double replay_time_ = 0.0;
+    // Scratch space for the backward pass of the `BlockNode`(s)
+    std::vector<T> block_grads_;
+    std::vector<T> block_output_grads_;
+
+    std::vector<Guard> guards_;
+
+    /**
+     * The nodes in [begin, end) belong to the region `region`
+     * (an index in `profile_.regions`)
+     */
+    struct RegionRange {
+        NodeIdx begin;
+        NodeIdx end;
+        NodeIdx region;
+    };
+    static constexpr NodeIdx NO_REGION = static_cast<NodeIdx>(-1);
+
+    // Backward profiler (see `profile`)
+    bool profiling_ = false;
+    BackwardProfile profile_;
+    std::vector<RegionRange> region_ranges_;
+    std::vector<size_t> open_regions_;
+    std::vector<NodeIdx> node_regions_;
+
+    // Adjoints touched since the last `clear_grad`
+    std::vector<NodeIdx> touched_;
+    bool all_touched_ = false;
+
+    // Adjoints of the vector-mode backward pass (node-major: K lanes per node)
+    std::vector<T> lane_grads_;
+    size_t n_lanes_ = 0;
+    std::vector<NodeIdx> lanes_touched_;
+
+    // Scratch space for `cone`
+    std::vector<std::uint8_t> marks_;
+    Cone cone_;
+    // Scratch space for `hessian`: the position of each node in the cone
+    //  and the interactions of the nodes of the cone
+    std::vector<NodeIdx> hessian_pos_;
+    std::vector<std::unordered_map<NodeIdx, T>> hessian_W_;
+    // Hash-consing (see `hash_consing`): open-addressing table of node
+    //  indices (0, the dummy node, marks an empty slot)
+    bool hash_consing_ = false;
+    std::vector<NodeIdx> cse_slots_;
+    size_t cse_size_ = 0;
+    size_t n_cse_hits_ = 0;
+
+    // Scratch buffers of `schedule` and `parallel_backward`
+    std::vector<NodeIdx> depths_;
+    Schedule schedule_;
+
+    // Lanes of `batch_gradient` (node-major: K lanes per node, and K lanes
+    //  per partial of the statements) and its scratch buffers
+    std::vector<T> batch_values_;
+    std::vector<T> batch_grads_;
+    std::vector<T> batch_partials_;
+    std::vector<T> batch_scratch_;
+    std::vector<NodeIdx> batch_iota_;
+    std::vector<size_t> batch_roots_;
+    Cone batch_cone_;
+};
+
+/**
+ * Explicit handle to a Tape
+ */
+template <typename T>
+using Tape = NodeManager<T>;
+
+/**
+ * @class ActiveTape
+ * @brief RAII object that makes a Tape the active one for the calling
+ * thread for the duration of its lifetime
+ * @tparam T The type of the underlying variables
+ *
+ * EXAMPLE:
+ *     Tape<double> tape;
+ *     {
+ *         ActiveTape<double> active(tape);
+ *         Var<double> x = 1.0;     // recorded in `tape`
+ *         ...
+ *     }
+ *     // the previously active Tape is restored here
+ */
+template <typename T>
+class ActiveTape {
+public:
+    ActiveTape(ActiveTape const &) = delete;
+    ActiveTape& operator=(ActiveTape const &) = delete;
+
+    explicit ActiveTape(Tape<T> & tape):
+        previous_{NodeManager<T>::active()}
+    {
+        NodeManager<T>::active() = &tape;
+    }
+
+    ~ActiveTape() {
+        NodeManager<T>::active() = previous_;
+    }
+
+private:
+    NodeManager<T> * previous_;
+};
+
+/**
+ * @class TapeScope
+ * @brief RAII object that rewinds a Tape to the size it had when the
+ * scope was opened (see `NodeManager::mark` and `NodeManager::rewind`)
+ * @tparam T The type of the underlying variables
+ *
+ * The nodes recorded before the scope (e.g. the parameters of a model)
+ * survive, with their indices, while the nodes recorded inside the scope
+ * are removed when it is closed (or at every `rewind`), and their memory
+ * is reused by the next recording.
+ *
+ * EXAMPLE:
+ *     Var<double> w = 0.5;                     // parameter
+ *     TapeScope<double> scope;
+ *     for(auto const & batch: batches) {
+ *         Var<double> loss = ...;              // uses w
+ *         loss.backward();
+ *         double dw = w.grad();
+ *         scope.rewind();                      // the Tape only holds w
+ *         NodeManager<double>::instance().set_node_value(w.index(), w.value() - lr * dw);
+ *     }
+ */
+template <typename T>
+class TapeScope {
+public:
+    TapeScope(TapeScope const &) = delete;
+    TapeScope& operator=(TapeScope const &) = delete;
+
+    explicit TapeScope(Tape<T> & tape = NodeManager<T>::instance()):
+        tape_{tape},
+        mark_{tape.mark()}
+    {}
+
+    /**
+     * Rewinds the Tape, unless it has been cleared (e.g. by a driver like
+     * `reverse::gradient`) or compacted since the scope was opened, or a
+     * region opened inside the scope is still open: then the Tape is left
+     * as it is
+     */
+    ~TapeScope() {
+        if(tape_.can_rewind(mark_)) {
+            tape_.rewind(mark_);
+        }
+    }
+
+    /**
+     * Removes the nodes recorded since the scope was opened
+     */
+    void rewind() {
+        tape_.rewind(mark_);
+    }
+
+private:
+    Tape<T> & tape_;
+    typename NodeManager<T>::Mark mark_;
+};
+
+/**
+ * @class ProfileRegion
+ * @brief RAII object that labels the nodes recorded during its lifetime
+ * for the backward profiler (see `NodeManager::profile`)
+ * @tparam T The type of the underlying variables
+ *
+ * EXAMPLE:
+ *     {
+ *         ProfileRegion<double> region("layer1");
+ *         Var<double> h = tanh(w * x + b);     // attributed to "layer1"
+ *     }
+ */
+template <typename T>
+class ProfileRegion {
+public:
+    ProfileRegion(ProfileRegion const &) = delete;
+    ProfileRegion& operator=(ProfileRegion const &) = delete;
+
+    explicit ProfileRegion(std::string const & name, Tape<T> & tape = NodeManager<T>::instance()):
+        tape_{tape},
+        slot_{tape.begin_region(name)}
+    {}
+
+    /**
+     * Ends the region, unless the Tape has been cleared meanwhile
+     * (e.g. by a driver like `reverse::gradient`)
+     */
+    ~ProfileRegion() {
+        if(tape_.is_innermost_region(slot_)) {
+            tape_.end_region();
+        }
+    }
+
+private:
+    Tape<T> & tape_;
+    size_t slot_;
+};
+
+template <typename U>
+size_t new_block(
+    NodeIdx const * args, size_t n_args, size_t n_outputs,
+    std::array<NodeIdx, 3> const & dims,
+    typename NodeManager<U>::BlockForward forward,
+    typename NodeManager<U>::BlockBackward backward
+) {
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    size_t offset = manager.block_args_.size();
+    manager.block_args_.insert(manager.block_args_.end(), args, args + n_args);
+
+    U * operands = static_cast<U*>(manager.arena_.alloc(n_args * sizeof(U), alignof(U)));
+    for(size_t j = 0; j < n_args; ++j) {
+        new (operands + j) U(manager.values_[args[j]]);
+    }
+
+    manager.blocks_.push_back(typename NodeManager<U>::Block{
+        static_cast<NodeIdx>(offset),
+        static_cast<NodeIdx>(n_args),
+        static_cast<NodeIdx>(n_outputs),
+        dims,
+        operands,
+        forward,
+        backward
+    });
+    size_t block = manager.push_node(
+        OpCode::Block,
+        static_cast<NodeIdx>(manager.blocks_.size()-1),
+        0,
+        U{0.0}
+    );
+
+    for(size_t j = 0; j < n_outputs; ++j) {
+        manager.push_node(OpCode::Output, static_cast<NodeIdx>(block), static_cast<NodeIdx>(j), U{0.0});
+    }
+    forward(dims.data(), operands, &manager.values_[block+1]);
+
+    return block + 1;
+}
+
+template <typename U>
+size_t new_node(U const & value) {
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    return manager.push_node(OpCode::Ind, 0, 0, value);
+}
+
+template <template <typename> class NodeType, typename U>
+size_t new_node(size_t first) {
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    return manager.intern(manager.push_node(
+        NodeType<U>::opcode,
+        static_cast<NodeIdx>(first),
+        0,
+        NodeType<U>::forward(manager.values_[first])
+    ));
+}
+
+template <template <typename> class NodeType, typename U>
+size_t new_node(size_t first, size_t second) {
+    NodeManager<U> & manager = NodeManager<U>::instance();
+
+    return manager.intern(manager.push_node(
+        NodeType<U>::opcode,
+        static_cast<NodeIdx>(first),
+        static_cast<NodeIdx>(second),
+        NodeType<U>::forward(manager.values_[first], manager.values_[second])
+    ));
+}
+
+template <template <typename> class NodeType, typename U>
+size_t new_node(size_t first, U const & constant) {
+    NodeManager<U> & manager = NodeManager<U>::instance();
 
-    manager.nodes_.emplace_back(node_ptr);
+    manager.constants_.push_back(constant);
 
-    return manager.nodes_.size()-1;
+    return manager.intern(manager.push_node(
+        NodeType<U>::opcode,
+        static_cast<NodeIdx>(first),
+        static_cast<NodeIdx>(manager.constants_.size()-1),
+        NodeType<U>::forward(manager.values_[first], constant)
+    ));
 }
 
 }; // namespace reverse
@@ -5,8 +5,8 @@
 
 /**
  * This file specializes the NumTraits struct template for the
- * Var<double> type to let Eigen access information
- * on this type
+ * Var<T> types (e.g. Var<double> or Var<DualVar<double>>) to let Eigen
+ * access information on these types
  *
  * Taken from:
  * "https://eigen.tuxfamily.org/dox/TopicCustomizing_CustomScalar.html"
@@ -15,14 +15,14 @@
 namespace Eigen {
 
 // TODO: review this
-template<>
-struct NumTraits<autodiff::reverse::Var<double>> : NumTraits<double> {
+template<typename T>
+struct NumTraits<autodiff::reverse::Var<T>> : NumTraits<double> {
     /* 
     Real gives the "real part" type of T. If T is already real, 
     then Real is just a typedef to T. If T is std::complex<U> 
     then Real is a typedef to U
     */
-    typedef autodiff::reverse::Var<double> Real;
+    typedef autodiff::reverse::Var<T> Real;
     /*
     NonInteger gives the type that should be used for operations 
     producing non-integral values, such as quotients, square roots, etc. 
@@ -30,11 +30,11 @@ struct NumTraits<autodiff::reverse::Var<double>> : NumTraits<double> {
     Thus, this typedef is only intended as a helper for code that needs
     to explicitly promote types.
     */
-    typedef autodiff::reverse::Var<double> NonInteger;
+    typedef autodiff::reverse::Var<T> NonInteger;
     /*
     Nested gives the type to use to nest a value inside of the expression tree.
     */
-    typedef autodiff::reverse::Var<double> Nested;
+    typedef autodiff::reverse::Var<T> Nested;
 
     enum {
         IsComplex = 0,
@@ -53,9 +53,12 @@ struct NumTraits<autodiff::reverse::Var<double>> : NumTraits<double> {
 namespace autodiff {
 namespace reverse {
 
-inline autodiff::reverse::Var<double> const & conj(autodiff::reverse::Var<double> const & x) { return x; }
-inline autodiff::reverse::Var<double> const & real(autodiff::reverse::Var<double> const & x) { return x; }
-inline autodiff::reverse::Var<double> abs2(autodiff::reverse::Var<double> const & x) { return x*x; }
+template <typename T>
+Var<T> const & conj(Var<T> const & x) { return x; }
+template <typename T>
+Var<T> const & real(Var<T> const & x) { return x; }
+template <typename T>
+Var<T> abs2(Var<T> const & x) { return x*x; }
 
 }; // namespace reverse
 }; // namespace autodiff
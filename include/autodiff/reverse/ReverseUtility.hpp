@@ -1,7 +1,14 @@
 #pragma once
 
 #include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include <algorithm>
 #include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "Coloring.hpp"
+#include "DualVar.hpp"
 #include "NodeManager.hpp"
 #include "ReverseEigenSupport.hpp"
 #include "Var.hpp"
@@ -52,6 +59,168 @@ inline void gradient(
     NodeManager::instance().clear();
 }
 
+/**
+ * Computes the product between the hessian of a function and a vector
+ * (along with the value and the gradient of the function) by
+ * forward-over-reverse differentiation.
+ *
+ * The function is recorded on a Tape of `DualVar<double>`(s) whose inputs
+ * are seeded with the direction `v`, i.e. `x(i) + v(i)ε`. The backward pass
+ * then propagates dual adjoints: their real parts are the gradient and their
+ * infinitesimal parts are the directional derivative of the gradient along
+ * `v`, i.e. `H*v`. The cost is a small multiple of the cost of a gradient,
+ * regardless of the size of `x`.
+ *
+ * @param f Function whose hessian-vector product is to be computed
+ * @param x The point where the function and its derivatives must be evaluated
+ * @param v The vector multiplied by the hessian
+ * @param f_x (OUT) The value of the function at the given point
+ * @param grad (OUT) The gradient of the function at the given point
+ * @param hv (OUT) The product between the hessian at the given point and `v`
+ */
+inline void hvp(
+    std::function<Var<forward::DualVar<double>>(Eigen::Vector<Var<forward::DualVar<double>>, Eigen::Dynamic> const &)> f,
+    Eigen::Vector<double, Eigen::Dynamic> const & x,
+    Eigen::Vector<double, Eigen::Dynamic> const & v,
+    double & f_x,
+    Eigen::Vector<double, Eigen::Dynamic> & grad,
+    Eigen::Vector<double, Eigen::Dynamic> & hv
+) {
+    using Dual = forward::DualVar<double>;
+    using VecVar = Eigen::Vector<Var<Dual>, Eigen::Dynamic>;
+    using Var = Var<Dual>;
+    using NodeManager = NodeManager<Dual>;
+
+    if(x.size() != v.size()) {
+        throw std::invalid_argument("hvp: x and v must have the same size");
+    }
+
+    VecVar var_x(x.size());
+
+    for(size_t i = 0; i < var_x.size(); ++i) {
+        var_x(i) = Var(Dual(x(i), v(i)));
+    }
+
+    Var y = f(var_x);
+    y.backward();
+
+    f_x = y.value().getReal();
+
+    grad.resizeLike(x);
+    hv.resizeLike(x);
+    for(size_t i = 0; i < grad.size(); ++i) {
+        grad(i) = var_x(i).grad().getReal();
+        hv(i) = var_x(i).grad().getInf();
+    }
+
+    NodeManager::instance().clear();
+}
+
+/**
+ * Computes the (sparse) hessian of a function along with its value and its
+ * gradient, with a single reverse sweep over the recorded Tape
+ * (see `NodeManager::hessian`).
+ *
+ * Only the nonzeros of the hessian are computed and stored, hence the cost
+ * depends on the number of nonlinear interactions between the inputs
+ * rather than on the size of `x`.
+ *
+ * @param f Function whose hessian is to be computed
+ * @param x The point where the function and its derivatives must be evaluated
+ * @param f_x (OUT) The value of the function at the given point
+ * @param grad (OUT) The gradient of the function at the given point
+ * @param hess (OUT) The hessian of the function at the given point (both triangles)
+ */
+inline void hessian(
+    std::function<Var<double>(Eigen::Vector<Var<double>, Eigen::Dynamic> const &)> f,
+    Eigen::Vector<double, Eigen::Dynamic> const & x,
+    double & f_x,
+    Eigen::Vector<double, Eigen::Dynamic> & grad,
+    Eigen::SparseMatrix<double> & hess
+) {
+    using VecVar = Eigen::Vector<Var<double>, Eigen::Dynamic>;
+    using Var = Var<double>;
+    using NodeManager = NodeManager<double>;
+
+    VecVar var_x(x.size());
+    for(size_t i = 0; i < var_x.size(); ++i) {
+        var_x(i) = Var(x(i));
+    }
+
+    Var y = f(var_x);
+    auto entries = NodeManager::instance().hessian(y.index());
+
+    f_x = y.value();
+
+    // position in x of each input node
+    std::unordered_map<NodeIdx, size_t> position;
+    grad.resizeLike(x);
+    for(size_t i = 0; i < var_x.size(); ++i) {
+        position.emplace(var_x(i).index(), i);
+        grad(i) = var_x(i).grad();
+    }
+
+    std::vector<Eigen::Triplet<double>> triplets;
+    for(auto const & entry: entries) {
+        auto row = position.find(entry.row);
+        auto col = position.find(entry.col);
+        if(row != position.end() && col != position.end()) {
+            triplets.emplace_back(row->second, col->second, entry.value);
+        }
+    }
+    hess.resize(x.size(), x.size());
+    hess.setFromTriplets(triplets.begin(), triplets.end());
+
+    NodeManager::instance().clear();
+}
+
+/**
+ * Number of rows of the jacobian computed by each (vector-mode) backward pass
+ */
+constexpr size_t JACOBIAN_LANES = 8;
+
+/**
+ * Fills the jacobian of the `outputs` wrt the `inputs` of a Tape using
+ * vector-mode backward passes (`JACOBIAN_LANES` rows per sweep over the Tape)
+ *
+ * Each sweep only visits the output cone of its rows (see `NodeManager::cone`).
+ * The cones are computed at the first call and then reused: `cones` must be
+ * cleared whenever the structure of the Tape changes.
+ *
+ * @param tape The Tape containing both the inputs and the outputs
+ * @param inputs The indices of the input nodes
+ * @param outputs The indices of the output nodes
+ * @param jac (OUT) The jacobian, it must already have the right size
+ * @param cones (IN/OUT) The cones of each group of `JACOBIAN_LANES` rows
+ */
+inline void backward_jacobian(
+    Tape<double> & tape,
+    std::vector<size_t> const & inputs,
+    std::vector<size_t> const & outputs,
+    Eigen::Ref<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>> jac,
+    std::vector<Tape<double>::Cone> & cones
+) {
+    size_t n_groups = (outputs.size() + JACOBIAN_LANES - 1) / JACOBIAN_LANES;
+    bool compute_cones = (cones.size() != n_groups);
+    cones.resize(n_groups);
+
+    for(size_t row = 0; row < outputs.size(); row += JACOBIAN_LANES) {
+        size_t n_rows = std::min(JACOBIAN_LANES, outputs.size() - row);
+        auto & cone = cones[row / JACOBIAN_LANES];
+        if(compute_cones) {
+            tape.cone(outputs.data() + row, n_rows, cone);
+        }
+        tape.backward<JACOBIAN_LANES>(outputs.data() + row, n_rows, cone);
+
+        // fill the rows [row, row+n_rows) of the jacobian
+        for(size_t k = 0; k < n_rows; ++k) {
+            for(size_t j = 0; j < inputs.size(); ++j) {
+                jac(row+k, j) = tape.get_node_grad(inputs[j], k);
+            }
+        }
+    }
+}
+
 /**
  * Computes the jacobian of a function along with the value of that
  * function at the given point.
@@ -79,22 +248,512 @@ inline void jacobian(
 
     VecVar y = f(var_x);
 
+    std::vector<size_t> inputs(var_x.size());
+    for(size_t j = 0; j < var_x.size(); ++j) {
+        inputs[j] = var_x(j).index();
+    }
+    std::vector<size_t> outputs(y.size());
     f_x.resizeLike(y);
+    for(size_t i = 0; i < y.size(); ++i) {
+        outputs[i] = y(i).index();
+        f_x(i) = y(i).value();
+    }
+
     jac.resize(y.size(), var_x.size());
+    std::vector<NodeManager::Cone> cones;
+    backward_jacobian(NodeManager::instance(), inputs, outputs, jac, cones);
+
+    NodeManager::instance().clear();
+}
+
+/**
+ * @class Workspace
+ * @brief The buffers reused by the overloads of `gradient` and `jacobian`
+ * taking a workspace: the Tape the function is recorded in (whose capacity
+ * survives `clear`), the input `Var`(s), the indices of the inputs and of
+ * the outputs and the cones of the backward passes. Repeated calls on
+ * inputs of the same size don't allocate (apart from what the function
+ * itself allocates).
+ *
+ * A Workspace must not be shared between threads.
+ */
+struct Workspace {
+    Tape<double> tape;
+    Eigen::Vector<Var<double>, Eigen::Dynamic> x;
+    std::vector<size_t> inputs;
+    std::vector<size_t> outputs;
+    std::vector<Tape<double>::Cone> cones;
+};
+
+/**
+ * Clears the Tape of a workspace and records the input leaves in it
+ * (the Tape must be the active one)
+ */
+inline void set_inputs(Workspace & ws, Eigen::Ref<Eigen::Vector<double, Eigen::Dynamic> const> x) {
+    ws.tape.clear();
+    if(ws.x.size() != x.size()) {
+        ws.x.resize(x.size());
+    }
+    ws.inputs.resize(x.size());
+    for(size_t i = 0; i < ws.inputs.size(); ++i) {
+        ws.x(i) = Var<double>(x(i));
+        ws.inputs[i] = ws.x(i).index();
+    }
+}
+
+/**
+ * Computes the gradient of a function along with the value of that
+ * function at the given point, reusing the buffers of a workspace.
+ *
+ * The function can be any callable taking a `VecVar const &` and returning
+ * a `Var<double>`: it is called directly (no `std::function`).
+ *
+ * @param f Function whose gradient is to be computed
+ * @param x The point where the function and the gradient must be evaluated
+ * @param f_x (OUT) The value of the function at the given point
+ * @param grad (OUT) The gradient of the function at the given point, it
+ * must have the size of `x`
+ * @param ws The workspace
+ */
+template <typename F>
+void gradient(
+    F && f,
+    Eigen::Ref<Eigen::Vector<double, Eigen::Dynamic> const> x,
+    double & f_x,
+    Eigen::Ref<Eigen::Vector<double, Eigen::Dynamic>> grad,
+    Workspace & ws
+) {
+    if(grad.size() != x.size()) {
+        throw std::invalid_argument("gradient: grad must have the size of x");
+    }
+
+    ActiveTape<double> active(ws.tape);
+    set_inputs(ws, x);
+
+    Eigen::Vector<Var<double>, Eigen::Dynamic> const & var_x = ws.x;
+    Var<double> y = f(var_x);
+    y.backward();
+
+    f_x = y.value();
+    for(size_t i = 0; i < ws.inputs.size(); ++i) {
+        grad(i) = ws.tape.get_node_grad(ws.inputs[i]);
+    }
+}
+
+/**
+ * Computes the jacobian of a function along with the value of that
+ * function at the given point, reusing the buffers of a workspace.
+ *
+ * The function can be any callable taking a `VecVar const &` and returning
+ * a `VecVar`: it is called directly (no `std::function`).
+ *
+ * @param f Function whose jacobian is to be computed
+ * @param x The point where the function and the jacobian must be evaluated
+ * @param f_x (OUT) The value of the function at the given point, it must
+ * have the size of the output
+ * @param jac (OUT) The jacobian of the function at the given point, it
+ * must already have the right size
+ * @param ws The workspace
+ */
+template <typename F>
+void jacobian(
+    F && f,
+    Eigen::Ref<Eigen::Vector<double, Eigen::Dynamic> const> x,
+    Eigen::Ref<Eigen::Vector<double, Eigen::Dynamic>> f_x,
+    Eigen::Ref<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>> jac,
+    Workspace & ws
+) {
+    ActiveTape<double> active(ws.tape);
+    set_inputs(ws, x);
+
+    Eigen::Vector<Var<double>, Eigen::Dynamic> const & var_x = ws.x;
+    Eigen::Vector<Var<double>, Eigen::Dynamic> y = f(var_x);
+    if(f_x.size() != y.size() || jac.rows() != y.size() || jac.cols() != x.size()) {
+        throw std::invalid_argument("jacobian: f_x and jac must have the sizes of the output and of the input");
+    }
+
+    ws.outputs.resize(y.size());
+    for(size_t i = 0; i < ws.outputs.size(); ++i) {
+        ws.outputs[i] = y(i).index();
+        f_x(i) = y(i).value();
+    }
+
+    // the Tape has been recorded again: recompute the cones (reusing their buffers)
+    size_t n_groups = (ws.outputs.size() + JACOBIAN_LANES - 1) / JACOBIAN_LANES;
+    ws.cones.resize(n_groups);
+    for(size_t row = 0; row < ws.outputs.size(); row += JACOBIAN_LANES) {
+        size_t n_rows = std::min(JACOBIAN_LANES, ws.outputs.size() - row);
+        ws.tape.cone(ws.outputs.data() + row, n_rows, ws.cones[row / JACOBIAN_LANES]);
+    }
+    backward_jacobian(ws.tape, ws.inputs, ws.outputs, jac, ws.cones);
+}
+
+/**
+ * Computes the value and the gradient of a function at many points (e.g.
+ * per-sample losses), reusing the buffers of a workspace.
+ *
+ * The function is recorded once, at the first point, and its Tape is
+ * replayed `NodeManager::BATCH_LANES` points at a time (see
+ * `NodeManager::batch_gradient`). The results are exact at the points where
+ * the function takes the branches it takes at the first point.
+ *
+ * @param f Function whose gradient is to be computed, any callable taking
+ * a `VecVar const &` and returning a `Var<double>`
+ * @param X The points, one per column
+ * @param f_X (OUT) The value of the function at each point
+ * @param grads (OUT) The gradient of the function at each point, one per column
+ * @param ws The workspace
+ * @return `true` if every point takes the branches taken at the first one
+ */
+template <typename F>
+bool batch_gradient(
+    F && f,
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> const & X,
+    Eigen::Vector<double, Eigen::Dynamic> & f_X,
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> & grads,
+    Workspace & ws
+) {
+    if(X.cols() == 0) {
+        throw std::invalid_argument("batch_gradient: no points");
+    }
+
+    ActiveTape<double> active(ws.tape);
+    set_inputs(ws, X.col(0));
+
+    Eigen::Vector<Var<double>, Eigen::Dynamic> const & var_x = ws.x;
+    Var<double> y = f(var_x);
+
+    f_X.resize(X.cols());
+    grads.resize(X.rows(), X.cols());
+    return ws.tape.batch_gradient(
+        y.index(), ws.inputs.data(), ws.inputs.size(),
+        X.data(), X.cols(), f_X.data(), grads.data()
+    );
+}
+
+/**
+ * Detects the sparsity pattern of the jacobian of a function, i.e. which
+ * outputs depend on which inputs, by recording the function once and
+ * analysing its Tape (see `NodeManager::sparsity`). No derivative is computed.
+ *
+ * The pattern is valid at every point where the function takes the same
+ * branches it takes at `x`.
+ *
+ * @param f Function whose jacobian sparsity pattern is to be detected
+ * @param x The point where the function is recorded
+ * @return The sparsity pattern (outputs x inputs)
+ */
+inline SparsityPattern jacobian_sparsity(
+    std::function<Eigen::Vector<Var<double>, Eigen::Dynamic>(Eigen::Vector<Var<double>, Eigen::Dynamic> const &)> f,
+    Eigen::Vector<double, Eigen::Dynamic> const & x
+) {
+    using VecVar = Eigen::Vector<Var<double>, Eigen::Dynamic>;
+    using Var = Var<double>;
+    using NodeManager = NodeManager<double>;
+
+    VecVar var_x(x.size());
+    std::vector<size_t> inputs(x.size());
+    for(size_t i = 0; i < var_x.size(); ++i) {
+        var_x(i) = Var(x(i));
+        inputs[i] = var_x(i).index();
+    }
+
+    VecVar y = f(var_x);
+    std::vector<size_t> outputs(y.size());
+    for(size_t i = 0; i < y.size(); ++i) {
+        outputs[i] = y(i).index();
+    }
+
+    std::vector<std::vector<NodeIdx>> rows = NodeManager::instance().sparsity(
+        inputs.data(), inputs.size(), outputs.data(), outputs.size()
+    );
+    NodeManager::instance().clear();
+
+    std::vector<Eigen::Triplet<bool>> entries;
+    for(size_t i = 0; i < rows.size(); ++i) {
+        for(NodeIdx j: rows[i]) {
+            entries.emplace_back(i, j, true);
+        }
+    }
+    SparsityPattern pattern(outputs.size(), inputs.size());
+    pattern.setFromTriplets(entries.begin(), entries.end());
+    return pattern;
+}
+
+/**
+ * Computes a sparse jacobian (whose sparsity pattern is known) along with
+ * the value of the function at the given point.
+ *
+ * The rows are colored (see `color_rows`) and each backward pass seeds all
+ * the outputs of a color at once: since the rows of a color never share a
+ * column, each nonzero of the result is read from the pass of the color of
+ * its row. The colors are processed `JACOBIAN_LANES` at a time by
+ * vector-mode backward passes (one lane per color).
+ *
+ * @param f Function whose jacobian is to be computed
+ * @param x The point where the function and the jacobian must be evaluated
+ * @param pattern The sparsity pattern of the jacobian (every nonzero of the
+ * jacobian must be in the pattern)
+ * @param f_x (OUT) The value of the function at the given point
+ * @param jac (OUT) The jacobian of the function at the given point, with
+ * the same nonzeros of `pattern`
+ */
+inline void sparse_jacobian(
+    std::function<Eigen::Vector<Var<double>, Eigen::Dynamic>(Eigen::Vector<Var<double>, Eigen::Dynamic> const &)> f,
+    Eigen::Vector<double, Eigen::Dynamic> const & x,
+    SparsityPattern const & pattern,
+    Eigen::Vector<double, Eigen::Dynamic> & f_x,
+    Eigen::SparseMatrix<double> & jac
+) {
+    using VecVar = Eigen::Vector<Var<double>, Eigen::Dynamic>;
+    using Var = Var<double>;
+    using NodeManager = NodeManager<double>;
+
+    if(pattern.cols() != x.size()) {
+        throw std::invalid_argument("sparse_jacobian: the pattern must have a column per input");
+    }
+
+    NodeManager & tape = NodeManager::instance();
+
+    VecVar var_x(x.size());
+    for(size_t i = 0; i < var_x.size(); ++i) {
+        var_x(i) = Var(x(i));
+    }
+
+    VecVar y = f(var_x);
+    if(pattern.rows() != y.size()) {
+        tape.clear();
+        throw std::invalid_argument("sparse_jacobian: the pattern must have a row per output");
+    }
+
+    f_x.resize(y.size());
     for(size_t i = 0; i < y.size(); ++i) {
         f_x(i) = y(i).value();
-        y(i).backward();
+    }
+
+    size_t n_colors;
+    std::vector<size_t> colors = color_rows(pattern, n_colors);
+
+    jac = pattern.cast<double>();
+    jac.makeCompressed();
+
+    std::vector<size_t> roots;
+    std::vector<size_t> lanes;
+    NodeManager::Cone cone;
+    for(size_t first = 0; first < n_colors; first += JACOBIAN_LANES) {
+        // the colors [first, first + JACOBIAN_LANES)
+        roots.clear();
+        lanes.clear();
+        for(size_t i = 0; i < colors.size(); ++i) {
+            if(colors[i] >= first && colors[i] < first + JACOBIAN_LANES) {
+                roots.push_back(y(i).index());
+                lanes.push_back(colors[i] - first);
+            }
+        }
+
+        tape.cone(roots.data(), roots.size(), cone);
+        tape.backward<JACOBIAN_LANES>(roots.data(), lanes.data(), roots.size(), cone);
 
-        // fill the i-th row of the jacobian
-        for(size_t j = 0; j < var_x.size(); ++j) {
-            jac(i,j) = var_x(j).grad();
+        for(size_t j = 0; j < jac.outerSize(); ++j) {
+            for(Eigen::SparseMatrix<double>::InnerIterator it(jac, j); it; ++it) {
+                size_t c = colors[it.row()];
+                if(c >= first && c < first + JACOBIAN_LANES) {
+                    it.valueRef() = tape.get_node_grad(var_x(j).index(), c - first);
+                }
+            }
         }
-        
-        // reset grad info for the next backward pass
-        NodeManager::instance().clear_grad();
     }
-    NodeManager::instance().clear();
+
+    tape.clear();
 }
 
+/**
+ * @class Recorder
+ * @brief Common machinery of the record-once/replay-many drivers
+ * (`RecordedGradient` and `RecordedJacobian`)
+ *
+ * The first evaluation runs the user function on `Var`(s) and keeps the
+ * resulting Tape. Subsequent evaluations only:
+ *  1. overwrite the values of the input leaves
+ *  2. re-evaluate the values of the nodes with a forward sweep over the Tape
+ *  3. run the backward pass
+ * without calling the user function and without allocating new nodes.
+ *
+ * The comparisons performed by the function during the recording (through
+ * `Var::operator<` and similar) act as guards: if any of them flips at the
+ * new point, the function is recorded again.
+ *
+ * NOTE: the function must not depend on the input through anything
+ * other than `Var` operations (e.g. by reading `value()` and creating new
+ * `Var`(s) from it), because such dependencies are not recorded in the Tape.
+ * Since a replay can't tell such leaves from the inputs, the recording throws
+ * `std::logic_error` if the function creates any leaf: constants must be
+ * plain values (e.g. `x(0) + 1.0` rather than `x(0) + Var<double>(1.0)`).
+ */
+class Recorder {
+public:
+    using VecVar = Eigen::Vector<Var<double>, Eigen::Dynamic>;
+
+    /**
+     * Returns how many times the function has been recorded
+     */
+    size_t n_records() const {
+        return n_records_;
+    }
+
+protected:
+    /**
+     * Clears the Tape and creates the input leaves
+     */
+    VecVar new_inputs(Eigen::Vector<double, Eigen::Dynamic> const & x) {
+        tape_.clear();
+
+        VecVar var_x(x.size());
+        for(size_t i = 0; i < var_x.size(); ++i) {
+            var_x(i) = Var<double>(x(i));
+        }
+
+        inputs_.resize(x.size());
+        for(size_t i = 0; i < inputs_.size(); ++i) {
+            inputs_[i] = var_x(i).index();
+        }
+
+        ++n_records_;
+        return var_x;
+    }
+
+    /**
+     * Re-evaluates the recorded Tape at a new point.
+     * Returns `false` if the function must be recorded again.
+     */
+    bool replay(Eigen::Vector<double, Eigen::Dynamic> const & x) {
+        if(n_records_ == 0 || x.size() != inputs_.size()) {
+            return false;
+        }
+
+        for(size_t i = 0; i < inputs_.size(); ++i) {
+            tape_.set_node_value(inputs_[i], x(i));
+        }
+
+        return tape_.forward();
+    }
+
+    /**
+     * Throws if the recorded function created leaves besides the inputs:
+     * their values would be stale at every replay
+     */
+    void check_leaves() {
+        if(tape_.n_leaves() != inputs_.size()) {
+            // nothing left to replay: every call records (and throws) again
+            tape_.clear();
+            inputs_.clear();
+            throw std::logic_error("Recorder: the function creates leaves, it can't be replayed");
+        }
+    }
+
+    Tape<double> tape_;
+    std::vector<size_t> inputs_;
+    size_t n_records_ = 0;
+};
+
+/**
+ * @class RecordedGradient
+ * @brief Computes the gradient of a function by recording its Tape once
+ * and replaying it at every new point (see `Recorder`)
+ */
+class RecordedGradient : public Recorder {
+public:
+    using FunctionType = std::function<Var<double>(VecVar const &)>;
+
+    explicit RecordedGradient(FunctionType f): f_{std::move(f)} {}
+
+    /**
+     * Computes the gradient of the function along with the value of that
+     * function at the given point.
+     *
+     * @param x The point where the function and the gradient must be evaluated
+     * @param f_x (OUT) The value of the function at the given point
+     * @param grad (OUT) The gradient of the function at the given point
+     */
+    void operator()(
+        Eigen::Vector<double, Eigen::Dynamic> const & x,
+        double & f_x,
+        Eigen::Vector<double, Eigen::Dynamic> & grad
+    ) {
+        if(!replay(x)) {
+            ActiveTape<double> active(tape_);
+            output_ = f_(new_inputs(x)).index();
+            check_leaves();
+            tape_.cone(&output_, 1, cone_);
+        }
+
+        tape_.clear_grad();
+        tape_.backward(output_, cone_);
+
+        f_x = tape_.get_node_value(output_);
+
+        grad.resize(inputs_.size());
+        for(size_t i = 0; i < inputs_.size(); ++i) {
+            grad(i) = tape_.get_node_grad(inputs_[i]);
+        }
+    }
+
+private:
+    FunctionType f_;
+    size_t output_ = 0;
+    Tape<double>::Cone cone_;
+};
+
+/**
+ * @class RecordedJacobian
+ * @brief Computes the jacobian of a function by recording its Tape once
+ * and replaying it at every new point (see `Recorder`)
+ */
+class RecordedJacobian : public Recorder {
+public:
+    using FunctionType = std::function<VecVar(VecVar const &)>;
+
+    explicit RecordedJacobian(FunctionType f): f_{std::move(f)} {}
+
+    /**
+     * Computes the jacobian of the function along with the value of that
+     * function at the given point.
+     *
+     * @param x The point where the function and the jacobian must be evaluated
+     * @param f_x (OUT) The value of the function at the given point
+     * @param jac (OUT) The jacobian of the function at the given point
+     */
+    void operator()(
+        Eigen::Vector<double, Eigen::Dynamic> const & x,
+        Eigen::Vector<double, Eigen::Dynamic> & f_x,
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> & jac
+    ) {
+        if(!replay(x)) {
+            ActiveTape<double> active(tape_);
+            VecVar y = f_(new_inputs(x));
+            check_leaves();
+
+            outputs_.resize(y.size());
+            for(size_t i = 0; i < outputs_.size(); ++i) {
+                outputs_[i] = y(i).index();
+            }
+            cones_.clear();
+        }
+
+        f_x.resize(outputs_.size());
+        for(size_t i = 0; i < outputs_.size(); ++i) {
+            f_x(i) = tape_.get_node_value(outputs_[i]);
+        }
+
+        jac.resize(outputs_.size(), inputs_.size());
+        backward_jacobian(tape_, inputs_, outputs_, jac, cones_);
+    }
+
+private:
+    FunctionType f_;
+    std::vector<size_t> outputs_;
+    std::vector<Tape<double>::Cone> cones_;
+};
+
 }; // namespace reverse 
 }; // namespace autodiff
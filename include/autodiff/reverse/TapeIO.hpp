@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "NodeManager.hpp"
+
+/**
+ * Binary serialization of a Tape.
+ *
+ * A Tape recorded in a process can be saved with `save_tape` and loaded
+ * (in the same or in another process) with `load_tape`, e.g. to run many
+ * backward passes without re-running the recording.
+ *
+ * File layout (every section starts at a multiple of 8 bytes):
+ *     +--------+-----+--------+--------+--------+-----------+------------+-----------+---------------+--------+
+ *     | header | ops | first  | second | values | constants | statements | nary_args | nary_partials | guards |
+ *     +--------+-----+--------+--------+--------+-----------+------------+-----------+---------------+--------+
+ *
+ * Limitations:
+ *  - `BlockNode`(s) refer to kernels of the recording process and can't
+ *    be saved (`save_tape` throws)
+ *  - the `StatementNode`(s) of a loaded Tape keep their local partials, hence
+ *    they support backward passes, but they can't be replayed (`forward` throws)
+ *  - the file must be read on a machine with the same endianness and
+ *    with the same type of values
+ */
+
+namespace autodiff {
+namespace reverse {
+
+/**
+ * The header of a Tape file
+ */
+struct TapeFileHeader {
+    static constexpr char MAGIC[8] = {'A', 'D', 'T', 'A', 'P', 'E', '\0', '\0'};
+    static constexpr std::uint32_t VERSION = 1;
+    static constexpr std::uint32_t ENDIANNESS = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t endianness;
+    std::uint32_t value_size;
+    std::uint32_t reserved;
+    std::uint64_t n_nodes;
+    std::uint64_t n_constants;
+    std::uint64_t n_statements;
+    std::uint64_t n_nary_args;
+    std::uint64_t n_guards;
+};
+
+/**
+ * On-disk representation of a `StatementNode` (the evaluation function
+ * is not saved)
+ */
+struct TapeFileStatement {
+    std::uint32_t args;
+    std::uint32_t n_args;
+    std::uint32_t constants;
+    std::uint32_t reserved;
+};
+
+/**
+ * On-disk representation of a guard
+ */
+template <typename T>
+struct TapeFileGuard {
+    std::uint8_t op;
+    std::uint8_t result;
+    std::uint8_t rhs_is_constant;
+    std::uint8_t reserved[5];
+    std::uint32_t lhs;
+    std::uint32_t rhs;
+    T constant;
+};
+
+/**
+ * Returns the number of padding bytes needed after `size` bytes
+ */
+inline size_t tape_file_padding(size_t size) {
+    return (8 - size % 8) % 8;
+}
+
+template <typename U>
+void save_tape(NodeManager<U> const & tape, std::string const & path) {
+    static_assert(std::is_trivially_copyable_v<U>, "only trivially copyable values can be saved");
+
+    if(!tape.blocks_.empty()) {
+        throw std::runtime_error("save_tape: Tapes with BlockNode(s) cannot be saved");
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out) {
+        throw std::runtime_error("save_tape: cannot open " + path);
+    }
+
+    auto write_section = [&out](void const * data, size_t size) {
+        static char const zeros[8] = {};
+        out.write(static_cast<char const *>(data), size);
+        out.write(zeros, tape_file_padding(size));
+    };
+
+    TapeFileHeader header{};
+    std::memcpy(header.magic, TapeFileHeader::MAGIC, sizeof(header.magic));
+    header.version = TapeFileHeader::VERSION;
+    header.endianness = TapeFileHeader::ENDIANNESS;
+    header.value_size = sizeof(U);
+    header.n_nodes = tape.ops_.size();
+    header.n_constants = tape.constants_.size();
+    header.n_statements = tape.statements_.size();
+    header.n_nary_args = tape.nary_args_.size();
+    header.n_guards = tape.guards_.size();
+    write_section(&header, sizeof(header));
+
+    write_section(tape.ops_.data(), tape.ops_.size() * sizeof(OpCode));
+    write_section(tape.first_.data(), tape.first_.size() * sizeof(NodeIdx));
+    write_section(tape.second_.data(), tape.second_.size() * sizeof(NodeIdx));
+    write_section(tape.values_.data(), tape.values_.size() * sizeof(U));
+    write_section(tape.constants_.data(), tape.constants_.size() * sizeof(U));
+
+    std::vector<TapeFileStatement> statements;
+    statements.reserve(tape.statements_.size());
+    for(auto const & statement: tape.statements_) {
+        statements.push_back({statement.args, statement.n_args, statement.constants, 0});
+    }
+    write_section(statements.data(), statements.size() * sizeof(TapeFileStatement));
+    write_section(tape.nary_args_.data(), tape.nary_args_.size() * sizeof(NodeIdx));
+    write_section(tape.nary_partials_.data(), tape.nary_partials_.size() * sizeof(U));
+
+    std::vector<TapeFileGuard<U>> guards;
+    guards.reserve(tape.guards_.size());
+    for(auto const & guard: tape.guards_) {
+        TapeFileGuard<U> record{};
+        record.op = static_cast<std::uint8_t>(guard.op);
+        record.result = guard.result;
+        record.rhs_is_constant = guard.rhs_is_constant;
+        record.lhs = guard.lhs;
+        record.rhs = guard.rhs;
+        record.constant = guard.constant;
+        guards.push_back(record);
+    }
+    write_section(guards.data(), guards.size() * sizeof(TapeFileGuard<U>));
+
+    if(!out) {
+        throw std::runtime_error("save_tape: error while writing " + path);
+    }
+}
+
+/**
+ * @class TapeFile
+ * @brief Read-only view of the content of a Tape file: the file is
+ * mapped in memory (when possible) instead of being read
+ */
+class TapeFile {
+public:
+    TapeFile(TapeFile const &) = delete;
+    TapeFile& operator=(TapeFile const &) = delete;
+
+    explicit TapeFile(std::string const & path) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error("load_tape: cannot open " + path);
+        }
+        struct stat st;
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("load_tape: cannot stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if(size_ > 0) {
+            void * p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("load_tape: cannot map " + path);
+            }
+            data_ = static_cast<char const *>(p);
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if(!in) {
+            throw std::runtime_error("load_tape: cannot open " + path);
+        }
+        size_ = static_cast<size_t>(in.tellg());
+        buffer_.resize(size_);
+        in.seekg(0);
+        in.read(buffer_.data(), size_);
+        data_ = buffer_.data();
+#endif
+    }
+
+    ~TapeFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if(data_) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+#endif
+    }
+
+    /**
+     * Returns a pointer to the next section of the file (of `count`
+     * elements of type `X`) and moves past it
+     */
+    template <typename X>
+    X const * next(size_t count) {
+        size_t size = count * sizeof(X);
+        if(offset_ + size > size_) {
+            throw std::runtime_error("load_tape: truncated file");
+        }
+        X const * section = reinterpret_cast<X const *>(data_ + offset_);
+        offset_ += size + tape_file_padding(size);
+        return section;
+    }
+
+private:
+    char const * data_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+#if !(defined(__unix__) || defined(__APPLE__))
+    std::vector<char> buffer_;
+#endif
+};
+
+/**
+ * Replaces the content of `tape` with the Tape saved in `path`.
+ * The nodes keep the indices they had when the Tape was saved.
+ *
+ * The content of the file is validated (node types, indices of the
+ * arguments, of the constants and of the statements): a file which
+ * `save_tape` could not have written throws `std::runtime_error` and
+ * leaves `tape` empty.
+ */
+template <typename U>
+void load_tape(NodeManager<U> & tape, std::string const & path) {
+    static_assert(std::is_trivially_copyable_v<U>, "only trivially copyable values can be loaded");
+
+    TapeFile file(path);
+
+    TapeFileHeader header = *file.next<TapeFileHeader>(1);
+    if(std::memcmp(header.magic, TapeFileHeader::MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("load_tape: " + path + " is not a Tape file");
+    }
+    if(header.version != TapeFileHeader::VERSION) {
+        throw std::runtime_error("load_tape: unsupported version");
+    }
+    if(header.endianness != TapeFileHeader::ENDIANNESS || header.value_size != sizeof(U)) {
+        throw std::runtime_error("load_tape: the Tape has been saved with a different type of values");
+    }
+    if(header.n_nodes == 0) {
+        throw std::runtime_error("load_tape: empty Tape");
+    }
+
+    tape.clear();
+    size_t n = header.n_nodes;
+    auto corrupted = [&tape]() {
+        tape.clear();
+        return std::runtime_error("load_tape: corrupted file");
+    };
+
+    OpCode const * ops = file.next<OpCode>(n);
+    tape.ops_.assign(ops, ops + n);
+    NodeIdx const * first = file.next<NodeIdx>(n);
+    tape.first_.assign(first, first + n);
+    NodeIdx const * second = file.next<NodeIdx>(n);
+    tape.second_.assign(second, second + n);
+    U const * values = file.next<U>(n);
+    tape.values_.assign(values, values + n);
+    tape.grads_.assign(n, U{0.0});
+
+    U const * constants = file.next<U>(header.n_constants);
+    tape.constants_.assign(constants, constants + header.n_constants);
+
+    TapeFileStatement const * statements = file.next<TapeFileStatement>(header.n_statements);
+    for(size_t i = 0; i < header.n_statements; ++i) {
+        if(size_t{statements[i].args} + statements[i].n_args > header.n_nary_args
+            || statements[i].constants > header.n_constants) {
+            throw corrupted();
+        }
+        tape.statements_.push_back(typename NodeManager<U>::Statement{
+            statements[i].args, statements[i].n_args, statements[i].constants, nullptr, nullptr
+        });
+    }
+    NodeIdx const * nary_args = file.next<NodeIdx>(header.n_nary_args);
+    tape.nary_args_.assign(nary_args, nary_args + header.n_nary_args);
+    U const * nary_partials = file.next<U>(header.n_nary_args);
+    tape.nary_partials_.assign(nary_partials, nary_partials + header.n_nary_args);
+
+    TapeFileGuard<U> const * guards = file.next<TapeFileGuard<U>>(header.n_guards);
+    for(size_t i = 0; i < header.n_guards; ++i) {
+        if(guards[i].op > static_cast<std::uint8_t>(CmpOp::Ge) || guards[i].lhs >= n
+            || (!guards[i].rhs_is_constant && guards[i].rhs >= n)) {
+            throw corrupted();
+        }
+        tape.guards_.push_back(typename NodeManager<U>::Guard{
+            static_cast<CmpOp>(guards[i].op),
+            guards[i].result != 0,
+            guards[i].rhs_is_constant != 0,
+            guards[i].lhs,
+            guards[i].rhs,
+            guards[i].constant
+        });
+    }
+
+    // every argument precedes its node: the sweeps never leave the Tape
+    if(tape.ops_[0] != OpCode::Ind) {
+        throw corrupted();
+    }
+    for(size_t i = 1; i < n; ++i) {
+        OpCode op = tape.ops_[i];
+        // the blocks are never saved
+        if(static_cast<size_t>(op) >= N_OPCODES || op == OpCode::Block || op == OpCode::Output) {
+            throw corrupted();
+        }
+        bool valid = true;
+        visit_node<U>(op, [&]<typename NodeType>() {
+            if constexpr (NodeType::opcode == OpCode::Statement) {
+                if(tape.first_[i] >= header.n_statements) {
+                    valid = false;
+                    return;
+                }
+                auto const & statement = tape.statements_[tape.first_[i]];
+                for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                    valid = valid && tape.nary_args_[statement.args + j] < i;
+                }
+            }
+            if constexpr (NodeType::arity >= 1) {
+                valid = valid && tape.first_[i] < i;
+            }
+            if constexpr (NodeType::arity >= 2) {
+                valid = valid && tape.second_[i] < i;
+            }
+            if constexpr (NodeType::with_constant) {
+                valid = valid && tape.second_[i] < header.n_constants;
+            }
+        });
+        if(!valid) {
+            throw corrupted();
+        }
+    }
+
+    if(tape.hash_consing_) {
+        tape.rebuild_cse_table();
+    }
+}
+
+}; // namespace reverse
+}; // namespace autodiff
@@ -0,0 +1,484 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NodeManager.hpp"
+
+/**
+ * Optimization passes over a recorded Tape.
+ *
+ * A Tape which is replayed many times (see `NodeManager::forward`) pays for
+ * every recorded node at every replay, including the nodes which can't
+ * influence its outputs (e.g. intermediate results which are not used) and
+ * the nodes whose value can't change (e.g. `Var(0)` accumulators and
+ * constant subexpressions). The passes below remove them once, right
+ * after the recording:
+ *  - `fold_constants`: the nodes which only depend on constants become
+ *    constants themselves
+ *  - `simplify_identities`: `x*1`, `x+0`, `-(-x)`, ... are replaced by `x`
+ *  - `eliminate_dead_nodes`: the nodes which don't reach any output (nor
+ *    any guard) are removed
+ *  - `compact`: the surviving nodes are renumbered into a dense Tape
+ *
+ * The passes need to know the interface of the Tape: its `inputs` (the
+ * leaves whose value is set before each replay, every other leaf is a
+ * constant) and its `outputs` (the nodes whose value or derivatives are
+ * read). `compact` renumbers the nodes: the `inputs` and the `outputs` are
+ * updated accordingly, and the indices held by the `Var`(s) created during
+ * the recording are no longer valid.
+ *
+ * EXAMPLE:
+ *     TapeOptimization<double> opt(tape, inputs, outputs);
+ *     PassManager<double>::default_pipeline().run(opt);
+ *     // tape.set_node_value(opt.inputs[k], ...), tape.backward(opt.outputs[0]), ...
+ */
+
+namespace autodiff {
+namespace reverse {
+
+/**
+ * @class TapeOptimization
+ * @brief A Tape along with its interface, on which the optimization
+ * passes operate
+ * @tparam T The type of the underlying variables
+ *
+ * Between the passes, the nodes removed by a pass are only marked as dead:
+ * they are actually removed (and the Tape renumbered) by `compact`.
+ */
+template <typename T>
+class TapeOptimization {
+public:
+    using Tape = NodeManager<T>;
+
+    TapeOptimization(Tape & tape, std::vector<size_t> inputs, std::vector<size_t> outputs):
+        inputs{std::move(inputs)},
+        outputs{std::move(outputs)},
+        tape_{tape},
+        dead_(tape.ops_.size(), 0)
+    {
+        if(!tape.open_regions_.empty()) {
+            throw std::logic_error("TapeOptimization: the Tape has open regions");
+        }
+        tape.end_recording();
+    }
+
+    // The leaves whose value changes between replays
+    std::vector<size_t> inputs;
+    // The nodes whose value/derivatives are read
+    std::vector<size_t> outputs;
+
+    Tape & tape() {
+        return tape_;
+    }
+
+    /**
+     * Returns the number of nodes of the Tape which are not dead
+     */
+    size_t n_live() const {
+        return static_cast<size_t>(std::count(dead_.begin(), dead_.end(), 0));
+    }
+
+    // *********** Passes ***********
+    // Each pass returns the number of nodes it has changed (or removed)
+
+    /**
+     * Turns into constants (i.e. leaves) the nodes whose arguments are all
+     * constants. A leaf is a constant unless it is one of the `inputs`.
+     * The blocks are never folded.
+     */
+    static size_t fold_constants(TapeOptimization & opt) {
+        Tape & tape = opt.tape_;
+        std::vector<std::uint8_t> constant = opt.constants();
+
+        size_t n_folded = 0;
+        for(size_t i = 1; i < tape.ops_.size(); ++i) {
+            OpCode op = tape.ops_[i];
+            if(opt.dead_[i] || op == OpCode::Ind || op == OpCode::Block || op == OpCode::Output) {
+                continue;
+            }
+            bool foldable = true;
+            tape.for_each_arg(i, [&](NodeIdx arg) {
+                foldable = foldable && constant[arg];
+            });
+            if(foldable) {
+                // the value has been computed by the recording (or the last replay)
+                tape.ops_[i] = OpCode::Ind;
+                tape.first_[i] = tape.second_[i] = 0;
+                constant[i] = 1;
+                ++n_folded;
+            }
+        }
+        return n_folded;
+    }
+
+    /**
+     * Replaces with their argument the nodes which compute an identity
+     * function of it:
+     *     x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1, x ^ 1, -(-x)
+     * (where 0 and 1 are constants). The replaced nodes become dead.
+     * The expressions fused into a `StatementNode` are opaque to this pass.
+     */
+    static size_t simplify_identities(TapeOptimization & opt) {
+        Tape & tape = opt.tape_;
+        std::vector<std::uint8_t> constant = opt.constants();
+        auto is = [&](NodeIdx node, T const & value) {
+            return constant[node] && tape.values_[node] == value;
+        };
+
+        // alias[i] == j => the i-th node has been replaced by the j-th one
+        std::vector<NodeIdx> alias(tape.ops_.size());
+        for(size_t i = 0; i < alias.size(); ++i) {
+            alias[i] = static_cast<NodeIdx>(i);
+        }
+
+        size_t n_simplified = 0;
+        for(size_t i = 1; i < tape.ops_.size(); ++i) {
+            if(opt.dead_[i]) {
+                continue;
+            }
+            // the arguments precede the node: their aliases are final
+            tape.for_each_arg(i, [&](NodeIdx & arg) {
+                arg = alias[arg];
+            });
+
+            NodeIdx first = tape.first_[i];
+            NodeIdx second = tape.second_[i];
+            NodeIdx target = static_cast<NodeIdx>(i);
+            switch(tape.ops_[i]) {
+                case OpCode::Add:
+                    if(is(second, T{0.0})) {
+                        target = first;
+                    } else if(is(first, T{0.0})) {
+                        target = second;
+                    }
+                    break;
+                case OpCode::Sub:
+                    if(is(second, T{0.0})) {
+                        target = first;
+                    }
+                    break;
+                case OpCode::Prod:
+                    if(is(second, T{1.0})) {
+                        target = first;
+                    } else if(is(first, T{1.0})) {
+                        target = second;
+                    }
+                    break;
+                case OpCode::Div:
+                case OpCode::Pow:
+                    if(is(second, T{1.0})) {
+                        target = first;
+                    }
+                    break;
+                case OpCode::Neg:
+                    if(tape.ops_[first] == OpCode::Neg) {
+                        target = tape.first_[first];
+                    }
+                    break;
+                case OpCode::AddConst:
+                    if(tape.constants_[second] == T{0.0}) {
+                        target = first;
+                    }
+                    break;
+                case OpCode::Scale:
+                case OpCode::DivConst:
+                case OpCode::PowConst:
+                    if(tape.constants_[second] == T{1.0}) {
+                        target = first;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            if(target != i) {
+                alias[i] = target;
+                opt.dead_[i] = 1;
+                ++n_simplified;
+            }
+        }
+
+        for(auto & output: opt.outputs) {
+            output = alias[output];
+        }
+        for(auto & guard: tape.guards_) {
+            guard.lhs = alias[guard.lhs];
+            if(!guard.rhs_is_constant) {
+                guard.rhs = alias[guard.rhs];
+            }
+        }
+        return n_simplified;
+    }
+
+    /**
+     * Marks as dead the nodes which neither the `outputs` nor the guards
+     * depend on. The `inputs` are always kept.
+     */
+    static size_t eliminate_dead_nodes(TapeOptimization & opt) {
+        Tape & tape = opt.tape_;
+
+        std::vector<size_t> roots = opt.outputs;
+        for(auto const & guard: tape.guards_) {
+            roots.push_back(guard.lhs);
+            if(!guard.rhs_is_constant) {
+                roots.push_back(guard.rhs);
+            }
+        }
+        typename Tape::Cone cone;
+        tape.cone(roots.data(), roots.size(), cone);
+
+        std::vector<std::uint8_t> live(tape.ops_.size(), 0);
+        live[0] = 1;
+        for(NodeIdx i: cone) {
+            live[i] = 1;
+        }
+        for(size_t input: opt.inputs) {
+            live[input] = 1;
+        }
+        // the outputs of a block must follow it
+        for(NodeIdx i: cone) {
+            if(tape.ops_[i] == OpCode::Block) {
+                auto const & block = tape.blocks_[tape.first_[i]];
+                std::fill_n(live.begin() + i + 1, block.n_outputs, 1);
+            }
+        }
+
+        size_t n_removed = 0;
+        for(size_t i = 0; i < live.size(); ++i) {
+            if(!live[i] && !opt.dead_[i]) {
+                opt.dead_[i] = 1;
+                ++n_removed;
+            }
+        }
+        return n_removed;
+    }
+
+    /**
+     * Removes the dead nodes from the Tape and renumbers the surviving ones
+     * (preserving their order). The `inputs`, the `outputs`, the guards and
+     * the regions are updated. The adjoints are reset.
+     */
+    static size_t compact(TapeOptimization & opt) {
+        Tape & tape = opt.tape_;
+        size_t const n = tape.ops_.size();
+
+        constexpr NodeIdx REMOVED = static_cast<NodeIdx>(-1);
+        std::vector<NodeIdx> index(n, REMOVED);
+        NodeIdx n_live = 0;
+        for(size_t i = 0; i < n; ++i) {
+            if(!opt.dead_[i]) {
+                index[i] = n_live++;
+            }
+        }
+        if(n_live == n) {
+            return 0;
+        }
+
+        std::vector<typename Tape::Statement> statements;
+        std::vector<NodeIdx> nary_args;
+        std::vector<T> nary_partials;
+        std::vector<typename Tape::Block> blocks;
+        std::vector<NodeIdx> block_args;
+
+        for(size_t i = 0; i < n; ++i) {
+            NodeIdx k = index[i];
+            OpCode op = tape.ops_[i];
+            if(k == REMOVED) {
+                if(op == OpCode::Block) {
+                    auto const & block = tape.blocks_[tape.first_[i]];
+                    if constexpr (!std::is_trivially_destructible_v<T>) {
+                        std::destroy_n(block.operands, block.n_args);
+                    }
+                }
+                continue;
+            }
+
+            NodeIdx first = tape.first_[i];
+            NodeIdx second = tape.second_[i];
+            visit_node<T>(op, [&]<typename NodeType>() {
+                if constexpr (NodeType::opcode == OpCode::Statement) {
+                    auto statement = tape.statements_[first];
+                    NodeIdx args = static_cast<NodeIdx>(nary_args.size());
+                    for(NodeIdx j = 0; j < statement.n_args; ++j) {
+                        nary_args.push_back(index[tape.nary_args_[statement.args + j]]);
+                        nary_partials.push_back(tape.nary_partials_[statement.args + j]);
+                    }
+                    statement.args = args;
+                    first = static_cast<NodeIdx>(statements.size());
+                    statements.push_back(statement);
+
+                } else if constexpr (NodeType::opcode == OpCode::Block) {
+                    auto block = tape.blocks_[first];
+                    NodeIdx args = static_cast<NodeIdx>(block_args.size());
+                    for(NodeIdx j = 0; j < block.n_args; ++j) {
+                        block_args.push_back(index[tape.block_args_[block.args + j]]);
+                    }
+                    block.args = args;
+                    first = static_cast<NodeIdx>(blocks.size());
+                    blocks.push_back(block);
+
+                } else if constexpr (NodeType::opcode == OpCode::Output) {
+                    first = index[first];
+
+                } else if constexpr (NodeType::arity == 1) {
+                    first = index[first];
+
+                } else if constexpr (NodeType::arity == 2) {
+                    first = index[first];
+                    second = index[second];
+                }
+                // the constant operand of a `ScalarNode` is not renumbered
+            });
+
+            // k <= i: the surviving nodes are moved down in place
+            tape.ops_[k] = op;
+            tape.first_[k] = first;
+            tape.second_[k] = second;
+            tape.values_[k] = tape.values_[i];
+        }
+
+        tape.ops_.resize(n_live);
+        tape.first_.resize(n_live);
+        tape.second_.resize(n_live);
+        tape.values_.resize(n_live);
+        tape.statements_ = std::move(statements);
+        tape.nary_args_ = std::move(nary_args);
+        tape.nary_partials_ = std::move(nary_partials);
+        tape.blocks_ = std::move(blocks);
+        tape.block_args_ = std::move(block_args);
+
+        for(auto & guard: tape.guards_) {
+            guard.lhs = index[guard.lhs];
+            if(!guard.rhs_is_constant) {
+                guard.rhs = index[guard.rhs];
+            }
+        }
+
+        // a region keeps the surviving nodes of its range
+        for(auto & range: tape.region_ranges_) {
+            auto renumber = [&](NodeIdx bound) {
+                while(bound < n && index[bound] == REMOVED) {
+                    ++bound;
+                }
+                return bound < n ? index[bound] : n_live;
+            };
+            range.begin = renumber(range.begin);
+            range.end = renumber(range.end);
+        }
+        tape.node_regions_.clear();
+
+        // reset the adjoints and the scratch buffers indexed by node
+        tape.grads_.assign(n_live, T{0.0});
+        tape.touched_.clear();
+        tape.all_touched_ = false;
+        tape.lane_grads_.clear();
+        tape.n_lanes_ = 0;
+        tape.lanes_touched_.clear();
+        tape.marks_.assign(n_live, 0);
+        // the indices changed: the marks of the Tape are no longer valid
+        ++tape.generation_;
+        if(tape.hash_consing_) {
+            tape.rebuild_cse_table();
+        }
+
+        for(auto & input: opt.inputs) {
+            input = index[input];
+        }
+        for(auto & output: opt.outputs) {
+            output = index[output];
+        }
+        opt.dead_.assign(n_live, 0);
+
+        return n - n_live;
+    }
+
+private:
+    /**
+     * Returns which nodes are constants: the leaves which are not inputs
+     */
+    std::vector<std::uint8_t> constants() const {
+        std::vector<std::uint8_t> constant(tape_.ops_.size(), 0);
+        for(size_t i = 0; i < constant.size(); ++i) {
+            constant[i] = !dead_[i] && tape_.ops_[i] == OpCode::Ind;
+        }
+        for(size_t input: inputs) {
+            constant[input] = 0;
+        }
+        return constant;
+    }
+
+    Tape & tape_;
+    // dead_[i] == 1 => the i-th node is removed by `compact`
+    std::vector<std::uint8_t> dead_;
+};
+
+/**
+ * @class PassManager
+ * @brief Runs a sequence of optimization passes over a Tape
+ * @tparam T The type of the underlying variables
+ *
+ * A pass is any callable taking a `TapeOptimization<T> &` and returning
+ * the number of nodes it has changed, e.g. the static members of
+ * `TapeOptimization`.
+ */
+template <typename T>
+class PassManager {
+public:
+    using Pass = std::function<size_t(TapeOptimization<T> &)>;
+
+    /**
+     * The result of a pass
+     */
+    struct Report {
+        std::string name;
+        size_t n_changed;
+    };
+
+    /**
+     * Returns the standard pipeline: constant folding, simplification of
+     * the identities, dead nodes elimination and compaction
+     */
+    static PassManager default_pipeline() {
+        PassManager passes;
+        passes.add("fold_constants", &TapeOptimization<T>::fold_constants);
+        passes.add("simplify_identities", &TapeOptimization<T>::simplify_identities);
+        passes.add("eliminate_dead_nodes", &TapeOptimization<T>::eliminate_dead_nodes);
+        passes.add("compact", &TapeOptimization<T>::compact);
+        return passes;
+    }
+
+    /**
+     * Appends a pass to the pipeline
+     */
+    PassManager & add(std::string name, Pass pass) {
+        passes_.emplace_back(std::move(name), std::move(pass));
+        return *this;
+    }
+
+    /**
+     * Runs the passes in the order in which they have been added
+     *
+     * @return What each pass has done
+     */
+    std::vector<Report> run(TapeOptimization<T> & opt) const {
+        std::vector<Report> reports;
+        reports.reserve(passes_.size());
+        for(auto const & [name, pass]: passes_) {
+            reports.push_back({name, pass(opt)});
+        }
+        return reports;
+    }
+
+private:
+    std::vector<std::pair<std::string, Pass>> passes_;
+};
+
+}; // namespace reverse
+}; // namespace autodiff
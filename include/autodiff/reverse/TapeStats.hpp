@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Node.hpp"
+
+namespace autodiff {
+namespace reverse {
+
+/**
+ * @brief A snapshot of the size and the composition of a Tape
+ * (see `NodeManager::stats`)
+ *
+ * The times are only collected while the instrumentation of the Tape
+ * is enabled (see `NodeManager::instrument`):
+ *  - `recording_time`: from a `clear` to the first sweep over the Tape,
+ *    i.e. the time spent running the user code that records the Tape
+ *  - `backward_time`: in the backward passes (scalar and vector mode)
+ *  - `replay_time`: in `forward`
+ */
+struct TapeStats {
+    // *********** Nodes ***********
+    size_t n_nodes = 0;
+    // Maximum number of nodes across `clear`(s)
+    size_t peak_nodes = 0;
+    // Number of nodes of each type (indexed by `OpCode`)
+    std::array<size_t, N_OPCODES> nodes_by_type{};
+    size_t n_guards = 0;
+
+    // *********** Memory (bytes) ***********
+    // Node columns and side arrays of the Tape
+    size_t columns_used = 0;
+    size_t columns_reserved = 0;
+    // Arena (operands of the `BlockNode`(s))
+    size_t arena_used = 0;
+    size_t arena_reserved = 0;
+    size_t arena_high_water_mark = 0;
+    size_t arena_blocks_allocated = 0;
+    size_t arena_blocks_reused = 0;
+
+    // *********** Activity ***********
+    size_t n_clears = 0;
+    size_t n_backward = 0;
+    size_t n_replays = 0;
+    // Nodes shared instead of being recorded again (see `NodeManager::hash_consing`)
+    size_t n_cse_hits = 0;
+    double recording_time = 0.0;  // seconds
+    double backward_time = 0.0;   // seconds
+    double replay_time = 0.0;     // seconds
+
+    /**
+     * Returns the number of nodes of the given type
+     */
+    size_t nodes(OpCode op) const {
+        return nodes_by_type[static_cast<size_t>(op)];
+    }
+
+    /**
+     * Returns the statistics as a JSON object. Only the node types which
+     * appear in the Tape are listed in `nodes_by_type`.
+     */
+    std::string to_json() const {
+        std::ostringstream out;
+        out << "{"
+            << "\"n_nodes\":" << n_nodes << ","
+            << "\"peak_nodes\":" << peak_nodes << ","
+            << "\"nodes_by_type\":{";
+        bool first = true;
+        for(size_t op = 0; op < N_OPCODES; ++op) {
+            if(nodes_by_type[op] == 0) {
+                continue;
+            }
+            out << (first ? "" : ",")
+                << "\"" << to_string(static_cast<OpCode>(op)) << "\":" << nodes_by_type[op];
+            first = false;
+        }
+        out << "},"
+            << "\"n_guards\":" << n_guards << ","
+            << "\"columns\":{"
+                << "\"bytes_used\":" << columns_used << ","
+                << "\"bytes_reserved\":" << columns_reserved
+            << "},"
+            << "\"arena\":{"
+                << "\"bytes_used\":" << arena_used << ","
+                << "\"bytes_reserved\":" << arena_reserved << ","
+                << "\"high_water_mark\":" << arena_high_water_mark << ","
+                << "\"blocks_allocated\":" << arena_blocks_allocated << ","
+                << "\"blocks_reused\":" << arena_blocks_reused
+            << "},"
+            << "\"n_clears\":" << n_clears << ","
+            << "\"n_backward\":" << n_backward << ","
+            << "\"n_replays\":" << n_replays << ","
+            << "\"n_cse_hits\":" << n_cse_hits << ","
+            << "\"recording_time\":" << recording_time << ","
+            << "\"backward_time\":" << backward_time << ","
+            << "\"replay_time\":" << replay_time
+            << "}";
+        return out.str();
+    }
+};
+
+/**
+ * @brief Calls and time attributed to a node type or to a region
+ * of the Tape by the backward profiler
+ */
+struct ProfileEntry {
+    std::string name;
+    size_t calls = 0;
+    double time = 0.0;  // seconds
+};
+
+/**
+ * @brief Where the backward passes of a Tape spend their time
+ * (see `NodeManager::profile`)
+ *
+ * Every node visited by a backward pass is timed and its time is
+ * attributed both to its type and to the innermost labelled region
+ * (see `ProfileRegion`) it was recorded in. Nodes recorded outside
+ * of every region are only attributed to their type.
+ */
+struct BackwardProfile {
+    // Number of profiled backward passes
+    size_t n_sweeps = 0;
+    // Calls and time of each node type (indexed by `OpCode`)
+    std::array<size_t, N_OPCODES> calls{};
+    std::array<double, N_OPCODES> time{};
+    // Calls and time of each region, in order of first appearance
+    std::vector<ProfileEntry> regions;
+
+    /**
+     * Returns the node types which have been visited, sorted by
+     * decreasing time
+     */
+    std::vector<ProfileEntry> by_type() const {
+        std::vector<ProfileEntry> entries;
+        for(size_t op = 0; op < N_OPCODES; ++op) {
+            if(calls[op] > 0) {
+                entries.push_back({to_string(static_cast<OpCode>(op)), calls[op], time[op]});
+            }
+        }
+        sort(entries);
+        return entries;
+    }
+
+    /**
+     * Returns the regions, sorted by decreasing time
+     */
+    std::vector<ProfileEntry> by_region() const {
+        std::vector<ProfileEntry> entries = regions;
+        sort(entries);
+        return entries;
+    }
+
+    /**
+     * Returns the total time spent visiting nodes (seconds)
+     */
+    double total_time() const {
+        double total = 0.0;
+        for(double t: time) {
+            total += t;
+        }
+        return total;
+    }
+
+    /**
+     * Returns a histogram of the time by node type and by region
+     */
+    std::string histogram() const {
+        std::ostringstream out;
+        out << "backward profile (" << n_sweeps << " sweeps)\n";
+        print(out, "node type", by_type());
+        if(!regions.empty()) {
+            out << "\n";
+            print(out, "region", by_region());
+        }
+        return out.str();
+    }
+
+private:
+    static void sort(std::vector<ProfileEntry> & entries) {
+        std::stable_sort(entries.begin(), entries.end(), [](auto const & a, auto const & b) {
+            return a.time > b.time;
+        });
+    }
+
+    void print(std::ostringstream & out, std::string const & title, std::vector<ProfileEntry> const & entries) const {
+        constexpr int BAR_WIDTH = 30;
+        double total = total_time();
+
+        out << std::left << std::setw(20) << title
+            << std::right << std::setw(12) << "calls"
+            << std::setw(14) << "time (ms)"
+            << std::setw(9) << "share" << "\n";
+        for(auto const & entry: entries) {
+            double share = total > 0.0 ? entry.time / total : 0.0;
+            out << std::left << std::setw(20) << entry.name
+                << std::right << std::setw(12) << entry.calls
+                << std::setw(14) << std::fixed << std::setprecision(3) << entry.time * 1e3
+                << std::setw(8) << std::setprecision(1) << share * 100.0 << "% "
+                << std::string(static_cast<size_t>(share * BAR_WIDTH + 0.5), '#') << "\n";
+        }
+    }
+};
+
+/**
+ * @class Stopwatch
+ * @brief Adds the time elapsed during its lifetime to `total` (in seconds),
+ * if `enabled`
+ */
+class Stopwatch {
+    using Clock = std::chrono::steady_clock;
+public:
+    Stopwatch(bool enabled, double & total):
+        total_{enabled ? &total : nullptr}
+    {
+        if(total_) {
+            start_ = Clock::now();
+        }
+    }
+
+    Stopwatch(Stopwatch const &) = delete;
+    Stopwatch& operator=(Stopwatch const &) = delete;
+
+    ~Stopwatch() {
+        if(total_) {
+            *total_ += std::chrono::duration<double>(Clock::now() - start_).count();
+        }
+    }
+
+private:
+    double * total_;
+    Clock::time_point start_;
+};
+
+}; // namespace reverse
+}; // namespace autodiff
@@ -2,6 +2,10 @@
 
 #include "NodeManager.hpp"
 #include "Functions.hpp"
+#include "Expression.hpp"
+
+#include <type_traits>
+#include <utility>
 
 namespace autodiff {
 namespace reverse {
@@ -29,6 +33,15 @@ public:
         node_idx_ = new_node<T>(value);
     }
 
+    /**
+     * Records the statement `expr` in the Tape (see `Expression.hpp`)
+     * and creates a new Var which tracks the resulting node
+     *
+     * @param expr The right-hand side of the statement
+     */
+    template <Expression E>
+    Var(E const & expr): node_idx_{expr.record()} {}
+
     /**
      * Computes the derivative of this variable wrt all the input variables
      */
@@ -51,305 +64,318 @@ public:
         return NodeManager<T>::instance().get_node_value(node_idx_);
     }
 
-    /******** Math functions/operators ********/
-    Var<T> operator+() const {
-        return *this;
+    /******** Compound assignment operators ********/
+    // `rhs` can be a `Var`, an expression or a scalar
+    template <typename R>
+    Var<T> & operator+=(R const & rhs) {
+        return *this = *this + rhs;
     }
-    Var<T> operator+(Var<T> const & rhs) const {
-        size_t idx = new_node<AddNode, T>(node_idx_, rhs.node_idx_);
-        return new_var_from_idx(idx);
+    template <typename R>
+    Var<T> & operator-=(R const & rhs) {
+        return *this = *this - rhs;
     }
-    Var<T> operator+(T const & rhs) const {
-        return *this + Var<T>{rhs};
+    template <typename R>
+    Var<T> & operator*=(R const & rhs) {
+        return *this = *this * rhs;
     }
-    Var<T> & operator+=(Var<T> const & rhs) {
-        node_idx_ = new_node<AddNode, T>(node_idx_, rhs.node_idx_);
-        return *this;
+    template <typename R>
+    Var<T> & operator/=(R const & rhs) {
+        return *this = *this / rhs;
     }
-    Var<T> & operator+=(T const & rhs) {
-        Var<T> tmp = Var<T>{rhs};
-        node_idx_ = new_node<AddNode, T>(node_idx_, tmp.node_idx_);
-        return *this;
-    }
-
 
-    Var<T> operator-() const {
-        size_t idx = new_node<NegNode, T>(node_idx_);
-        return new_var_from_idx(idx);
-    }
-    Var<T> operator-(Var<T> const & rhs) const {
-        size_t idx = new_node<SubNode, T>(node_idx_, rhs.node_idx_);
-        return new_var_from_idx(idx);
-    }
-    Var<T> operator-(T const & rhs) const {
-        return *this - Var<T>{rhs};
-    }
-    Var<T> & operator-=(Var<T> const & rhs) {
-        node_idx_ = new_node<SubNode, T>(node_idx_, rhs.node_idx_);
-        return *this;
-    }
-    Var<T> & operator-=(T const & rhs) {
-        Var<T> tmp = Var<T>{rhs};
-        node_idx_ = new_node<SubNode, T>(node_idx_, tmp.node_idx_);
-        return *this;
+    /**
+     * Returns the index of the `Node` tracked by this variable in the
+     * active Tape
+     */
+    size_t index() const {
+        return node_idx_;
     }
 
-
-    Var<T> operator*(Var<T> const & rhs) const {
-        size_t idx = new_node<ProdNode, T>(node_idx_, rhs.node_idx_);
-        return new_var_from_idx(idx);
-    }
-    Var<T> operator*(T const & rhs) const {
-        return *this * Var<T>{rhs};
-    }
-    Var<T> & operator*=(Var<T> const & rhs) {
-        node_idx_ = new_node<ProdNode, T>(node_idx_, rhs.node_idx_);
-        return *this;
-    }
-    Var<T> & operator*=(T const & rhs) {
-        Var<T> tmp = Var<T>{rhs};
-        node_idx_ = new_node<ProdNode, T>(node_idx_, tmp.node_idx_);
-        return *this;
+    /**
+     * Creates a Var which tracks an already existing `Node` of the
+     * active Tape
+     *
+     * @param idx The index of the `Node`
+     */
+    static Var<T> from_index(size_t idx) {
+        Var<T> var;
+        var.node_idx_ = idx;
+        return var;
     }
 
+private:
+    /**
+     * The index of the `Node` which is tracked by this variable
+     */
+    size_t node_idx_;
+};
 
-    Var<T> operator/(Var<T> const & rhs) const {
-        size_t idx = new_node<DivNode, T>(node_idx_, rhs.node_idx_);
-        return new_var_from_idx(idx);
-    }
-    Var<T> operator/(T const & rhs) const {
-        return *this / Var<T>{rhs};
-    }
-    Var<T> & operator/=(Var<T> const & rhs) {
-        node_idx_ = new_node<DivNode, T>(node_idx_, rhs.node_idx_);
-        return *this;
-    }
-    Var<T> & operator/=(T const & rhs) {
-        Var<T> tmp = Var<T>{rhs};
-        node_idx_ = new_node<DivNode, T>(node_idx_, tmp.node_idx_);
-        return *this;
-    }
+/******** Expressions *******/
+// Operands of the operators below: `Var`(s) and expressions.
+// A `Var` appears in an expression as a leaf.
+template <typename E>
+struct is_var : std::false_type {};
 
-    template <typename U>
-    friend Var<U> abs(Var<U> const & arg);
+template <typename U>
+struct is_var<Var<U>> : std::true_type {};
 
-    template <typename U>
-    friend Var<U> cos(Var<U> const & arg);
+template <typename E>
+concept Operand = is_var<E>::value || Expression<E>;
 
-    template <typename U>
-    friend Var<U> sin(Var<U> const & arg);
+template <typename U>
+LeafExpr<U> as_expression(Var<U> const & var) {
+    return LeafExpr<U>{static_cast<NodeIdx>(var.index())};
+}
 
-    template <typename U>
-    friend Var<U> tan(Var<U> const & arg);
+template <Expression E>
+E const & as_expression(E const & expr) {
+    return expr;
+}
 
-    template <typename U>
-    friend Var<U> log(Var<U> const & arg);
+template <typename E>
+using expr_t = std::remove_cvref_t<decltype(as_expression(std::declval<E const &>()))>;
 
-    template <typename U>
-    friend Var<U> relu(Var<U> const & arg);
+template <typename E>
+using scalar_t = typename expr_t<E>::Scalar;
 
-    template <typename U>
-    friend Var<U> tanh(Var<U> const & arg);
+template <typename U>
+Var<U> const & as_var(Var<U> const & var) {
+    return var;
+}
 
-    template <typename U>
-    friend Var<U> pow(Var<U> const & base, Var<U> const & exp);
+template <Expression E>
+Var<typename E::Scalar> as_var(E const & expr) {
+    return Var<typename E::Scalar>(expr);
+}
 
-    template <typename U>
-    friend Var<U> pow(Var<U> const & base, U const & exp);
+/******** Math functions/operators *******/
+// Nothing is recorded until the result is converted to a `Var`
+//  (see `Expression.hpp`).
+// The scalar operands are stored inline in the Tape (see `ScalarNode`)
+template <Operand E>
+E operator+(E const & arg) {
+    return arg;
+}
 
-    template <typename U>
-    friend Var<U> pow(U const & base, Var<U> const & exp);
+template <Operand E>
+auto operator-(E const & arg) {
+    return UnaryExpr<NegNode, expr_t<E>>{as_expression(arg)};
+}
 
-    template <typename U>
-    friend Var<U> exp(Var<U> const & arg);
+template <Operand L, Operand R>
+auto operator+(L const & lhs, R const & rhs) {
+    return BinaryExpr<AddNode, expr_t<L>, expr_t<R>>{as_expression(lhs), as_expression(rhs)};
+}
 
-    template <typename U>
-    friend Var<U> sqrt(Var<U> const & arg);
+template <Operand E>
+auto operator+(E const & lhs, scalar_t<E> const & rhs) {
+    return ScalarExpr<AddConstNode, expr_t<E>>{as_expression(lhs), rhs};
+}
 
-    /******** Other Operators ********/
-    bool operator<(Var<T> const & rhs) const {
-        return (value() < rhs.value());
-    }
-    bool operator<(T const & rhs) const {
-        return (value() < rhs);
-    }
+template <Operand E>
+auto operator+(scalar_t<E> const & lhs, E const & rhs) {
+    return ScalarExpr<AddConstNode, expr_t<E>>{as_expression(rhs), lhs};
+}
 
-    bool operator>(Var<T> const & rhs) const {
-        return (value() > rhs.value());
-    }
-    bool operator>(T const & rhs) const {
-        return (value() > rhs);
-    }
+template <Operand L, Operand R>
+auto operator-(L const & lhs, R const & rhs) {
+    return BinaryExpr<SubNode, expr_t<L>, expr_t<R>>{as_expression(lhs), as_expression(rhs)};
+}
 
-    bool operator==(Var<T> const & rhs) const {
-        return (value() == rhs.value());
-    }
-    bool operator==(T const & rhs) const {
-        return (value() == rhs);
-    }
+template <Operand E>
+auto operator-(E const & lhs, scalar_t<E> const & rhs) {
+    return ScalarExpr<AddConstNode, expr_t<E>>{as_expression(lhs), scalar_t<E>{-rhs}};
+}
 
-    bool operator!=(Var<T> const & rhs) const {
-        return !(*this == rhs);
-    }
-    bool operator!=(T const & rhs) const {
-        return !(*this == rhs);
-    }
+template <Operand E>
+auto operator-(scalar_t<E> const & lhs, E const & rhs) {
+    return ScalarExpr<ConstSubNode, expr_t<E>>{as_expression(rhs), lhs};
+}
 
-    bool operator<=(Var<T> const & rhs) const {
-        return (*this < rhs) || (*this == rhs);
-    }
-    bool operator<=(T const & rhs) const {
-        return (*this < rhs) || (*this == rhs);
-    }
+template <Operand L, Operand R>
+auto operator*(L const & lhs, R const & rhs) {
+    return BinaryExpr<ProdNode, expr_t<L>, expr_t<R>>{as_expression(lhs), as_expression(rhs)};
+}
 
-    bool operator>=(Var<T> const & rhs) const {
-        return (*this > rhs) || (*this == rhs);
-    }
-    bool operator>=(T const & rhs) const {
-        return (*this > rhs) || (*this == rhs);
-    }
+template <Operand E>
+auto operator*(E const & lhs, scalar_t<E> const & rhs) {
+    return ScalarExpr<ScaleNode, expr_t<E>>{as_expression(lhs), rhs};
+}
 
-private:
-    /**
-     * Creates a new variable from a given index and returns it
-     */
-    static Var<T> new_var_from_idx(size_t idx) {
-        Var<T> tmp;
-        tmp.node_idx_ = idx;
-        return tmp;
-    }
+template <Operand E>
+auto operator*(scalar_t<E> const & lhs, E const & rhs) {
+    return ScalarExpr<ScaleNode, expr_t<E>>{as_expression(rhs), lhs};
+}
 
-    /**
-     * The index of the `Node` which is tracked by this variable
-     */
-    size_t node_idx_;
-};
+template <Operand L, Operand R>
+auto operator/(L const & lhs, R const & rhs) {
+    return BinaryExpr<DivNode, expr_t<L>, expr_t<R>>{as_expression(lhs), as_expression(rhs)};
+}
 
-/******** Math functions/operators *******/
-template <typename U>
-Var<U> operator+(U const & lhs, Var<U> const & rhs) {
-    return Var<U>{lhs} + rhs;
+template <Operand E>
+auto operator/(E const & lhs, scalar_t<E> const & rhs) {
+    return ScalarExpr<DivConstNode, expr_t<E>>{as_expression(lhs), rhs};
 }
 
-template <typename U>
-Var<U> operator-(U const & lhs, Var<U> const & rhs) {
-    return Var<U>{lhs} - rhs;
+template <Operand E>
+auto operator/(scalar_t<E> const & lhs, E const & rhs) {
+    return ScalarExpr<ConstDivNode, expr_t<E>>{as_expression(rhs), lhs};
 }
 
-template <typename U>
-Var<U> operator*(U const & lhs, Var<U> const & rhs) {
-    return Var<U>{lhs} * rhs;
+template <Operand E>
+auto abs(E const & arg) {
+    return UnaryExpr<AbsNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> operator/(U const & lhs, Var<U> const & rhs) {
-    return Var<U>{lhs} / rhs;
+template <Operand E>
+auto cos(E const & arg) {
+    return UnaryExpr<CosNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> abs(Var<U> const & arg) {
-    size_t idx = new_node<AbsNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto sin(E const & arg) {
+    return UnaryExpr<SinNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> cos(Var<U> const & arg) {
-    size_t idx = new_node<CosNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto tan(E const & arg) {
+    return UnaryExpr<TanNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> sin(Var<U> const & arg) {
-    size_t idx = new_node<SinNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto log(E const & arg) {
+    return UnaryExpr<LogNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> tan(Var<U> const & arg) {
-    size_t idx = new_node<TanNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto relu(E const & arg) {
+    return UnaryExpr<ReluNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> log(Var<U> const & arg) {
-    size_t idx = new_node<LogNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto tanh(E const & arg) {
+    return UnaryExpr<TanhNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> relu(Var<U> const & arg) {
-    size_t idx = new_node<ReluNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand L, Operand R>
+auto pow(L const & base, R const & exp) {
+    return BinaryExpr<PowNode, expr_t<L>, expr_t<R>>{as_expression(base), as_expression(exp)};
 }
 
-template <typename U>
-Var<U> tanh(Var<U> const & arg) {
-    size_t idx = new_node<TanhNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto pow(E const & base, scalar_t<E> const & exp) {
+    return ScalarExpr<PowConstNode, expr_t<E>>{as_expression(base), exp};
 }
 
-template <typename U>
-Var<U> pow(Var<U> const & base, Var<U> const & exp) {
-    size_t idx = new_node<PowNode, U>(base.node_idx_, exp.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto pow(scalar_t<E> const & base, E const & exp) {
+    return ScalarExpr<ConstPowNode, expr_t<E>>{as_expression(exp), base};
 }
 
-template <typename U>
-Var<U> pow(Var<U> const & base, U const & exp) {
-    Var<U> tmp = Var<U>{exp};
-    size_t idx = new_node<PowNode, U>(base.node_idx_, tmp.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto exp(E const & arg) {
+    return UnaryExpr<ExpNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> pow(U const & base, Var<U> const & exp) {
-    Var<U> tmp = Var<U>{base};
-    size_t idx = new_node<PowNode, U>(tmp.node_idx_, exp.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+auto sqrt(E const & arg) {
+    return UnaryExpr<SqrtNode, expr_t<E>>{as_expression(arg)};
 }
 
-template <typename U>
-Var<U> exp(Var<U> const & arg) {
-    size_t idx = new_node<ExpNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+/******** Other Operators ********/
+// Every comparison is recorded in the Tape as a guard
+//  (see `NodeManager::forward`).
+// Expressions are recorded first, so that the guard can refer to their node
+template <Operand L, Operand R>
+bool compare(CmpOp op, L const & lhs, R const & rhs) {
+    size_t lhs_idx = as_var(lhs).index();
+    size_t rhs_idx = as_var(rhs).index();
+    return NodeManager<scalar_t<L>>::instance().compare(op, lhs_idx, rhs_idx);
 }
 
-template <typename U>
-Var<U> sqrt(Var<U> const & arg) {
-    size_t idx = new_node<SqrtNode, U>(arg.node_idx_);
-    return Var<U>::new_var_from_idx(idx);
+template <Operand E>
+bool compare(CmpOp op, E const & lhs, scalar_t<E> const & rhs) {
+    size_t lhs_idx = as_var(lhs).index();
+    return NodeManager<scalar_t<E>>::instance().compare(op, lhs_idx, rhs);
 }
 
-/******** Other Operators ********/
-template <typename U>
-bool operator<(U const & lhs, Var<U> const & rhs) {
-    return (lhs < rhs.value());
+template <Operand L, Operand R>
+bool operator<(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Lt, lhs, rhs);
+}
+template <Operand E>
+bool operator<(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Lt, lhs, rhs);
+}
+template <Operand E>
+bool operator<(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Gt, rhs, lhs);
 }
 
-template <typename U>
-bool operator>(U const & lhs, Var<U> const & rhs) {
-    return (lhs > rhs.value());
+template <Operand L, Operand R>
+bool operator>(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Gt, lhs, rhs);
+}
+template <Operand E>
+bool operator>(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Gt, lhs, rhs);
+}
+template <Operand E>
+bool operator>(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Lt, rhs, lhs);
 }
 
-template <typename U>
-bool operator==(U const & lhs, Var<U> const & rhs) {
-    return (lhs == rhs.value());
+template <Operand L, Operand R>
+bool operator==(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Eq, lhs, rhs);
+}
+template <Operand E>
+bool operator==(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Eq, lhs, rhs);
+}
+template <Operand E>
+bool operator==(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Eq, rhs, lhs);
 }
 
-template <typename U>
-bool operator!=(U const & lhs, Var<U> const & rhs) {
-    return (lhs != rhs.value());
+template <Operand L, Operand R>
+bool operator!=(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Ne, lhs, rhs);
+}
+template <Operand E>
+bool operator!=(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Ne, lhs, rhs);
+}
+template <Operand E>
+bool operator!=(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Ne, rhs, lhs);
 }
 
-template <typename U>
-bool operator<=(U const & lhs, Var<U> const & rhs) {
-    return (lhs <= rhs.value());
+template <Operand L, Operand R>
+bool operator<=(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Le, lhs, rhs);
+}
+template <Operand E>
+bool operator<=(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Le, lhs, rhs);
+}
+template <Operand E>
+bool operator<=(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Ge, rhs, lhs);
 }
 
-template <typename U>
-bool operator>=(U const & lhs, Var<U> const & rhs) {
-    return (lhs >= rhs.value());
+template <Operand L, Operand R>
+bool operator>=(L const & lhs, R const & rhs) {
+    return compare(CmpOp::Ge, lhs, rhs);
+}
+template <Operand E>
+bool operator>=(E const & lhs, scalar_t<E> const & rhs) {
+    return compare(CmpOp::Ge, lhs, rhs);
+}
+template <Operand E>
+bool operator>=(scalar_t<E> const & lhs, E const & rhs) {
+    return compare(CmpOp::Le, rhs, lhs);
 }
 
 }; // namespace reverse
-}; // namespace autodiff 
+}; // namespace autodiff
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <random>
+
+#include "Var.hpp"
+#include "NodeManager.hpp"
+#include "NeuralModel.h"
+
+// same network as NeuralModel, but the gradient of the batch loss is computed
+// in reverse mode: the loss is recorded once on a Tape and a single backward
+// pass gives the derivatives wrt all the 3H+1 parameters, instead of one
+// forward pass per parameter
+class NeuralModelReverse : public NeuralModel
+{
+protected:
+    using RVar = autodiff::reverse::Var<double>;
+    using RTape = autodiff::reverse::Tape<double>;
+
+    // the parameters are the first leaves of the tape: they are recorded once
+    // per fit and survive the rewinds, only their values change between batches
+    static std::vector<RVar> record_params(const std::vector<double>& params)
+    {
+        std::vector<RVar> p;
+        p.reserve(params.size());
+        for (double v : params)
+            p.emplace_back(v);
+        return p;
+    }
+
+    RVar loss_func(const std::vector<std::pair<double, double>>& batch,
+                   std::span<const RVar> p) const
+    {
+        auto w1 = p.subspan(0, hidden_size);
+        auto b1 = p.subspan(hidden_size, hidden_size);
+        auto w2 = p.subspan(2 * hidden_size, hidden_size);
+        const RVar& b2 = p[3 * hidden_size];
+
+        RVar accum = 0.0;
+        std::vector<RVar> hidden(hidden_size);
+        for (const auto& [x, y] : batch)
+        {
+            //forward of 1 -> hidden
+            for (int i = 0; i < hidden_size; i++)
+                hidden[i] = tanh(w1[i] * x + b1[i]);
+
+            //forward of hidden -> 1
+            RVar out = b2;
+            for (int j = 0; j < hidden_size; j++)
+                out = out + hidden[j] * w2[j];
+
+            RVar diff = out - y;
+            accum = accum + diff * diff;
+        }
+        return accum / static_cast<double>(batch.size());
+    }
+
+    // gradient of the loss of a batch wrt the parameters: `tape` must be the
+    // active tape, `p` its parameters and `mark` the tape right after them
+    std::vector<double> batch_gradient(RTape& tape,
+                                       const std::vector<RVar>& p,
+                                       const RTape::Mark& mark,
+                                       const std::vector<std::pair<double, double>>& batch) const
+    {
+        for (size_t j = 0; j < p.size(); ++j)
+            tape.set_node_value(p[j].index(), params[j]);
+
+        RVar loss = loss_func(batch, p);
+        loss.backward();
+
+        std::vector<double> grad(p.size());
+        for (size_t j = 0; j < p.size(); ++j)
+            grad[j] = p[j].grad();
+
+        //drops the nodes of the batch, keeping the memory for the next one
+        tape.rewind(mark);
+        return grad;
+    }
+
+public:
+    NeuralModelReverse(Optimizer* optimizer,
+                       const int hidden_size,
+                       const int epochs = 50,
+                       const int batch_size = 10): NeuralModel(optimizer, hidden_size, epochs, batch_size){}
+
+    void fit(std::vector<std::pair<double, double>>& data) override
+    {
+        RTape tape;
+        autodiff::reverse::ActiveTape<double> active(tape);
+        std::vector<RVar> p = record_params(params);
+        auto mark = tape.mark();
+
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            //same shuffling as NeuralModel, so both models see the same batches
+            std::shuffle(data.begin(), data.end(), std::mt19937(epoch));
+            for (int i = 0; i < data.size(); i+= batch_size)
+            {
+                auto batch_end = std::min(i + batch_size, static_cast<int>(data.size()));
+                std::vector<std::pair<double, double>> batch(data.begin() + i, data.begin() + batch_end);
+
+                auto grad = batch_gradient(tape, p, mark, batch);
+                optimizer->update(params, grad);
+            }
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <random>
+#include <memory>
+
+#include <omp.h>
+#include "NeuralModelReverse.h"
+
+// same meta-batch scheme as NeuralModelOpenmp (one minibatch per thread, weighted
+// average of the gradients), with the reverse-mode gradient of NeuralModelReverse:
+// every thread records on its own tape
+class NeuralModelReverseOpenmp : public NeuralModelReverse
+{
+public:
+    NeuralModelReverseOpenmp(Optimizer* optimizer,
+                             const int hidden_size,
+                             const int epochs = 50,
+                             const int batch_size = 10): NeuralModelReverse(optimizer, hidden_size, epochs, batch_size){}
+
+    void fit(std::vector<std::pair<double, double>>& data) override
+    {
+        int num_concurrent_batches = omp_get_max_threads();
+        if (num_concurrent_batches <= 0) num_concurrent_batches = 1;
+
+        //one tape (with its parameters) per thread, kept for the whole fit
+        std::vector<std::unique_ptr<RTape>> tapes(num_concurrent_batches);
+        std::vector<std::vector<RVar>> thread_params(num_concurrent_batches);
+        std::vector<RTape::Mark> marks(num_concurrent_batches);
+        for (int k = 0; k < num_concurrent_batches; ++k)
+        {
+            tapes[k] = std::make_unique<RTape>();
+            autodiff::reverse::ActiveTape<double> active(*tapes[k]);
+            thread_params[k] = record_params(params);
+            marks[k] = tapes[k]->mark();
+        }
+
+        for (int epoch = 0; epoch < epochs; epoch++)
+        {
+            std::shuffle(data.begin(), data.end(), std::mt19937(epoch));
+
+            for (size_t i = 0; i < data.size(); i += (size_t)batch_size * num_concurrent_batches)
+            {
+                std::vector<std::vector<double>> batch_gradients(num_concurrent_batches);
+                std::vector<int> actual_samples_in_batch(num_concurrent_batches, 0);
+
+                #pragma omp parallel num_threads(num_concurrent_batches)
+                {
+                    int thread_id = omp_get_thread_num();
+                    size_t current_batch_start_index = i + (size_t)thread_id * batch_size;
+                    if (current_batch_start_index < data.size())
+                    {
+                        auto batch_end_iter = data.begin() + std::min(current_batch_start_index + batch_size, data.size());
+                        std::vector<std::pair<double, double>> current_thread_batch(
+                            data.begin() + current_batch_start_index,
+                            batch_end_iter
+                        );
+
+                        autodiff::reverse::ActiveTape<double> active(*tapes[thread_id]);
+                        actual_samples_in_batch[thread_id] = current_thread_batch.size();
+                        batch_gradients[thread_id] = batch_gradient(*tapes[thread_id], thread_params[thread_id],
+                                                                    marks[thread_id], current_thread_batch);
+                    }
+                } // End of OpenMP parallel region
+
+                std::vector<double> aggregated_grad(params.size(), 0.0);
+                double total_samples_processed_in_meta_batch = 0;
+                for (int k = 0; k < num_concurrent_batches; ++k)
+                {
+                    if (actual_samples_in_batch[k] > 0)
+                    {
+                        //weighted average, the last minibatch may be smaller
+                        for (size_t j = 0; j < params.size(); ++j)
+                            aggregated_grad[j] += batch_gradients[k][j] * static_cast<double>(actual_samples_in_batch[k]);
+                        total_samples_processed_in_meta_batch += actual_samples_in_batch[k];
+                    }
+                }
+
+                if (total_samples_processed_in_meta_batch > 0)
+                {
+                    for (size_t j = 0; j < params.size(); ++j)
+                        aggregated_grad[j] /= total_samples_processed_in_meta_batch;
+                    optimizer->update(params, aggregated_grad);
+                }
+            }
+        }
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <Eigen/Dense>
 #include <omp.h>
 
@@ -50,15 +51,23 @@ protected:
  * @brief ReverseJac allows to solve systems involving
  *  the jacobian of a given non-linear function using
  *  reverse-mode automatic differtentiation
+ *
+ * By default the function is recorded again at every call to `solve`.
+ *  With `replay` its Tape is recorded at the first call and then replayed
+ *  at every subsequent Newton iteration (see
+ *  `autodiff::reverse::RecordedJacobian`): the function must then depend
+ *  on its input only through `Var` operations, otherwise `solve` throws
+ *  `std::logic_error`
  */
 class ReverseJac final : public JacobianBase {
 public:
-    ReverseJac(RvNLSType const & fn);
+    ReverseJac(RvNLSType const & fn, bool replay = false);
 
     RealVec solve(const RealVec & x, RealVec & resid) override;
 
 protected:
     RvNLSType const & fn_;
+    std::unique_ptr<autodiff::reverse::RecordedJacobian> recorded_jac_;
 };
 
 #ifdef __CUDACC__
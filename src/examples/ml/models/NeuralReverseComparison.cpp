@@ -0,0 +1,121 @@
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
+#include <functional>
+
+#include "NeuralModel.h"
+#include "NeuralModelOptimized.h"
+#include "NeuralModelOpenmp.h"
+#include "NeuralModelReverse.h"
+#include "NeuralModelReverseOpenmp.h"
+#include "Adam.h"
+
+// Forward mode (one pass per parameter, 3H+1 passes per batch) against
+// reverse mode (one recording and one backward pass per batch) when
+// training the same network for growing hidden sizes
+
+#define TARGET_FUNCTION(x) (std::sin(2 * 3.14159265358979323846 * x) + 0.3 * x * x * x)
+
+static std::vector<std::pair<double,double>> make_data(int N, double x_min, double x_max) {
+    std::vector<std::pair<double,double>> data;
+    std::mt19937 rng(42);
+    std::normal_distribution<double> noise(0.0, 0.1);
+
+    for(int i = 0; i < N; ++i){
+        double x = x_min + (static_cast<double>(i) / (N - 1)) * (x_max - x_min);
+        double y = TARGET_FUNCTION(x) + noise(rng);
+        data.emplace_back(x,y);
+    }
+    return data;
+}
+
+// trains the model on a copy of the data and returns the time in ms
+static long long time_fit(IModel& model, std::vector<std::pair<double,double>> data) {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    model.fit(data);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+}
+
+static double max_abs_difference(const std::vector<double>& a, const std::vector<double>& b) {
+    double diff = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        diff = std::max(diff, std::abs(a[i] - b[i]));
+    return diff;
+}
+
+int main(){
+    std::cout << "--- Forward vs Reverse mode training ---\n";
+
+    const int DATA_SIZE = 100;
+    const double X_MIN = -2.0;
+    const double X_MAX = 3.0;
+    const int EPOCHS = 50;
+    const int BATCH_SIZE = 5;
+
+    std::vector<int> hidden_sizes = {1, 2, 4, 8, 16, 32, 64, 128};
+    auto data = make_data(DATA_SIZE, X_MIN, X_MAX);
+
+    std::ofstream performance_csv("performance_reverse.csv");
+    performance_csv << "HiddenSize,Forward_ms,ForwardOptimized_ms,ForwardOpenMP_ms,Reverse_ms,ReverseOpenMP_ms,MaxParamDiff\n";
+
+    std::cout << std::left << std::setw(12) << "Hidden"
+              << std::setw(14) << "Forward"
+              << std::setw(14) << "Fwd optim."
+              << std::setw(14) << "Fwd OpenMP"
+              << std::setw(14) << "Reverse"
+              << std::setw(14) << "Rev OpenMP"
+              << "Max |p_fwd - p_rev|\n";
+    std::cout << std::string(100, '-') << "\n";
+
+    int crossover = -1;
+    for (int hidden_size : hidden_sizes) {
+        Adam adam_forward(0.03), adam_optimized(0.03), adam_openmp(0.03), adam_reverse(0.03), adam_reverse_openmp(0.03);
+        NeuralModel forward_model(&adam_forward, hidden_size, EPOCHS, BATCH_SIZE);
+        NeuralModelOptimized optimized_model(&adam_optimized, hidden_size, EPOCHS, BATCH_SIZE);
+        NeuralModelOpenmp openmp_model(&adam_openmp, hidden_size, EPOCHS, BATCH_SIZE);
+        NeuralModelReverse reverse_model(&adam_reverse, hidden_size, EPOCHS, BATCH_SIZE);
+        NeuralModelReverseOpenmp reverse_openmp_model(&adam_reverse_openmp, hidden_size, EPOCHS, BATCH_SIZE);
+
+        long long ms_forward = time_fit(forward_model, data);
+        long long ms_optimized = time_fit(optimized_model, data);
+        long long ms_openmp = time_fit(openmp_model, data);
+        long long ms_reverse = time_fit(reverse_model, data);
+        long long ms_reverse_openmp = time_fit(reverse_openmp_model, data);
+
+        // same initialization and same batches: both modes must train the same parameters
+        double param_diff = max_abs_difference(forward_model.get_params(), reverse_model.get_params());
+
+        if (crossover < 0 && ms_reverse < ms_forward)
+            crossover = hidden_size;
+
+        std::cout << std::left << std::setw(12) << hidden_size
+                  << std::setw(14) << ms_forward
+                  << std::setw(14) << ms_optimized
+                  << std::setw(14) << ms_openmp
+                  << std::setw(14) << ms_reverse
+                  << std::setw(14) << ms_reverse_openmp
+                  << param_diff << "\n";
+        performance_csv << hidden_size << ","
+                        << ms_forward << ","
+                        << ms_optimized << ","
+                        << ms_openmp << ","
+                        << ms_reverse << ","
+                        << ms_reverse_openmp << ","
+                        << param_diff << "\n";
+    }
+
+    std::cout << std::string(100, '-') << "\n";
+    if (crossover > 0)
+        std::cout << "Reverse mode is faster than forward mode from hidden size " << crossover << "\n";
+    else
+        std::cout << "Reverse mode is never faster than forward mode in this sweep\n";
+    std::cout << "Performance data saved to performance_reverse.csv\n";
+
+    return 0;
+}
@@ -11,12 +11,20 @@ JacobianTraits::RealVec ForwardJac::solve(const RealVec & x, RealVec & resid) {
     return J.fullPivLu().solve(resid);
 }
 
-ReverseJac::ReverseJac(RvNLSType const & fn): fn_{fn} {}
+ReverseJac::ReverseJac(RvNLSType const & fn, bool replay): fn_{fn} {
+    if(replay) {
+        recorded_jac_ = std::make_unique<autodiff::reverse::RecordedJacobian>(fn);
+    }
+}
 
 JacobianTraits::RealVec ReverseJac::solve(const RealVec & x, RealVec & resid) {
     JacType J;
     // update the jacobian
-    autodiff::reverse::jacobian(fn_, x, resid, J);
+    if(recorded_jac_) {
+        (*recorded_jac_)(x, resid, J);
+    } else {
+        autodiff::reverse::jacobian(fn_, x, resid, J);
+    }
     return J.fullPivLu().solve(resid);
 }
 
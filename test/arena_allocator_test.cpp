@@ -1,3 +1,5 @@
+#include <cstdint>
+#include <cstring>
 #include <gtest/gtest.h>
 #include "ArenaAllocator.hpp"
 
@@ -11,7 +13,7 @@ using namespace autodiff::reverse;
 constexpr size_t BLOCK_SIZE = 4096;
 
 TEST(ArenaAllocatorTest, StateNewObject) {
-    ArenaAllocator<BLOCK_SIZE> arena;
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
     ASSERT_EQ(arena.n_blocks(), 1);
     ASSERT_EQ(arena.total_size(), 1*BLOCK_SIZE);
     ASSERT_EQ(arena.remaining_size(), BLOCK_SIZE);
@@ -19,7 +21,7 @@ TEST(ArenaAllocatorTest, StateNewObject) {
 }
 
 TEST(ArenaAllocatorTest, StateAfterClear) {
-    ArenaAllocator<BLOCK_SIZE> arena;
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
 
     arena.alloc(BLOCK_SIZE-10, 8);
     arena.alloc(BLOCK_SIZE-10, 8);
@@ -38,13 +40,13 @@ TEST(ArenaAllocatorTest, StateAfterClear) {
 
 // This shouldn't compile
 // TEST(ArenaAllocatorTest, CannotCopy) {
-//     ArenaAllocator<BLOCK_SIZE> arena1;
-//     ArenaAllocator<BLOCK_SIZE> arena2;
+//     ArenaAllocator arena1{ArenaPolicy{BLOCK_SIZE}};
+//     ArenaAllocator arena2{ArenaPolicy{BLOCK_SIZE}};
 //     arena2 = arena1;
 // }
 
 TEST(ArenaAllocatorTest, Move) {
-    ArenaAllocator<BLOCK_SIZE> arena1;
+    ArenaAllocator arena1{ArenaPolicy{BLOCK_SIZE}};
     arena1.alloc(BLOCK_SIZE-10, 8);
     arena1.alloc(BLOCK_SIZE-10, 8);
     arena1.alloc(BLOCK_SIZE-10, 8);
@@ -55,13 +57,13 @@ TEST(ArenaAllocatorTest, Move) {
     size_t remaining_size = arena1.remaining_size();
     void * data = arena1.data();
 
-    ArenaAllocator<BLOCK_SIZE> arena2(std::move(arena1));
+    ArenaAllocator arena2(std::move(arena1));
     ASSERT_EQ(arena2.n_blocks(), n_blocks);
     ASSERT_EQ(arena2.current_block(), current_block);
     ASSERT_EQ(arena2.remaining_size(), remaining_size);
     ASSERT_EQ(arena2.data(), data);
 
-    ArenaAllocator<BLOCK_SIZE> arena3;
+    ArenaAllocator arena3{ArenaPolicy{BLOCK_SIZE}};
     arena3 = std::move(arena2);
     ASSERT_EQ(arena3.n_blocks(), n_blocks);
     ASSERT_EQ(arena3.current_block(), current_block);
@@ -70,17 +72,129 @@ TEST(ArenaAllocatorTest, Move) {
 }
 
 TEST(ArenaAllocator, AllocExceptionNotPowerOfTwo) {
-    ArenaAllocator<BLOCK_SIZE> arena;
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
 
     EXPECT_THROW(
         arena.alloc(10, 3)
     , std::invalid_argument);
 }
 
-TEST(ArenaAllocator, AllocExceptionSizeTooBig) {
-    ArenaAllocator<BLOCK_SIZE> arena;
+TEST(ArenaAllocator, LargeObject) {
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
 
-    EXPECT_THROW(
-        arena.alloc(BLOCK_SIZE+1, 2)
-    , std::bad_alloc);
+    // bigger than a block and than `large_object_size`:
+    //  the object gets its own allocation
+    size_t size = ArenaPolicy{}.large_object_size + 1;
+    void * ptr = arena.alloc(size, 64);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % 64, 0);
+    std::memset(ptr, 0, size);
+    ASSERT_EQ(arena.n_blocks(), 1);
+    ASSERT_EQ(arena.n_large_objects(), 1);
+    ASSERT_GE(arena.used_size(), size);
+
+    // the allocation is reused after a clear
+    size_t total_size = arena.total_size();
+    arena.clear();
+    arena.alloc(size, 64);
+    ASSERT_EQ(arena.total_size(), total_size);
+
+    // bigger than a block but still placed in a (bigger) block
+    arena.alloc(2*BLOCK_SIZE, 8);
+    ASSERT_EQ(arena.n_blocks(), 2);
+    ASSERT_EQ(arena.n_large_objects(), 1);
+}
+
+TEST(ArenaAllocator, GeometricGrowth) {
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
+
+    // 2 + 4 + 8 + 16 + 32 allocations in blocks of
+    //  4096, 8192, 16384, 32768 and 65536 bytes
+    for(size_t i = 0; i < 62; ++i) {
+        arena.alloc(BLOCK_SIZE/2, 8);
+    }
+    ASSERT_EQ(arena.n_blocks(), 5);
+    ASSERT_EQ(arena.total_size(), 31*BLOCK_SIZE);
+    ASSERT_EQ(arena.used_size(), 31*BLOCK_SIZE);
+    ASSERT_EQ(arena.high_water_mark(), arena.used_size());
+
+    // the size of the blocks is capped by `max_block_size`
+    ArenaAllocator capped{ArenaPolicy{BLOCK_SIZE, 2.0, 2*BLOCK_SIZE}};
+    for(size_t i = 0; i < 10; ++i) {
+        capped.alloc(BLOCK_SIZE/2, 8);
+    }
+    ASSERT_EQ(capped.n_blocks(), 3);
+    ASSERT_EQ(capped.total_size(), 5*BLOCK_SIZE);
+}
+
+TEST(ArenaAllocator, ReleaseAndShrink) {
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
+
+    for(size_t i = 0; i < 32; ++i) {
+        arena.alloc(BLOCK_SIZE, 8);
+    }
+    size_t high_water_mark = arena.high_water_mark();
+    size_t n_blocks = arena.n_blocks();
+    ASSERT_GT(n_blocks, 2);
+
+    // keeps enough blocks for a few allocations
+    arena.clear();
+    arena.shrink_to(2*BLOCK_SIZE);
+    ASSERT_LT(arena.n_blocks(), n_blocks);
+    ASSERT_GE(arena.total_size(), 2*BLOCK_SIZE);
+
+    // the high water mark is preserved across clears
+    ASSERT_EQ(arena.high_water_mark(), high_water_mark);
+
+    arena.release();
+    ASSERT_EQ(arena.n_blocks(), 1);
+    ASSERT_EQ(arena.total_size(), BLOCK_SIZE);
+    ASSERT_EQ(arena.used_size(), 0);
+}
+
+TEST(ArenaAllocator, MarkRewind) {
+    ArenaAllocator arena{ArenaPolicy{BLOCK_SIZE}};
+
+    arena.alloc(BLOCK_SIZE/2, 8);
+    auto mark = arena.mark();
+    size_t used_size = arena.used_size();
+
+    for(size_t i = 0; i < 8; ++i) {
+        arena.alloc(BLOCK_SIZE/2, 8);
+    }
+    arena.alloc(ArenaPolicy{}.large_object_size + 1, 8);
+    size_t total_size = arena.total_size();
+    ASSERT_GT(arena.n_blocks(), 1);
+    ASSERT_EQ(arena.n_large_objects(), 1);
+
+    // the memory allocated before the mark is kept
+    arena.rewind(mark);
+    ASSERT_EQ(arena.used_size(), used_size);
+    ASSERT_EQ(arena.current_block(), 0);
+    ASSERT_EQ(arena.n_large_objects(), 0);
+
+    // the memory allocated after the mark is reused
+    for(size_t i = 0; i < 8; ++i) {
+        arena.alloc(BLOCK_SIZE/2, 8);
+    }
+    arena.alloc(ArenaPolicy{}.large_object_size + 1, 8);
+    ASSERT_EQ(arena.total_size(), total_size);
+}
+
+TEST(ArenaAllocator, Mmap) {
+    ArenaPolicy policy;
+    policy.block_size = BLOCK_SIZE;
+    policy.use_mmap = true;
+    policy.huge_pages = true;
+    ArenaAllocator arena{policy};
+
+    for(size_t i = 0; i < 16; ++i) {
+        auto * ptr = static_cast<double*>(arena.alloc(BLOCK_SIZE, alignof(double)));
+        ptr[0] = 1.0;
+        ptr[BLOCK_SIZE/sizeof(double) - 1] = 2.0;
+    }
+    void * large = arena.alloc(policy.large_object_size + 1, 8);
+    std::memset(large, 1, policy.large_object_size + 1);
+    arena.release();
+    ASSERT_EQ(arena.n_blocks(), 1);
 }
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Var.hpp"
+#include "NodeManager.hpp"
+#include "CustomPrimitive.hpp"
+
+/**
+ * Unit tests for the functionalities exposed by
+ *  CustomPrimitive.hpp
+ */
+
+using Var = autodiff::reverse::Var<double>;
+using NodeManager = autodiff::reverse::NodeManager<double>;
+using autodiff::reverse::register_primitive;
+using autodiff::reverse::call_primitive;
+
+// (r, phi) = polar(x, y)
+static size_t polar() {
+    static size_t id = register_primitive<double>("polar", 2, 2,
+        [](double const * in, double * out) {
+            out[0] = std::hypot(in[0], in[1]);
+            out[1] = std::atan2(in[1], in[0]);
+        },
+        [](double const * in, double const * out, double const * out_grads, double * in_grads) {
+            double r2 = out[0] * out[0];
+            in_grads[0] = out_grads[0] * in[0] / out[0] - out_grads[1] * in[1] / r2;
+            in_grads[1] = out_grads[0] * in[1] / out[0] + out_grads[1] * in[0] / r2;
+        });
+    return id;
+}
+
+TEST(CustomPrimitiveTest, MultipleOutputs) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 0.6;
+    Var y = -1.7;
+    size_t n_nodes = manager.size();
+    auto rphi = call_primitive(polar(), {x, y});
+    // the block and its outputs
+    ASSERT_EQ(manager.size(), n_nodes + 3);
+    ASSERT_DOUBLE_EQ(rphi[0].value(), std::hypot(0.6, -1.7));
+    ASSERT_DOUBLE_EQ(rphi[1].value(), std::atan2(-1.7, 0.6));
+
+    // r * sin(phi) = y
+    Var f = rphi[0] * sin(rphi[1]);
+    ASSERT_NEAR(f.value(), -1.7, 1e-12);
+    f.backward();
+    ASSERT_NEAR(x.grad(), 0.0, 1e-12);
+    ASSERT_NEAR(y.grad(), 1.0, 1e-12);
+
+    // r^2 = x^2 + y^2
+    manager.clear_grad();
+    Var g = rphi[0] * rphi[0];
+    g.backward();
+    ASSERT_NEAR(x.grad(), 2.0 * 0.6, 1e-12);
+    ASSERT_NEAR(y.grad(), 2.0 * -1.7, 1e-12);
+    manager.clear();
+}
+
+TEST(CustomPrimitiveTest, TabulatedFunction) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    // piecewise linear interpolation of x^2 on [0, 4]
+    std::vector<double> table = {0.0, 1.0, 4.0, 9.0, 16.0};
+    auto segment = [](double x) {
+        return std::min<size_t>(static_cast<size_t>(x), 3);
+    };
+    size_t interp = register_primitive<double>("interp", 1, 1,
+        [=](double const * in, double * out) {
+            size_t k = segment(in[0]);
+            out[0] = table[k] + (in[0] - k) * (table[k+1] - table[k]);
+        },
+        [=](double const * in, double const *, double const * out_grads, double * in_grads) {
+            size_t k = segment(in[0]);
+            in_grads[0] = out_grads[0] * (table[k+1] - table[k]);
+        });
+
+    Var x = 1.5;
+    Var y = 3.0 * call_primitive(interp, {x})[0];
+    ASSERT_DOUBLE_EQ(y.value(), 7.5);
+    y.backward();
+    ASSERT_DOUBLE_EQ(x.grad(), 9.0);
+
+    // the call is replayed with the new inputs
+    manager.set_node_value(x.index(), 2.5);
+    ASSERT_TRUE(manager.forward());
+    ASSERT_DOUBLE_EQ(y.value(), 19.5);
+    manager.clear_grad();
+    y.backward();
+    ASSERT_DOUBLE_EQ(x.grad(), 15.0);
+    manager.clear();
+}
+
+TEST(CustomPrimitiveTest, Errors) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 1.0;
+    ASSERT_THROW(call_primitive(polar(), {x}), std::invalid_argument);
+    ASSERT_THROW(call_primitive(autodiff::reverse::PrimitiveRegistry<double>::instance().size(), {x}), std::out_of_range);
+    ASSERT_THROW(register_primitive<double>("no_adjoint", 1, 1, [](double const *, double *) {}, nullptr), std::invalid_argument);
+
+    // no second derivatives
+    Var r = call_primitive(polar(), {x, x})[0];
+    ASSERT_THROW(manager.hessian(r.index()), std::logic_error);
+    manager.clear();
+}
+
+TEST(CustomPrimitiveTest, BatchGradientOfEachOutput) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    // (x, 2x)
+    size_t twice = register_primitive<double>("twice", 1, 2,
+        [](double const * in, double * out) {
+            out[0] = in[0];
+            out[1] = 2.0 * in[0];
+        },
+        [](double const *, double const *, double const * out_grads, double * in_grads) {
+            in_grads[0] = out_grads[0] + 2.0 * out_grads[1];
+        });
+
+    Var x = 1.0;
+    auto y = call_primitive(twice, {x});
+
+    // the adjoint of the other output must not leak from the previous call
+    size_t input = x.index();
+    double points[3] = {1.0, 2.0, 3.0};
+    double values[3];
+    double gradients[3];
+    for(size_t j = 0; j < 2; ++j) {
+        ASSERT_TRUE(manager.batch_gradient(y[j].index(), &input, 1, points, 3, values, gradients));
+        for(size_t k = 0; k < 3; ++k) {
+            ASSERT_DOUBLE_EQ(values[k], (j + 1.0) * points[k]);
+            ASSERT_DOUBLE_EQ(gradients[k], j + 1.0);
+        }
+    }
+    manager.clear();
+}
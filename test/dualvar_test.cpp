@@ -129,7 +129,7 @@ TEST_F(DualVarTest, Multiplication) {
     auto prod_assign2 = x;
     prod_assign2 *= 3.0;
     EXPECT_EQ(prod_assign2.getReal(), 6.0);
-    EXPECT_EQ(prod_assign2.getInf(), 1.0);
+    EXPECT_EQ(prod_assign2.getInf(), 3.0);
     
 }
 
@@ -161,6 +161,23 @@ TEST_F(DualVarTest, Division) {
     quot_assign2 /= 2.0; // (2,1) / (2, 0) = (1, (1*2 - 2*0) / (2*2)) = (1, 0.5)
     EXPECT_EQ(quot_assign2.getReal(), 1.0);
     EXPECT_EQ(quot_assign2.getInf(), 0.5);
+
+    // the infinitesimal part of the divisor is not zero
+    auto quot4 = x / z;  // (2,1) / (4,2) = (0.5, (1*4 - 2*2)/(4*4)) = (0.5, 0)
+    EXPECT_NEAR(quot4.getReal(), 0.5, eps);
+    EXPECT_NEAR(quot4.getInf(), 0.0, eps);
+
+    auto quot5 = y / x;  // (3,0) / (2,1) = (1.5, (0*2 - 3*1)/(2*2)) = (1.5, -0.75)
+    EXPECT_NEAR(quot5.getReal(), 1.5, eps);
+    EXPECT_NEAR(quot5.getInf(), -0.75, eps);
+
+    auto quot_assign3 = y;
+    quot_assign3 /= x;
+    EXPECT_NEAR(quot_assign3.getInf(), -0.75, eps);
+
+    auto quot6 = 6.0 / x;  // 6 / (2,1) = (3, -6*1/(2*2)) = (3, -1.5)
+    EXPECT_NEAR(quot6.getReal(), 3.0, eps);
+    EXPECT_NEAR(quot6.getInf(), -1.5, eps);
 }
 
 // Test trigonometric functions
@@ -2,6 +2,7 @@
 #include <cmath>
 #include <vector>
 #include <functional>
+#include <span>
 #include <Eigen/Dense>
 #include "ForwardUtility.hpp"
 #include "DualVar.hpp"
@@ -141,4 +142,144 @@ TEST_F(fwdiff, jacobian_single_output) {
     // Expected gradient: [13, 14]
     EXPECT_NEAR(jac(0, 0), 13.0, eps);
     EXPECT_NEAR(jac(0, 1), 14.0, eps);
-}
\ No newline at end of file
+}
+// y_i = x_{i-1} * x_i + sin(x_{i+1}) (tridiagonal jacobian)
+template <typename T>
+DualVec<T> tridiagonal_test(DualVec<T> vars) {
+    size_t n = vars.size();
+    DualVec<T> result(n);
+    for (size_t i = 0; i < n; i++) {
+        result[i] = vars[i] * vars[i];
+        if (i > 0) {
+            result[i] = result[i] + vars[i-1] * vars[i];
+        }
+        if (i + 1 < n) {
+            result[i] = result[i] + sin(vars[i+1]);
+        }
+    }
+    return result;
+}
+
+autodiff::SparsityPattern tridiagonal_pattern(size_t n) {
+    std::vector<Eigen::Triplet<bool>> entries;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = (i > 0 ? i-1 : 0); j <= std::min(i+1, n-1); j++) {
+            entries.emplace_back(i, j, true);
+        }
+    }
+    autodiff::SparsityPattern pattern(n, n);
+    pattern.setFromTriplets(entries.begin(), entries.end());
+    return pattern;
+}
+
+TEST_F(fwdiff, coloring) {
+    size_t n_colors;
+    auto pattern = tridiagonal_pattern(100);
+    std::vector<size_t> colors = autodiff::color_columns(pattern, n_colors);
+    EXPECT_EQ(n_colors, 3);
+
+    // columns of the same color never share a row
+    for (size_t i = 0; i < 100; i++) {
+        for (size_t j = (i > 0 ? i-1 : 0); j <= std::min<size_t>(i+1, 99); j++) {
+            for (size_t k = j+1; k <= std::min<size_t>(i+1, 99); k++) {
+                EXPECT_NE(colors[j], colors[k]);
+            }
+        }
+    }
+
+    // block-diagonal: as many colors as the size of the blocks
+    std::vector<Eigen::Triplet<bool>> entries;
+    for (size_t b = 0; b < 10; b++) {
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                entries.emplace_back(4*b + i, 4*b + j, true);
+            }
+        }
+    }
+    autodiff::SparsityPattern blocks(40, 40);
+    blocks.setFromTriplets(entries.begin(), entries.end());
+    autodiff::color_rows(blocks, n_colors);
+    EXPECT_EQ(n_colors, 4);
+}
+
+TEST_F(fwdiff, sparse_jacobian) {
+    constexpr size_t n = 50;
+    std::function<DualVec<double>(DualVec<double>)> f = tridiagonal_test<double>;
+
+    RealVec<double> point(n);
+    for (size_t i = 0; i < n; i++) {
+        point[i] = 0.1 * i - 2.0;
+    }
+
+    RealVec<double> f_x, f_x_dense;
+    JacType<double> jac_dense;
+    jacobian(f, point, f_x_dense, jac_dense);
+
+    Eigen::SparseMatrix<double> jac;
+    sparse_jacobian(f, point, tridiagonal_pattern(n), f_x, jac);
+
+    EXPECT_EQ(jac.nonZeros(), 3*n - 2);
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_NEAR(f_x[i], f_x_dense[i], 1e-12);
+    }
+    JacType<double> jac_sparse = JacType<double>(jac);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+            EXPECT_NEAR(jac_sparse(i, j), jac_dense(i, j), 1e-12);
+        }
+    }
+
+    EXPECT_THROW(sparse_jacobian(f, point, tridiagonal_pattern(n+1), f_x, jac), std::invalid_argument);
+}
+
+TEST_F(fwdiff, gradient_workspace) {
+    Workspace<double> ws;
+    auto f = [](DualVec<double> const & vars) { return multi_poly_eigen_test<double>(vars); };
+
+    RealVec<double> point(2);
+    point << 2.0, 3.0;
+    double f_x;
+    RealVec<double> grad(2);
+    gradient(f, point, f_x, grad, ws);
+    EXPECT_NEAR(f_x, 4.0 + 12.0 + 9.0 + 6.0 + 12.0 + 5.0, eps);
+    EXPECT_NEAR(grad[0], 13.0, eps);
+    EXPECT_NEAR(grad[1], 14.0, eps);
+
+    // contiguous inputs and outputs
+    auto g = [](std::span<DualVar<double> const> vars) {
+        return vars[0] * vars[0] + 2.0 * vars[0] * vars[1] + vars[1] * vars[1];
+    };
+    std::vector<double> x = {1.0, 2.0};
+    std::vector<double> grad_std(2);
+    gradient(g, x, f_x, grad_std, ws);
+    EXPECT_NEAR(f_x, 9.0, eps);
+    EXPECT_NEAR(grad_std[0], 6.0, eps);
+    EXPECT_NEAR(grad_std[1], 6.0, eps);
+
+    RealVec<double> wrong(3);
+    EXPECT_THROW(gradient(f, point, f_x, wrong, ws), std::invalid_argument);
+}
+
+TEST_F(fwdiff, jacobian_workspace) {
+    Workspace<double> ws;
+    auto f = [](DualVec<double> const & vars) { return vector_function_test<double>(vars); };
+
+    RealVec<double> point(2);
+    point << 2.0, 3.0;
+
+    // the jacobian is written in a block of a larger matrix
+    RealVec<double> f_x(2);
+    JacType<double> big = JacType<double>::Zero(4, 4);
+    jacobian(f, point, f_x, big.block(1, 1, 2, 2), ws);
+
+    EXPECT_NEAR(f_x[0], 7.0, eps);
+    EXPECT_NEAR(f_x[1], 11.0, eps);
+    EXPECT_NEAR(big(1, 1), 4.0, eps);
+    EXPECT_NEAR(big(1, 2), 1.0, eps);
+    EXPECT_NEAR(big(2, 1), 1.0, eps);
+    EXPECT_NEAR(big(2, 2), 6.0, eps);
+    EXPECT_EQ(big(0, 0), 0.0);
+
+    JacType<double> wrong(3, 2);
+    EXPECT_THROW(jacobian(f, point, f_x, wrong, ws), std::invalid_argument);
+}
@@ -0,0 +1,332 @@
+#include <cmath>
+#include <gtest/gtest.h>
+#include <Eigen/Core>
+#include "Var.hpp"
+#include "NodeManager.hpp"
+#include "MatrixFunctions.hpp"
+
+/**
+ * Unit tests for the functionalities exposed by
+ *  MatrixFunctions.hpp
+ */
+
+using Var = autodiff::reverse::Var<double>;
+using NodeManager = autodiff::reverse::NodeManager<double>;
+using MatVar = Eigen::Matrix<Var, Eigen::Dynamic, Eigen::Dynamic>;
+using VecVar = Eigen::Vector<Var, Eigen::Dynamic>;
+using Mat = Eigen::MatrixXd;
+using Vec = Eigen::VectorXd;
+
+using autodiff::reverse::matmul;
+using autodiff::reverse::matvec;
+using autodiff::reverse::map;
+using autodiff::reverse::sum;
+using autodiff::reverse::dot;
+using autodiff::reverse::norm;
+using autodiff::reverse::squared_norm;
+using autodiff::reverse::solve;
+using autodiff::reverse::llt_solve;
+using autodiff::reverse::log_det;
+using autodiff::reverse::inverse;
+using autodiff::reverse::TanhNode;
+
+constexpr double TOL = 1e-12;
+
+MatVar to_var(Mat const & m) {
+    MatVar res(m.rows(), m.cols());
+    for(Eigen::Index j = 0; j < m.cols(); ++j) {
+        for(Eigen::Index i = 0; i < m.rows(); ++i) {
+            res(i, j) = m(i, j);
+        }
+    }
+    return res;
+}
+
+Mat grads(MatVar const & m) {
+    Mat res(m.rows(), m.cols());
+    for(Eigen::Index j = 0; j < m.cols(); ++j) {
+        for(Eigen::Index i = 0; i < m.rows(); ++i) {
+            res(i, j) = m(i, j).grad();
+        }
+    }
+    return res;
+}
+
+Mat values(MatVar const & m) {
+    Mat res(m.rows(), m.cols());
+    for(Eigen::Index j = 0; j < m.cols(); ++j) {
+        for(Eigen::Index i = 0; i < m.rows(); ++i) {
+            res(i, j) = m(i, j).value();
+        }
+    }
+    return res;
+}
+
+TEST(MatrixFunctionsTest, MatMul) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(4, 3);
+    Mat B_val = Mat::Random(3, 5);
+    MatVar A = to_var(A_val);
+    MatVar B = to_var(B_val);
+    size_t n_nodes = manager.size();
+
+    MatVar C = matmul(A, B);
+    // one block + its outputs
+    ASSERT_EQ(manager.size(), n_nodes + 1 + 4*5);
+    ASSERT_TRUE(values(C).isApprox(A_val * B_val, TOL));
+
+    // L = sum(C) => dL/dA = 1 * B^T, dL/dB = A^T * 1
+    Var L = sum(C);
+    L.backward();
+    ASSERT_TRUE(grads(A).isApprox(Mat::Ones(4, 5) * B_val.transpose(), TOL));
+    ASSERT_TRUE(grads(B).isApprox(A_val.transpose() * Mat::Ones(4, 5), TOL));
+}
+
+TEST(MatrixFunctionsTest, MatMulTransposedView) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(3, 4);
+    MatVar A = to_var(A_val);
+
+    // L = ||A^T A||^2
+    MatVar C = matmul(A.transpose(), A);
+    Var L = squared_norm(C);
+    L.backward();
+
+    Mat C_val = A_val.transpose() * A_val;
+    ASSERT_NEAR(L.value(), C_val.squaredNorm(), TOL);
+    // dL/dA = 2 A (dC + dC^T), dC = 2 C
+    Mat expected = 2.0 * A_val * (2.0 * C_val + 2.0 * C_val.transpose()) / 2.0;
+    ASSERT_TRUE(grads(A).isApprox(expected, TOL));
+}
+
+TEST(MatrixFunctionsTest, MatVecMapDot) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(5, 3);
+    Vec x_val = Vec::Random(3);
+    Vec w_val = Vec::Random(5);
+    MatVar A = to_var(A_val);
+    VecVar x = to_var(x_val);
+    VecVar w = to_var(w_val);
+
+    // L = w . tanh(A x)
+    VecVar h = map<TanhNode>(matvec(A, x));
+    Var L = dot(w, h);
+    L.backward();
+
+    Vec h_val = (A_val * x_val).array().tanh();
+    ASSERT_NEAR(L.value(), w_val.dot(h_val), TOL);
+
+    Vec dz = w_val.array() * (1.0 - h_val.array().square());
+    ASSERT_TRUE(grads(w).isApprox(h_val, TOL));
+    ASSERT_TRUE(grads(A).isApprox(dz * x_val.transpose(), TOL));
+    ASSERT_TRUE(grads(x).isApprox(A_val.transpose() * dz, TOL));
+}
+
+TEST(MatrixFunctionsTest, MatchesScalarNodes) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Vec x_val = Vec::Random(6);
+    VecVar x = to_var(x_val);
+
+    Var blocks = norm(x) + sum(x);
+    Var scalars = x.norm() + x.sum();
+    ASSERT_NEAR(blocks.value(), scalars.value(), TOL);
+
+    size_t roots[] = {blocks.index(), scalars.index()};
+    manager.backward<2>(roots, 2);
+    for(Eigen::Index i = 0; i < x.size(); ++i) {
+        ASSERT_NEAR(
+            manager.get_node_grad(x(i).index(), 0),
+            manager.get_node_grad(x(i).index(), 1),
+            TOL
+        );
+    }
+}
+
+TEST(MatrixFunctionsTest, Replay) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(3, 3);
+    Mat B_val = Mat::Random(3, 3);
+    MatVar A = to_var(A_val);
+    MatVar B = to_var(B_val);
+
+    MatVar C = matmul(A, B);
+    Var L = sum(C);
+
+    // new values for A
+    A_val = Mat::Random(3, 3);
+    for(Eigen::Index j = 0; j < 3; ++j) {
+        for(Eigen::Index i = 0; i < 3; ++i) {
+            manager.set_node_value(A(i, j).index(), A_val(i, j));
+        }
+    }
+    ASSERT_TRUE(manager.forward());
+    ASSERT_TRUE(values(C).isApprox(A_val * B_val, TOL));
+    ASSERT_NEAR(L.value(), (A_val * B_val).sum(), TOL);
+
+    L.backward();
+    ASSERT_TRUE(grads(B).isApprox(A_val.transpose() * Mat::Ones(3, 3), TOL));
+}
+
+TEST(MatrixFunctionsTest, DimensionMismatch) {
+    MatVar A = to_var(Mat::Random(2, 3));
+    MatVar B = to_var(Mat::Random(2, 3));
+    ASSERT_THROW(matmul(A, B), std::invalid_argument);
+    ASSERT_THROW(solve(A, B), std::invalid_argument);
+    ASSERT_THROW(log_det(A), std::invalid_argument);
+    MatVar C = to_var(Mat::Random(3, 3));
+    ASSERT_THROW(solve(C, B), std::invalid_argument);
+}
+
+TEST(MatrixFunctionsTest, LargeOperands) {
+    NodeManager tape;
+    autodiff::reverse::ActiveTape<double> active(tape);
+
+    // the operands don't fit in a block of the arena
+    Mat A_val = Mat::Random(256, 256);
+    Vec x_val = Vec::Random(256);
+    MatVar A = to_var(A_val);
+    VecVar x = to_var(x_val);
+
+    Var L = sum(matvec(A, x));
+    L.backward();
+
+    ASSERT_NEAR(L.value(), (A_val * x_val).sum(), 1e-9);
+    ASSERT_TRUE(grads(x).isApprox(A_val.transpose() * Vec::Ones(256), 1e-9));
+}
+
+TEST(MatrixFunctionsTest, Solve) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(5, 5) + 5.0 * Mat::Identity(5, 5);
+    Mat B_val = Mat::Random(5, 2);
+    Mat W_val = Mat::Random(5, 2);
+    MatVar A = to_var(A_val);
+    MatVar B = to_var(B_val);
+    MatVar W = to_var(W_val);
+
+    // L = sum(W .* A^-1 B)
+    MatVar X = solve(A, B);
+    Var L = dot(W, X);
+    L.backward();
+
+    Mat X_val = A_val.lu().solve(B_val);
+    ASSERT_TRUE(values(X).isApprox(X_val, TOL));
+    Mat dB = A_val.transpose().lu().solve(W_val);
+    ASSERT_TRUE(grads(B).isApprox(dB, TOL));
+    ASSERT_TRUE(grads(A).isApprox(-dB * X_val.transpose(), TOL));
+
+    // the factorization is recomputed by a replay
+    A_val = Mat::Random(5, 5) + 5.0 * Mat::Identity(5, 5);
+    for(Eigen::Index j = 0; j < 5; ++j) {
+        for(Eigen::Index i = 0; i < 5; ++i) {
+            manager.set_node_value(A(i, j).index(), A_val(i, j));
+        }
+    }
+    ASSERT_TRUE(manager.forward());
+    manager.clear_grad();
+    L.backward();
+    X_val = A_val.lu().solve(B_val);
+    dB = A_val.transpose().lu().solve(W_val);
+    ASSERT_TRUE(values(X).isApprox(X_val, TOL));
+    ASSERT_TRUE(grads(A).isApprox(-dB * X_val.transpose(), TOL));
+}
+
+TEST(MatrixFunctionsTest, LltSolve) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat M = Mat::Random(4, 4);
+    Mat A_val = M * M.transpose() + 4.0 * Mat::Identity(4, 4);
+    // not symmetric: the strict upper triangle is never read
+    A_val.triangularView<Eigen::StrictlyUpper>().setConstant(10.0);
+    Vec b_val = Vec::Random(4);
+    Vec w_val = Vec::Random(4);
+    MatVar A = to_var(A_val);
+    VecVar b = to_var(b_val);
+    VecVar w = to_var(w_val);
+
+    VecVar x = llt_solve(A, b);
+    Var L = dot(w, x);
+    L.backward();
+
+    Vec x_val = A_val.llt().solve(b_val);
+    Vec db = A_val.llt().solve(w_val);
+    ASSERT_TRUE(values(x).isApprox(x_val, TOL));
+    ASSERT_TRUE(grads(b).isApprox(db, TOL));
+
+    // central finite differences wrt each entry of A
+    constexpr double h = 1e-6;
+    Mat dA = grads(A);
+    for(Eigen::Index j = 0; j < 4; ++j) {
+        for(Eigen::Index i = 0; i < 4; ++i) {
+            Mat A_plus = A_val, A_minus = A_val;
+            A_plus(i, j) += h;
+            A_minus(i, j) -= h;
+            double fd = (w_val.dot(A_plus.llt().solve(b_val)) - w_val.dot(A_minus.llt().solve(b_val))) / (2*h);
+            ASSERT_NEAR(dA(i, j), fd, 1e-7) << i << ", " << j;
+            if(i < j) {
+                ASSERT_EQ(dA(i, j), 0.0);
+            }
+        }
+    }
+
+    // not positive definite
+    MatVar N = to_var(-A_val);
+    VecVar y = llt_solve(N, b);
+    ASSERT_TRUE(std::isnan(y(0).value()));
+}
+
+TEST(MatrixFunctionsTest, LogDetInverse) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Mat A_val = Mat::Random(4, 4) + 3.0 * Mat::Identity(4, 4);
+    // negative determinant
+    A_val.row(0).swap(A_val.row(1));
+    Mat W_val = Mat::Random(4, 4);
+    MatVar A = to_var(A_val);
+    MatVar W = to_var(W_val);
+
+    Var d = log_det(A);
+    ASSERT_NEAR(d.value(), std::log(std::abs(A_val.determinant())), TOL);
+    d.backward();
+    Mat A_inv = A_val.inverse();
+    ASSERT_TRUE(grads(A).isApprox(A_inv.transpose(), TOL));
+
+    manager.clear_grad();
+    MatVar C = inverse(A);
+    Var L = dot(W, C);
+    L.backward();
+    ASSERT_TRUE(values(C).isApprox(A_inv, TOL));
+    ASSERT_TRUE(grads(A).isApprox(-A_inv.transpose() * W_val * A_inv.transpose(), TOL));
+}
+
+TEST(MatrixFunctionsTest, LargeSolve) {
+    NodeManager tape;
+    autodiff::reverse::ActiveTape<double> active(tape);
+
+    Mat A_val = Mat::Random(200, 200) + 20.0 * Mat::Identity(200, 200);
+    Vec b_val = Vec::Random(200);
+    MatVar A = to_var(A_val);
+    VecVar b = to_var(b_val);
+
+    // one block, its outputs and the factorization (LU and P)
+    size_t n_nodes = tape.size();
+    Var L = sum(solve(A, b));
+    ASSERT_EQ(tape.size(), n_nodes + (1 + 200 + 200*200 + 200) + 2);
+    L.backward();
+
+    Vec db = A_val.transpose().lu().solve(Vec::Ones(200));
+    ASSERT_TRUE(grads(b).isApprox(db, 1e-9));
+}
@@ -177,3 +177,27 @@ TEST_F(NewtonTest, newtontest_5it)
 
 
 
+TEST_F(NewtonTest, newtontest_replay)
+{
+  NewtonOpts newtonopts = {
+    .maxit = 5,
+    .tol = 1e-6
+  };
+
+  ReverseJac J_r(rf, true);
+  Newton revsolver(J_r, newtonopts);
+  auto revres = revsolver.solve(x0);
+
+  EXPECT_NEAR(revres[0], 0.567297, eps);
+  EXPECT_NEAR(revres[1], -0.309442, eps);
+
+  // a residual which creates leaves can't be replayed
+  ReverseJac::RvNLSType leaky = [](VarVec const & x) {
+    VarVec res(2);
+    res << x(0) * Var(x(1).value()), x(1);
+    return res;
+  };
+  ReverseJac J_leaky(leaky, true);
+  Newton leaky_solver(J_leaky, newtonopts);
+  EXPECT_THROW(leaky_solver.solve(x0), std::logic_error);
+}
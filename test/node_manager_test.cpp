@@ -0,0 +1,745 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "DualVar.hpp"
+#include "Var.hpp"
+#include "NodeManager.hpp"
+
+/**
+ * Unit tests for the functionalities exposed by
+ *  NodeManager.hpp
+ */
+
+using Var = autodiff::reverse::Var<double>;
+using NodeManager = autodiff::reverse::NodeManager<double>;
+
+TEST(NodeManagerTest, OneNodePerOperation) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+    ASSERT_EQ(manager.size(), 1);
+
+    Var x = 2.0;
+    Var y = 3.0;
+    ASSERT_EQ(manager.size(), 3);
+
+    Var z = sin(x);
+    z = x * y;
+    ASSERT_EQ(manager.size(), 5);
+}
+
+TEST(NodeManagerTest, ClearResetsTape) {
+    NodeManager & manager = NodeManager::instance();
+
+    Var x = 2.0;
+    [[maybe_unused]] Var z = exp(x) * x;
+    manager.clear();
+
+    ASSERT_EQ(manager.size(), 1);
+    ASSERT_EQ(manager.get_node_value(0), 0.0);
+    ASSERT_EQ(manager.get_node_grad(0), 0.0);
+}
+
+TEST(NodeManagerTest, BackwardLongChain) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    // z = x^N computed as N-1 products => dz/dx = N * x^(N-1)
+    constexpr size_t N = 1000;
+    Var x = 1.001;
+    Var z = x;
+    for(size_t i = 1; i < N; ++i) {
+        z = z * x;
+    }
+    z.backward();
+
+    ASSERT_NEAR(z.value(), std::pow(1.001, N), 1e-9);
+    ASSERT_NEAR(x.grad(), N * std::pow(1.001, N-1), 1e-9);
+}
+
+TEST(NodeManagerTest, ClearGrad) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 5.0;
+    Var z = x * y - log(y);
+    z.backward();
+    ASSERT_EQ(x.grad(), 5.0);
+
+    manager.clear_grad();
+    for(size_t i = 0; i < manager.size(); ++i) {
+        ASSERT_EQ(manager.get_node_grad(i), 0.0);
+    }
+
+    // a second backward pass gives the same result
+    z.backward();
+    ASSERT_EQ(x.grad(), 5.0);
+    ASSERT_EQ(y.grad(), 2.0 - 1.0/5.0);
+}
+
+TEST(NodeManagerTest, ActiveTapeRecordsInExplicitTape) {
+    using autodiff::reverse::Tape;
+    using autodiff::reverse::ActiveTape;
+
+    NodeManager & default_tape = NodeManager::instance();
+    default_tape.clear();
+
+    Tape<double> tape;
+    {
+        ActiveTape<double> active(tape);
+        ASSERT_EQ(&NodeManager::instance(), &tape);
+
+        Var x = 3.0;
+        Var z = x * x;
+        z.backward();
+        ASSERT_EQ(x.grad(), 6.0);
+    }
+
+    // the default Tape is active again and it was never touched
+    ASSERT_EQ(&NodeManager::instance(), &default_tape);
+    ASSERT_EQ(default_tape.size(), 1);
+    ASSERT_EQ(tape.size(), 3);
+}
+
+TEST(NodeManagerTest, NestedActiveTapes) {
+    using autodiff::reverse::Tape;
+    using autodiff::reverse::ActiveTape;
+
+    NodeManager & default_tape = NodeManager::instance();
+    Tape<double> outer;
+    Tape<double> inner;
+    {
+        ActiveTape<double> active_outer(outer);
+        {
+            ActiveTape<double> active_inner(inner);
+            ASSERT_EQ(&NodeManager::instance(), &inner);
+        }
+        ASSERT_EQ(&NodeManager::instance(), &outer);
+    }
+    ASSERT_EQ(&NodeManager::instance(), &default_tape);
+}
+
+TEST(NodeManagerTest, ForwardReplay) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var z = sin(x * y) + exp(x) / y;
+    size_t n_nodes = manager.size();
+
+    manager.set_node_value(x.index(), 0.5);
+    manager.set_node_value(y.index(), 1.5);
+    ASSERT_TRUE(manager.forward());
+
+    // no new nodes and the values are the ones at the new point
+    ASSERT_EQ(manager.size(), n_nodes);
+    ASSERT_DOUBLE_EQ(z.value(), std::sin(0.5 * 1.5) + std::exp(0.5) / 1.5);
+
+    z.backward();
+    ASSERT_DOUBLE_EQ(x.grad(), 1.5 * std::cos(0.75) + std::exp(0.5) / 1.5);
+    ASSERT_DOUBLE_EQ(y.grad(), 0.5 * std::cos(0.75) - std::exp(0.5) / (1.5 * 1.5));
+}
+
+TEST(NodeManagerTest, ForwardGuards) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    ASSERT_TRUE(x < y);
+    ASSERT_TRUE(x > 1.0);
+    ASSERT_EQ(manager.n_guards(), 2);
+
+    // both comparisons still hold
+    manager.set_node_value(x.index(), 1.5);
+    ASSERT_TRUE(manager.forward());
+
+    // x < y flips
+    manager.set_node_value(x.index(), 4.0);
+    ASSERT_FALSE(manager.forward());
+
+    manager.clear();
+    ASSERT_EQ(manager.n_guards(), 0);
+}
+
+TEST(NodeManagerTest, VectorBackward) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 0.7;
+    Var y = 1.3;
+    Var z0 = x * y;
+    Var z1 = sin(x) / y;
+    Var z2 = pow(x, y) + x * x;
+
+    size_t roots[] = {z0.index(), z1.index(), z2.index()};
+    manager.backward<4>(roots, 3);
+
+    // same result as 3 scalar backward passes
+    Var zs[] = {z0, z1, z2};
+    for(size_t k = 0; k < 3; ++k) {
+        manager.clear_grad();
+        zs[k].backward();
+        ASSERT_DOUBLE_EQ(manager.get_node_grad(x.index(), k), x.grad());
+        ASSERT_DOUBLE_EQ(manager.get_node_grad(y.index(), k), y.grad());
+    }
+
+    // unused lane
+    ASSERT_EQ(manager.get_node_grad(x.index(), 3), 0.0);
+    ASSERT_EQ(manager.get_node_grad(y.index(), 3), 0.0);
+}
+
+TEST(NodeManagerTest, ConeSkipsUnrelatedNodes) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var a = exp(y) * y;     // doesn't depend on x
+    Var z = x * x;
+    Var b = a + y;          // recorded after z
+
+    NodeManager::Cone cone;
+    size_t root = z.index();
+    manager.cone(&root, 1, cone);
+
+    // z and x only, in decreasing order
+    ASSERT_EQ(cone.size(), 2);
+    ASSERT_EQ(cone[0], z.index());
+    ASSERT_EQ(cone[1], x.index());
+
+    z.backward();
+    ASSERT_EQ(x.grad(), 4.0);
+    ASSERT_EQ(y.grad(), 0.0);
+    ASSERT_EQ(a.grad(), 0.0);
+    ASSERT_EQ(b.grad(), 0.0);
+}
+
+TEST(NodeManagerTest, ClearGradTouchedOnly) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var z0 = x * y;
+    Var z1 = sin(y) + y;
+
+    z0.backward();
+    z1.backward();
+    manager.clear_grad();
+    for(size_t i = 0; i < manager.size(); ++i) {
+        ASSERT_EQ(manager.get_node_grad(i), 0.0);
+    }
+
+    // many passes without clearing => fallback to a full reset
+    for(size_t i = 0; i < 10; ++i) {
+        z0.backward();
+    }
+    manager.clear_grad();
+    for(size_t i = 0; i < manager.size(); ++i) {
+        ASSERT_EQ(manager.get_node_grad(i), 0.0);
+    }
+}
+
+TEST(NodeManagerTest, VectorBackwardResetsPreviousLanes) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var z0 = x * y;
+    Var z1 = y * y;
+
+    size_t roots0[] = {z0.index()};
+    manager.backward<2>(roots0, 1);
+    ASSERT_EQ(manager.get_node_grad(x.index(), 0), 3.0);
+
+    // the adjoints of the previous pass don't leak into this one
+    size_t roots1[] = {z1.index()};
+    manager.backward<2>(roots1, 1);
+    ASSERT_EQ(manager.get_node_grad(x.index(), 0), 0.0);
+    ASSERT_EQ(manager.get_node_grad(y.index(), 0), 6.0);
+}
+
+TEST(NodeManagerTest, ScalarOperandsAreInline) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 2.0;
+    size_t n_nodes = manager.size();
+
+    // one node per operation, no leaves for the scalars
+    Var z = 3.0 * x;
+    z = z + 1.0;
+    z -= 0.5;
+    z = 2.0 / z;
+    z = pow(z, 2.0);
+    z = pow(2.0, z);
+    ASSERT_EQ(manager.size(), n_nodes + 6);
+
+    // the constants are also used when the Tape is replayed
+    manager.set_node_value(x.index(), 1.0);
+    ASSERT_TRUE(manager.forward());
+    double expected = std::pow(2.0, std::pow(2.0 / (3.0 * 1.0 + 1.0 - 0.5), 2.0));
+    ASSERT_DOUBLE_EQ(z.value(), expected);
+}
+
+TEST(NodeManagerTest, OneNodePerStatement) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var a = 1.0, b = 2.0, c = 3.0, d = 4.0, e = 5.0;
+    size_t n_nodes = manager.size();
+
+    Var z = a*b + c*d - e;
+    ASSERT_EQ(manager.size(), n_nodes + 1);
+    ASSERT_EQ(z.value(), 9.0);
+
+    // evaluating an expression doesn't record it
+    ASSERT_EQ((a*b + c).value(), 5.0);
+    ASSERT_EQ(manager.size(), n_nodes + 1);
+
+    z.backward();
+    ASSERT_EQ(a.grad(), 2.0);
+    ASSERT_EQ(b.grad(), 1.0);
+    ASSERT_EQ(c.grad(), 4.0);
+    ASSERT_EQ(d.grad(), 3.0);
+    ASSERT_EQ(e.grad(), -1.0);
+}
+
+TEST(NodeManagerTest, ExpressionRecordedOnce) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var a = 1.0, b = 2.0, c = 3.0;
+    size_t n_nodes = manager.size();
+
+    auto z = a*b + c;
+    ASSERT_EQ(manager.size(), n_nodes);
+
+    // the first use records the statement, the next ones reuse its node
+    Var u = z;
+    Var v = z;
+    ASSERT_EQ(manager.size(), n_nodes + 1);
+    ASSERT_EQ(u.index(), z.index());
+    ASSERT_EQ(v.index(), z.index());
+
+    z.backward();
+    ASSERT_EQ(z.grad(), 1.0);
+    ASSERT_EQ(a.grad(), 2.0);
+    ASSERT_EQ(b.grad(), 1.0);
+    ASSERT_EQ(c.grad(), 1.0);
+    ASSERT_EQ(manager.size(), n_nodes + 1);
+}
+
+TEST(NodeManagerTest, StatementMatchesElementaryNodes) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 0.7;
+    Var y = 1.3;
+
+    // x appears twice and the statement contains constants
+    Var fused = sin(x * y) / (2.0 + x) - pow(y, 3.0);
+
+    Var t1 = x * y;
+    Var t2 = sin(t1);
+    Var t3 = 2.0 + x;
+    Var t4 = t2 / t3;
+    Var t5 = pow(y, 3.0);
+    Var elementary = t4 - t5;
+
+    ASSERT_DOUBLE_EQ(fused.value(), elementary.value());
+
+    fused.backward();
+    double dx = x.grad(), dy = y.grad();
+    manager.clear_grad();
+    elementary.backward();
+    ASSERT_DOUBLE_EQ(dx, x.grad());
+    ASSERT_DOUBLE_EQ(dy, y.grad());
+
+    // replay recomputes both the values and the local partials
+    manager.set_node_value(x.index(), 0.2);
+    ASSERT_TRUE(manager.forward());
+    ASSERT_DOUBLE_EQ(fused.value(), elementary.value());
+
+    manager.clear_grad();
+    size_t roots[] = {fused.index(), elementary.index()};
+    manager.backward<2>(roots, 2);
+    ASSERT_DOUBLE_EQ(manager.get_node_grad(x.index(), 0), manager.get_node_grad(x.index(), 1));
+    ASSERT_DOUBLE_EQ(manager.get_node_grad(y.index(), 0), manager.get_node_grad(y.index(), 1));
+}
+
+TEST(NodeManagerTest, ReleaseAndShrink) {
+    NodeManager tape;
+    autodiff::reverse::ActiveTape<double> active(tape);
+
+    Var x = 1.0;
+    Var z = x;
+    for(size_t i = 0; i < 10000; ++i) {
+        z = z * x;
+    }
+    size_t n_nodes = tape.size();
+
+    tape.clear();
+    ASSERT_EQ(tape.size(), 1);
+    ASSERT_EQ(tape.high_water_mark(), n_nodes);
+
+    // the Tape is still usable after a shrink and a release
+    tape.shrink_to(100);
+    Var y = 2.0;
+    Var w = y * y;
+    w.backward();
+    ASSERT_EQ(y.grad(), 4.0);
+
+    tape.release();
+    ASSERT_EQ(tape.size(), 1);
+    ASSERT_EQ(tape.arena().n_blocks(), 1);
+}
+
+TEST(NodeManagerTest, Stats) {
+    NodeManager tape;
+    autodiff::reverse::ActiveTape<double> active(tape);
+    tape.instrument();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var z = x * y;
+    z = sin(z);
+    z = z + x * y;
+    z.backward();
+    ASSERT_TRUE(x > 1.0);
+
+    autodiff::reverse::TapeStats stats = tape.stats();
+    ASSERT_EQ(stats.n_nodes, tape.size());
+    ASSERT_EQ(stats.nodes(autodiff::reverse::OpCode::Ind), 3);
+    ASSERT_EQ(stats.nodes(autodiff::reverse::OpCode::Prod), 1);
+    ASSERT_EQ(stats.nodes(autodiff::reverse::OpCode::Sin), 1);
+    ASSERT_EQ(stats.nodes(autodiff::reverse::OpCode::Statement), 1);
+    ASSERT_EQ(stats.n_guards, 1);
+    ASSERT_EQ(stats.n_backward, 1);
+    ASSERT_GE(stats.columns_reserved, stats.columns_used);
+    ASSERT_GT(stats.recording_time, 0.0);
+    ASSERT_GT(stats.backward_time, 0.0);
+
+    // peak length across clears
+    tape.clear();
+    stats = tape.stats();
+    ASSERT_EQ(stats.n_nodes, 1);
+    ASSERT_EQ(stats.peak_nodes, 6);
+    ASSERT_EQ(stats.n_clears, 1);
+
+    std::string json = stats.to_json();
+    ASSERT_EQ(json.front(), '{');
+    ASSERT_EQ(json.back(), '}');
+    ASSERT_NE(json.find("\"peak_nodes\":6"), std::string::npos);
+    ASSERT_NE(json.find("\"IndNode\":1"), std::string::npos);
+    ASSERT_NE(json.find("\"arena\":{"), std::string::npos);
+}
+
+TEST(NodeManagerTest, BackwardProfile) {
+    using autodiff::reverse::OpCode;
+    using autodiff::reverse::ProfileRegion;
+
+    NodeManager tape;
+    autodiff::reverse::ActiveTape<double> active(tape);
+    tape.profile();
+
+    Var x = 2.0;
+    Var y = 3.0;
+    Var z;
+    {
+        ProfileRegion<double> outer("outer");
+        z = pow(x, y);
+        {
+            ProfileRegion<double> inner("inner");
+            z = tanh(z);
+            z = tanh(z);
+        }
+    }
+    z = z * x;
+    z.backward();
+
+    autodiff::reverse::BackwardProfile const & profile = tape.backward_profile();
+    ASSERT_EQ(profile.n_sweeps, 1);
+    ASSERT_EQ(profile.calls[static_cast<size_t>(OpCode::Pow)], 1);
+    ASSERT_EQ(profile.calls[static_cast<size_t>(OpCode::Tanh)], 2);
+    ASSERT_EQ(profile.calls[static_cast<size_t>(OpCode::Prod)], 1);
+    ASSERT_EQ(profile.calls[static_cast<size_t>(OpCode::Ind)], 2);
+
+    // the nodes are attributed to the innermost region
+    ASSERT_EQ(profile.regions.size(), 2);
+    ASSERT_EQ(profile.regions[0].name, "outer");
+    ASSERT_EQ(profile.regions[0].calls, 1);
+    ASSERT_EQ(profile.regions[1].name, "inner");
+    ASSERT_EQ(profile.regions[1].calls, 2);
+
+    // sorted by decreasing time
+    auto by_type = profile.by_type();
+    ASSERT_EQ(by_type.size(), 4);
+    for(size_t k = 1; k < by_type.size(); ++k) {
+        ASSERT_GE(by_type[k-1].time, by_type[k].time);
+    }
+    ASSERT_NE(profile.histogram().find("TanhNode"), std::string::npos);
+    ASSERT_NE(profile.histogram().find("inner"), std::string::npos);
+
+    // the gradients are the same as without the profiler
+    double dx = x.grad();
+    tape.clear_grad();
+    tape.profile(false);
+    z.backward();
+    ASSERT_EQ(x.grad(), dx);
+    ASSERT_EQ(profile.n_sweeps, 1);
+
+    tape.reset_profile();
+    ASSERT_EQ(profile.calls[static_cast<size_t>(OpCode::Tanh)], 0);
+    ASSERT_EQ(profile.regions[1].calls, 0);
+    ASSERT_THROW(tape.end_region(), std::logic_error);
+}
+
+TEST(NodeManagerTest, HessianStatementMatchesElementaryNodes) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    Var x = 0.7;
+    Var y = 1.3;
+
+    Var fused = sin(x * y) / (2.0 + x) - pow(y, 3.0) * x;
+
+    Var t1 = x * y;
+    Var t2 = sin(t1);
+    Var t3 = 2.0 + x;
+    Var t4 = t2 / t3;
+    Var t5 = pow(y, 3.0);
+    Var elementary = t4 - t5 * x;
+
+    auto dense = [&](std::vector<NodeManager::HessianEntry> const & entries) {
+        double h[2][2] = {};
+        for(auto const & entry: entries) {
+            size_t row = entry.row == x.index() ? 0 : 1;
+            size_t col = entry.col == x.index() ? 0 : 1;
+            h[row][col] += entry.value;
+        }
+        return std::vector<double>{h[0][0], h[0][1], h[1][0], h[1][1]};
+    };
+
+    std::vector<double> h_fused = dense(manager.hessian(fused.index()));
+    double dx = x.grad(), dy = y.grad();
+    manager.clear_grad();
+    std::vector<double> h_elementary = dense(manager.hessian(elementary.index()));
+    ASSERT_DOUBLE_EQ(dx, x.grad());
+    ASSERT_DOUBLE_EQ(dy, y.grad());
+
+    for(size_t k = 0; k < 4; ++k) {
+        ASSERT_NEAR(h_fused[k], h_elementary[k], 1e-12);
+    }
+    ASSERT_DOUBLE_EQ(h_fused[1], h_fused[2]);
+    // d2/dy2 = -6xy + d2/dy2 sin(xy) / (2 + x)
+    ASSERT_NEAR(h_fused[3], -6.0 * 0.7 * 1.3 - 0.7 * 0.7 * std::sin(0.7 * 1.3) / 2.7, 1e-12);
+}
+
+TEST(NodeManagerTest, ParallelBackward) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    // a wide Tape: a loss summed over a batch, with shared parameters (fan-in)
+    constexpr size_t N = 2000;
+    Var w = 0.3, b = -0.2;
+    std::vector<Var> xs;
+    for(size_t k = 0; k < N; ++k) {
+        xs.push_back(Var(0.001 * k));
+    }
+    // pairwise reduction: the levels of the Tape are wide
+    std::vector<Var> terms;
+    for(size_t k = 0; k < N; ++k) {
+        Var diff = tanh(w * xs[k] + b) - 0.5;
+        terms.push_back(diff * diff);
+    }
+    while(terms.size() > 1) {
+        std::vector<Var> sums;
+        for(size_t k = 0; k + 1 < terms.size(); k += 2) {
+            sums.push_back(terms[k] + terms[k+1]);
+        }
+        if(terms.size() % 2) {
+            sums.push_back(terms.back());
+        }
+        terms = sums;
+    }
+    Var loss = terms[0];
+
+    loss.backward();
+    double dw = w.grad(), db = b.grad();
+    std::vector<double> dxs;
+    for(auto const & x: xs) {
+        dxs.push_back(x.grad());
+    }
+
+    manager.clear_grad();
+    manager.parallel_backward(loss.index());
+    ASSERT_NEAR(w.grad(), dw, 1e-9);
+    ASSERT_NEAR(b.grad(), db, 1e-9);
+    for(size_t k = 0; k < N; ++k) {
+        ASSERT_DOUBLE_EQ(xs[k].grad(), dxs[k]);
+    }
+
+    // the levels are independent
+    NodeManager::Cone cone;
+    NodeManager::Schedule schedule;
+    size_t root = loss.index();
+    manager.cone(&root, 1, cone);
+    manager.schedule(cone, schedule);
+    ASSERT_EQ(schedule.nodes.size(), cone.size());
+    ASSERT_EQ(schedule.levels.back(), cone.size());
+    ASSERT_EQ(schedule.nodes[0], loss.index());
+    size_t widest = 0;
+    for(size_t l = 0; l + 1 < schedule.levels.size(); ++l) {
+        widest = std::max(widest, schedule.levels[l+1] - schedule.levels[l]);
+    }
+    ASSERT_GE(widest, NodeManager::MIN_PARALLEL_LEVEL);
+
+    // the touched adjoints are reset
+    manager.clear_grad();
+    ASSERT_EQ(w.grad(), 0.0);
+    ASSERT_EQ(xs[N-1].grad(), 0.0);
+}
+
+TEST(NodeManagerTest, HashConsing) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+    manager.reset_stats();
+    manager.hash_consing();
+
+    Var x = 0.7;
+    Var y = 1.3;
+    size_t n_nodes = manager.size();
+
+    // statements
+    Var a = sin(2.0 * y);
+    Var b = sin(2.0 * y);
+    ASSERT_EQ(a.index(), b.index());
+    // elementary nodes
+    Var p = x * y;
+    Var q = x * y;
+    ASSERT_EQ(p.index(), q.index());
+    Var e = exp(x);
+    ASSERT_EQ(e.index(), Var(exp(x)).index());
+    ASSERT_EQ(manager.size(), n_nodes + 3);
+
+    // different arguments, operations or constants
+    ASSERT_NE(Var(y * x).index(), p.index());
+    ASSERT_NE(Var(sin(3.0 * y)).index(), a.index());
+    ASSERT_NE(Var(x * 0.0).index(), Var(x * -0.0).index());
+    ASSERT_NE(Var(0.7).index(), x.index());
+    ASSERT_EQ(manager.stats().n_cse_hits, 3);
+
+    Var z = a * b + p;
+    z.backward();
+    ASSERT_DOUBLE_EQ(x.grad(), 1.3);
+    ASSERT_DOUBLE_EQ(y.grad(), 4.0 * std::sin(2.6) * std::cos(2.6) + 0.7);
+
+    // the Tape can be replayed
+    manager.set_node_value(y.index(), 0.4);
+    ASSERT_TRUE(manager.forward());
+    ASSERT_DOUBLE_EQ(z.value(), std::sin(0.8) * std::sin(0.8) + 0.7 * 0.4);
+
+    manager.hash_consing(false);
+    ASSERT_NE(Var(x * y).index(), p.index());
+
+    // the duplicate recorded meanwhile is not inserted in the table
+    manager.hash_consing();
+    ASSERT_EQ(Var(x * y).index(), p.index());
+    manager.hash_consing(false);
+    manager.clear();
+}
+
+TEST(NodeManagerTest, TapeScope) {
+    NodeManager & manager = NodeManager::instance();
+    manager.clear();
+
+    // y = 2 x + 1
+    std::vector<double> xs = {0.0, 0.5, 1.0, 1.5, 2.0, 2.5};
+    Var w = 0.3;
+    Var b = -0.2;
+    size_t n_params = manager.size();
+    size_t w_idx = w.index();
+
+    {
+        autodiff::reverse::TapeScope<double> scope;
+        size_t columns_reserved = 0;
+        size_t arena_reserved = 0;
+        for(int epoch = 0; epoch < 200; ++epoch) {
+            for(size_t batch = 0; batch < xs.size(); batch += 2) {
+                Var loss = 0.0;
+                double dw = 0.0;
+                double db = 0.0;
+                for(size_t k = batch; k < batch + 2; ++k) {
+                    Var r = w * xs[k] + b - (2.0 * xs[k] + 1.0);
+                    loss = loss + r * r;
+                    dw += 2.0 * r.value() * xs[k];
+                    db += 2.0 * r.value();
+                }
+                loss.backward();
+                ASSERT_DOUBLE_EQ(w.grad(), dw);
+                ASSERT_DOUBLE_EQ(b.grad(), db);
+
+                double w_next = w.value() - 0.05 * w.grad();
+                double b_next = b.value() - 0.05 * b.grad();
+                scope.rewind();
+                ASSERT_EQ(manager.size(), n_params);
+                ASSERT_EQ(w.grad(), 0.0);
+                manager.set_node_value(w.index(), w_next);
+                manager.set_node_value(b.index(), b_next);
+            }
+
+            // the memory is allocated by the first epoch only
+            auto stats = manager.stats();
+            if(epoch == 0) {
+                columns_reserved = stats.columns_reserved;
+                arena_reserved = stats.arena_reserved;
+            }
+            ASSERT_EQ(stats.columns_reserved, columns_reserved);
+            ASSERT_EQ(stats.arena_reserved, arena_reserved);
+        }
+    }
+    ASSERT_EQ(w.index(), w_idx);
+    ASSERT_NEAR(w.value(), 2.0, 1e-3);
+    ASSERT_NEAR(b.value(), 1.0, 1e-3);
+
+    // a mark past the end of the Tape
+    auto mark = manager.mark();
+    manager.clear();
+    ASSERT_FALSE(manager.can_rewind(mark));
+    ASSERT_THROW(manager.rewind(mark), std::logic_error);
+
+    // a mark taken before a clear, even once the Tape has grown past it
+    for(size_t k = 0; k < n_params + 4; ++k) {
+        Var v = 1.0;
+        v = v * 2.0;
+    }
+    ASSERT_GT(manager.size(), mark.n_nodes);
+    ASSERT_FALSE(manager.can_rewind(mark));
+    ASSERT_THROW(manager.rewind(mark), std::logic_error);
+    manager.clear();
+}
+
+TEST(NodeManagerTest, ParallelBackwardDualVar) {
+    using Dual = autodiff::forward::DualVar<double>;
+    using DualTape = autodiff::reverse::Tape<Dual>;
+    using DualReverse = autodiff::reverse::Var<Dual>;
+
+    // non floating point adjoints: the levels are propagated sequentially
+    DualTape tape;
+    autodiff::reverse::ActiveTape<Dual> active(tape);
+    DualReverse x = Dual(0.5, 1.0);
+    DualReverse y = Dual(2.0, 0.0);
+    DualReverse z = x * y + sin(x);
+
+    tape.parallel_backward(z.index());
+    // d/dx (x y + sin x) = y + cos(x), and its tangent wrt x is -sin(x)
+    ASSERT_DOUBLE_EQ(x.grad().getReal(), 2.0 + std::cos(0.5));
+    ASSERT_DOUBLE_EQ(x.grad().getInf(), -std::sin(0.5));
+    ASSERT_DOUBLE_EQ(y.grad().getReal(), 0.5);
+}
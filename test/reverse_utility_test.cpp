@@ -1,7 +1,10 @@
+#include <thread>
+#include <vector>
 #include <Eigen/Core>
 #include <gtest/gtest.h>
 #include "Var.hpp"
 #include "ReverseUtility.hpp"
+#include "MatrixFunctions.hpp"
 
 /**
  * Unit tests for the utility functions exposed by
@@ -97,3 +100,528 @@ TEST(ReverseUtilityTest, JacobianTest1) {
         }
     }
 }
+
+TEST(ReverseUtilityTest, GradientMultipleThreads) {
+    // each thread records in its own (thread-local) Tape
+    constexpr size_t N_THREADS = 4;
+    constexpr size_t N_ITER = 200;
+
+    std::vector<Vec> grads(N_THREADS);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < N_THREADS; ++t) {
+        threads.emplace_back([t, &grads]() {
+            Vec x = (1.0 + t) * Vec::Ones(2);
+            double f_x;
+            for(size_t i = 0; i < N_ITER; ++i) {
+                autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x, grads[t]);
+            }
+        });
+    }
+    for(auto & thread: threads) {
+        thread.join();
+    }
+
+    for(size_t t = 0; t < N_THREADS; ++t) {
+        Vec x = (1.0 + t) * Vec::Ones(2);
+        Vec grad;
+        double f_x;
+        autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x, grad);
+        for(size_t i = 0; i < grad.size(); ++i) {
+            ASSERT_EQ(grads[t](i), grad(i));
+        }
+    }
+}
+
+TEST(ReverseUtilityTest, RecordedGradient) {
+    autodiff::reverse::RecordedGradient rec_gradient(f_N1_1<Var, VecVar>);
+
+    for(double t: {1.0, 0.5, -2.0, 3.0}) {
+        Vec x = t * Vec::Ones(2);
+        Vec grad, rec_grad;
+        double f_x, rec_f_x;
+
+        autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x, grad);
+        rec_gradient(x, rec_f_x, rec_grad);
+
+        ASSERT_DOUBLE_EQ(f_x, rec_f_x);
+        for(size_t i = 0; i < grad.size(); ++i) {
+            ASSERT_DOUBLE_EQ(grad(i), rec_grad(i));
+        }
+    }
+
+    // no control flow => recorded only once
+    ASSERT_EQ(rec_gradient.n_records(), 1);
+}
+
+TEST(ReverseUtilityTest, RecordedGradientGuards) {
+    // |x0| * x1 written with an explicit branch
+    auto f = [](VecVar const & x) -> Var {
+        if(x(0) < 0.0) {
+            return -x(0) * x(1);
+        }
+        return x(0) * x(1);
+    };
+    autodiff::reverse::RecordedGradient rec_gradient(f);
+
+    Vec x(2);
+    Vec grad;
+    double f_x;
+
+    x << 2.0, 3.0;
+    rec_gradient(x, f_x, grad);
+    ASSERT_EQ(grad(0), 3.0);
+
+    // same branch => replay
+    x << 1.0, 3.0;
+    rec_gradient(x, f_x, grad);
+    ASSERT_EQ(rec_gradient.n_records(), 1);
+    ASSERT_EQ(f_x, 3.0);
+    ASSERT_EQ(grad(0), 3.0);
+
+    // the branch flips => record again
+    x << -1.0, 3.0;
+    rec_gradient(x, f_x, grad);
+    ASSERT_EQ(rec_gradient.n_records(), 2);
+    ASSERT_EQ(f_x, 3.0);
+    ASSERT_EQ(grad(0), -3.0);
+    ASSERT_EQ(grad(1), 1.0);
+}
+
+TEST(ReverseUtilityTest, RecordedJacobian) {
+    autodiff::reverse::RecordedJacobian rec_jacobian(f_NM_1<VecVar, VecVar>);
+
+    for(double t: {1.0, 0.5, 2.0}) {
+        Vec x = t * Vec::Ones(2);
+        Vec f_x, rec_f_x;
+        Jac jac, rec_jac;
+
+        autodiff::reverse::jacobian(f_NM_1<VecVar, VecVar>, x, f_x, jac);
+        rec_jacobian(x, rec_f_x, rec_jac);
+
+        for(size_t i = 0; i < jac.rows(); ++i) {
+            ASSERT_DOUBLE_EQ(f_x(i), rec_f_x(i));
+            for(size_t j = 0; j < jac.cols(); ++j) {
+                ASSERT_DOUBLE_EQ(jac(i,j), rec_jac(i,j));
+            }
+        }
+    }
+    ASSERT_EQ(rec_jacobian.n_records(), 1);
+}
+
+// more outputs than lanes of a single backward pass
+constexpr size_t M_MANY = 3 * autodiff::reverse::JACOBIAN_LANES + 1;
+
+template <typename OutType, typename InType>
+OutType f_NM_many(InType const & x) {
+    // 3 inputs
+    OutType res(M_MANY);
+    for(size_t i = 0; i < M_MANY; ++i) {
+        res(i) = sin((1.0 + 0.1*i) * x(0)) * x(1) + x(2) * x(i % 3);
+    }
+    return res;
+}
+
+TEST(ReverseUtilityTest, JacobianManyOutputs) {
+    Jac jac_fd;
+    Jac jac_ad;
+    Vec x(3);
+    x << 0.3, -1.2, 0.8;
+    Vec f_x;
+
+    jacobian_finite_diff(f_NM_many<Vec, Vec>, x, f_x, jac_fd);
+    autodiff::reverse::jacobian(f_NM_many<VecVar, VecVar>, x, f_x, jac_ad);
+
+    ASSERT_EQ(jac_ad.rows(), M_MANY);
+    double eps = 0.0001;
+    for(size_t i = 0; i < jac_ad.rows(); ++i) {
+        for(size_t j = 0; j < jac_ad.cols(); ++j) {
+            ASSERT_NEAR(jac_fd(i,j), jac_ad(i,j), eps);
+        }
+    }
+}
+
+using DualVar = autodiff::forward::DualVar<double>;
+using DVar = autodiff::reverse::Var<DualVar>;
+using VecDVar = Eigen::Vector<DVar, Eigen::Dynamic>;
+
+template <typename OutType, typename InType>
+OutType f_N1_hvp(InType const & x) {
+    // statements, constants, a guard and every kind of node
+    OutType res = x(0) * x(0) * x(1) + sin(x(0) * x(1)) + exp(x(1)) / x(0);
+    res = res + x(2) * tanh(x(0)) + pow(x(2), 3.0) - 2.0 / x(1);
+    if(res > 0.0) {
+        res = res + sqrt(x(0)) * log(x(2)) + pow(x(0), x(2));
+    }
+    return res;
+}
+
+TEST(ReverseUtilityTest, HessianVectorProduct) {
+    Vec x(3);
+    x << 0.7, 1.3, 0.9;
+    Vec v(3);
+    v << 0.5, -1.0, 2.0;
+
+    double f_x;
+    Vec grad, hv;
+    autodiff::reverse::hvp(f_N1_hvp<DVar, VecDVar>, x, v, f_x, grad, hv);
+
+    double f_x_ref;
+    Vec grad_ref;
+    autodiff::reverse::gradient(f_N1_hvp<Var, VecVar>, x, f_x_ref, grad_ref);
+    ASSERT_DOUBLE_EQ(f_x, f_x_ref);
+    for(size_t i = 0; i < x.size(); ++i) {
+        ASSERT_NEAR(grad(i), grad_ref(i), 1e-12);
+    }
+
+    // central differences of the gradient along v
+    constexpr double h = 1e-5;
+    Vec grad_plus, grad_minus;
+    autodiff::reverse::gradient(f_N1_hvp<Var, VecVar>, x + h*v, f_x_ref, grad_plus);
+    autodiff::reverse::gradient(f_N1_hvp<Var, VecVar>, x - h*v, f_x_ref, grad_minus);
+    Vec hv_fd = (grad_plus - grad_minus) / (2*h);
+    for(size_t i = 0; i < x.size(); ++i) {
+        ASSERT_NEAR(hv(i), hv_fd(i), 1e-5);
+    }
+}
+
+TEST(ReverseUtilityTest, HessianVectorProductQuadratic) {
+    // f(x) = 0.5 x'Ax with A symmetric => H*v = A*v
+    Jac A(3, 3);
+    A << 4.0, 1.0, -2.0,
+         1.0, 3.0,  0.5,
+        -2.0, 0.5,  5.0;
+    auto f = [&A](VecDVar const & x) {
+        DVar res = 0.0 * x(0);
+        for(size_t i = 0; i < 3; ++i) {
+            for(size_t j = 0; j < 3; ++j) {
+                res = res + 0.5 * A(i,j) * x(i) * x(j);
+            }
+        }
+        return res;
+    };
+
+    Vec x(3);
+    x << 1.0, -2.0, 0.5;
+    Vec v(3);
+    v << 0.3, 0.1, -1.0;
+
+    double f_x;
+    Vec grad, hv;
+    autodiff::reverse::hvp(f, x, v, f_x, grad, hv);
+
+    ASSERT_NEAR(f_x, 0.5 * x.dot(A * x), 1e-12);
+    Vec Ax = A * x;
+    Vec Av = A * v;
+    for(size_t i = 0; i < 3; ++i) {
+        ASSERT_NEAR(grad(i), Ax(i), 1e-12);
+        ASSERT_NEAR(hv(i), Av(i), 1e-12);
+    }
+
+    ASSERT_THROW(autodiff::reverse::hvp(f, x, Vec::Ones(2), f_x, grad, hv), std::invalid_argument);
+}
+
+// y_i = x_{i-1} * x_i + sin(x_{i+1}) (tridiagonal jacobian)
+template <typename OutType, typename InType>
+OutType f_NM_tridiagonal(InType const & x) {
+    size_t n = x.size();
+    OutType res(n);
+    for(size_t i = 0; i < n; ++i) {
+        res(i) = x(i) * x(i);
+        if(i > 0) {
+            res(i) = res(i) + x(i-1) * x(i);
+        }
+        if(i + 1 < n) {
+            res(i) = res(i) + sin(x(i+1));
+        }
+    }
+    return res;
+}
+
+TEST(ReverseUtilityTest, SparseJacobian) {
+    constexpr size_t n = 40;
+    Vec x(n);
+    for(size_t i = 0; i < n; ++i) {
+        x(i) = 0.1 * i - 2.0;
+    }
+
+    std::vector<Eigen::Triplet<bool>> entries;
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t j = (i > 0 ? i-1 : 0); j <= std::min(i+1, n-1); ++j) {
+            entries.emplace_back(i, j, true);
+        }
+    }
+    autodiff::SparsityPattern pattern(n, n);
+    pattern.setFromTriplets(entries.begin(), entries.end());
+
+    Vec f_x, f_x_dense;
+    Jac jac_dense;
+    autodiff::reverse::jacobian(f_NM_tridiagonal<VecVar, VecVar>, x, f_x_dense, jac_dense);
+
+    Eigen::SparseMatrix<double> jac;
+    autodiff::reverse::sparse_jacobian(f_NM_tridiagonal<VecVar, VecVar>, x, pattern, f_x, jac);
+
+    ASSERT_EQ(jac.nonZeros(), 3*n - 2);
+    Jac jac_sparse = Jac(jac);
+    for(size_t i = 0; i < n; ++i) {
+        ASSERT_DOUBLE_EQ(f_x(i), f_x_dense(i));
+        for(size_t j = 0; j < n; ++j) {
+            ASSERT_NEAR(jac_sparse(i, j), jac_dense(i, j), 1e-12);
+        }
+    }
+    ASSERT_EQ(autodiff::reverse::NodeManager<double>::instance().size(), 1);
+}
+
+TEST(ReverseUtilityTest, JacobianSparsity) {
+    constexpr size_t n = 30;
+    Vec x(n);
+    for(size_t i = 0; i < n; ++i) {
+        x(i) = 0.1 * i - 2.0;
+    }
+
+    autodiff::SparsityPattern pattern = autodiff::reverse::jacobian_sparsity(f_NM_tridiagonal<VecVar, VecVar>, x);
+    ASSERT_EQ(pattern.rows(), n);
+    ASSERT_EQ(pattern.cols(), n);
+    ASSERT_EQ(pattern.nonZeros(), 3*n - 2);
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t j = 0; j < n; ++j) {
+            bool expected = (j + 1 >= i) && (j <= i + 1);
+            ASSERT_EQ(pattern.coeff(i, j), expected);
+        }
+    }
+    ASSERT_EQ(autodiff::reverse::NodeManager<double>::instance().size(), 1);
+
+    // the detected pattern drives the sparse jacobian
+    Vec f_x;
+    Eigen::SparseMatrix<double> jac;
+    autodiff::reverse::sparse_jacobian(f_NM_tridiagonal<VecVar, VecVar>, x, pattern, f_x, jac);
+    ASSERT_EQ(jac.nonZeros(), 3*n - 2);
+
+    // statements and outputs which don't depend on the inputs
+    auto g = [](VecVar const & x) {
+        VecVar res(3);
+        res(0) = x(0) * x(2) + exp(x(2)) / 2.0;
+        res(1) = Var(1.0) * 2.0;
+        res(2) = x(1);
+        return res;
+    };
+    pattern = autodiff::reverse::jacobian_sparsity(g, Vec::Ones(3));
+    ASSERT_EQ(pattern.nonZeros(), 3);
+    ASSERT_TRUE(pattern.coeff(0, 0));
+    ASSERT_TRUE(pattern.coeff(0, 2));
+    ASSERT_TRUE(pattern.coeff(2, 1));
+}
+
+TEST(ReverseUtilityTest, Hessian) {
+    Vec x(3);
+    x << 0.7, 1.3, 0.9;
+
+    double f_x;
+    Vec grad;
+    Eigen::SparseMatrix<double> hess;
+    autodiff::reverse::hessian(f_N1_hvp<Var, VecVar>, x, f_x, grad, hess);
+
+    double f_x_ref;
+    Vec grad_ref;
+    autodiff::reverse::gradient(f_N1_hvp<Var, VecVar>, x, f_x_ref, grad_ref);
+    ASSERT_DOUBLE_EQ(f_x, f_x_ref);
+    for(size_t i = 0; i < x.size(); ++i) {
+        ASSERT_NEAR(grad(i), grad_ref(i), 1e-12);
+    }
+
+    // each column of the hessian is a hessian-vector product
+    Jac dense = hess;
+    for(size_t j = 0; j < x.size(); ++j) {
+        Vec hv;
+        autodiff::reverse::hvp(f_N1_hvp<DVar, VecDVar>, x, Vec::Unit(x.size(), j), f_x_ref, grad_ref, hv);
+        for(size_t i = 0; i < x.size(); ++i) {
+            ASSERT_NEAR(dense(i,j), hv(i), 1e-10);
+        }
+    }
+}
+
+// f(x) = sum_i x_i * x_{i+1} + 2^x_i + x_i / 3 + 1 / x_i + x_i^2 (tridiagonal hessian)
+template <typename OutType, typename InType>
+OutType f_N1_chain(InType const & x) {
+    OutType res = x(0) * x(0);
+    for(size_t i = 0; i < x.size(); ++i) {
+        res = res + pow(2.0, x(i)) + x(i) / 3.0 + 1.0 / x(i) + x(i) * x(i);
+        if(i + 1 < x.size()) {
+            res = res + sin(x(i) * x(i+1));
+        }
+    }
+    return res;
+}
+
+TEST(ReverseUtilityTest, SparseHessian) {
+    constexpr size_t n = 30;
+    Vec x = Vec::LinSpaced(n, 0.5, 1.5);
+
+    double f_x;
+    Vec grad;
+    Eigen::SparseMatrix<double> hess;
+    autodiff::reverse::hessian(f_N1_chain<Var, VecVar>, x, f_x, grad, hess);
+
+    // only the tridiagonal band is stored
+    ASSERT_EQ(hess.nonZeros(), 3*n - 2);
+
+    Jac dense = hess;
+    for(size_t j = 0; j < n; ++j) {
+        double f_x_ref;
+        Vec grad_ref, hv;
+        autodiff::reverse::hvp(f_N1_chain<DVar, VecDVar>, x, Vec::Unit(n, j), f_x_ref, grad_ref, hv);
+        for(size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(dense(i,j), hv(i), 1e-10);
+        }
+    }
+}
+
+TEST(ReverseUtilityTest, GradientWorkspace) {
+    autodiff::reverse::Workspace ws;
+    auto f = [](VecVar const & x) { return f_N1_1<Var, VecVar>(x); };
+
+    // the gradients are written in the columns of a matrix
+    Jac grads(2, 3);
+    Var const * inputs = nullptr;
+    for(size_t k = 0; k < 3; ++k) {
+        Vec x = Vec::Constant(2, 0.5 + k);
+        double f_x;
+        autodiff::reverse::gradient(f, x, f_x, grads.col(k), ws);
+        if(k == 0) {
+            inputs = ws.x.data();
+        }
+        ASSERT_EQ(ws.x.data(), inputs);
+
+        double f_x_ref;
+        Vec grad_ref;
+        autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x_ref, grad_ref);
+        ASSERT_DOUBLE_EQ(f_x, f_x_ref);
+        for(size_t i = 0; i < 2; ++i) {
+            ASSERT_DOUBLE_EQ(grads(i, k), grad_ref(i));
+        }
+    }
+
+    // nothing has been recorded in the thread-local Tape
+    ASSERT_EQ(autodiff::reverse::NodeManager<double>::instance().size(), 1);
+
+    Vec grad(3);
+    double f_x;
+    ASSERT_THROW(autodiff::reverse::gradient(f, Vec::Ones(2), f_x, grad, ws), std::invalid_argument);
+}
+
+TEST(ReverseUtilityTest, JacobianWorkspace) {
+    constexpr size_t n = 20;
+    autodiff::reverse::Workspace ws;
+
+    Vec f_x(n);
+    Jac jac(n, n);
+    for(double shift: {0.0, 0.3}) {
+        Vec x = Vec::LinSpaced(n, 0.5, 1.5).array() + shift;
+        autodiff::reverse::jacobian(f_NM_tridiagonal<VecVar, VecVar>, x, f_x, jac, ws);
+
+        Vec f_x_ref;
+        Jac jac_ref;
+        autodiff::reverse::jacobian(f_NM_tridiagonal<VecVar, VecVar>, x, f_x_ref, jac_ref);
+        for(size_t i = 0; i < n; ++i) {
+            ASSERT_DOUBLE_EQ(f_x(i), f_x_ref(i));
+            for(size_t j = 0; j < n; ++j) {
+                ASSERT_DOUBLE_EQ(jac(i,j), jac_ref(i,j));
+            }
+        }
+    }
+
+    Jac wrong(n, n + 1);
+    ASSERT_THROW(
+        autodiff::reverse::jacobian(f_NM_tridiagonal<VecVar, VecVar>, Vec::Ones(n), f_x, wrong, ws),
+        std::invalid_argument
+    );
+}
+
+TEST(ReverseUtilityTest, BatchGradient) {
+    autodiff::reverse::Workspace ws;
+    // elementary nodes, scalar nodes, statements, a block and a guard
+    auto f = [](VecVar const & x) {
+        Var p = x(0) * x(1);
+        Var s = sin(p) + exp(x(2)) / x(0);
+        Var t = 2.0 * s - 1.0;
+        Var n = autodiff::reverse::squared_norm(x);
+        Var y = t * n + p * p;
+        if(x(0) > 0.0) {
+            y = y + log(x(0));
+        }
+        return y;
+    };
+
+    // 21 points: the last group of lanes is partially used
+    Jac X(3, 21);
+    for(Eigen::Index k = 0; k < X.cols(); ++k) {
+        X.col(k) << 0.5 + 0.1 * k, -0.3 + 0.05 * k, 0.2 * std::sin(double(k));
+    }
+    Vec f_X;
+    Jac grads;
+    ASSERT_TRUE(autodiff::reverse::batch_gradient(f, X, f_X, grads, ws));
+    // one replay per group of lanes
+    constexpr size_t lanes = autodiff::reverse::Tape<double>::BATCH_LANES;
+    ASSERT_EQ(ws.tape.stats().n_replays, (21 + lanes - 1) / lanes);
+    ASSERT_EQ(f_X.size(), 21);
+    ASSERT_EQ(grads.rows(), 3);
+    ASSERT_EQ(grads.cols(), 21);
+
+    autodiff::reverse::Workspace ref;
+    Vec grad(3);
+    for(Eigen::Index k = 0; k < X.cols(); ++k) {
+        double f_x;
+        autodiff::reverse::gradient(f, X.col(k), f_x, grad, ref);
+        ASSERT_NEAR(f_X(k), f_x, 1e-12);
+        for(Eigen::Index i = 0; i < 3; ++i) {
+            ASSERT_NEAR(grads(i, k), grad(i), 1e-12);
+        }
+    }
+
+    // a point which takes the other branch
+    X(0, 5) = -1.0;
+    ASSERT_FALSE(autodiff::reverse::batch_gradient(f, X, f_X, grads, ws));
+}
+
+TEST(ReverseUtilityTest, GradientInsideTapeScope) {
+    autodiff::reverse::NodeManager<double> & manager = autodiff::reverse::NodeManager<double>::instance();
+    manager.clear();
+
+    Var w = 0.5;
+    Vec x = Vec::Ones(2);
+    Vec grad;
+    double f_x;
+    {
+        // `gradient` clears the active Tape: the scope can't rewind it anymore
+        autodiff::reverse::TapeScope<double> scope;
+        [[maybe_unused]] Var y = w * w;
+        autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x, grad);
+        ASSERT_THROW(scope.rewind(), std::logic_error);
+    }
+    ASSERT_EQ(grad.size(), 2);
+    manager.clear();
+}
+
+TEST(ReverseUtilityTest, GradientInsideProfileRegion) {
+    autodiff::reverse::NodeManager<double> & manager = autodiff::reverse::NodeManager<double>::instance();
+    manager.clear();
+
+    Vec x = Vec::Ones(2);
+    Vec grad;
+    double f_x;
+    {
+        // `gradient` clears the active Tape, which closes the region
+        autodiff::reverse::ProfileRegion<double> region("gradient");
+        autodiff::reverse::gradient(f_N1_1<Var, VecVar>, x, f_x, grad);
+        ASSERT_THROW(manager.end_region(), std::logic_error);
+    }
+    ASSERT_EQ(grad.size(), 2);
+
+    // a region opened after the clear is still closed by its own object
+    manager.clear();
+    {
+        autodiff::reverse::ProfileRegion<double> region("after");
+        ASSERT_TRUE(manager.is_innermost_region(0));
+    }
+    ASSERT_FALSE(manager.is_innermost_region(0));
+    manager.clear();
+}
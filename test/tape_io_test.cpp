@@ -0,0 +1,207 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+#include "Var.hpp"
+#include "NodeManager.hpp"
+#include "MatrixFunctions.hpp"
+#include "TapeIO.hpp"
+
+/**
+ * Unit tests for the functionalities exposed by
+ *  TapeIO.hpp
+ */
+
+using Var = autodiff::reverse::Var<double>;
+using autodiff::reverse::Tape;
+using autodiff::reverse::ActiveTape;
+using autodiff::reverse::save_tape;
+using autodiff::reverse::load_tape;
+
+static std::string tape_path(std::string const & name) {
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST(TapeIOTest, SaveAndLoad) {
+    std::string path = tape_path("autodiff_tape_io_save_and_load.bin");
+
+    Tape<double> recorded;
+    size_t x_idx, y_idx, z_idx;
+    double dx, dy;
+    {
+        ActiveTape<double> active(recorded);
+        Var x = 0.7;
+        Var y = 1.3;
+        Var t = x * y;
+        Var z = sin(t) / (2.0 + x) - pow(y, 3.0);
+        Var w = x * y + exp(x) * 3.0;   // statement
+        (void)(z > 0.0);                // guard
+        z.backward();
+        x_idx = x.index(); y_idx = y.index(); z_idx = z.index();
+        dx = x.grad(); dy = y.grad();
+        (void)w;
+    }
+    save_tape(recorded, path);
+
+    Tape<double> loaded;
+    load_tape(loaded, path);
+    ASSERT_EQ(loaded.size(), recorded.size());
+    ASSERT_EQ(loaded.n_guards(), recorded.n_guards());
+    for(size_t i = 0; i < loaded.size(); ++i) {
+        ASSERT_EQ(loaded.get_node_value(i), recorded.get_node_value(i));
+    }
+
+    loaded.backward(z_idx);
+    ASSERT_EQ(loaded.get_node_grad(x_idx), dx);
+    ASSERT_EQ(loaded.get_node_grad(y_idx), dy);
+
+    std::remove(path.c_str());
+}
+
+TEST(TapeIOTest, ReplayLoadedTape) {
+    std::string path = tape_path("autodiff_tape_io_replay.bin");
+
+    Tape<double> recorded;
+    size_t x_idx, y_idx, z_idx;
+    {
+        ActiveTape<double> active(recorded);
+        Var x = 2.0;
+        Var y = 3.0;
+        Var t1 = x * y;
+        Var t2 = sin(t1);
+        Var t3 = exp(x);
+        Var t4 = t3 / y;
+        Var z = t2 + t4;
+        x_idx = x.index(); y_idx = y.index(); z_idx = z.index();
+    }
+    save_tape(recorded, path);
+
+    Tape<double> loaded;
+    load_tape(loaded, path);
+    loaded.set_node_value(x_idx, 0.5);
+    loaded.set_node_value(y_idx, 1.5);
+    ASSERT_TRUE(loaded.forward());
+    ASSERT_DOUBLE_EQ(loaded.get_node_value(z_idx), std::sin(0.75) + std::exp(0.5) / 1.5);
+
+    loaded.backward(z_idx);
+    ASSERT_DOUBLE_EQ(loaded.get_node_grad(x_idx), 1.5 * std::cos(0.75) + std::exp(0.5) / 1.5);
+    ASSERT_DOUBLE_EQ(loaded.get_node_grad(y_idx), 0.5 * std::cos(0.75) - std::exp(0.5) / (1.5 * 1.5));
+
+    std::remove(path.c_str());
+}
+
+TEST(TapeIOTest, LoadedStatementsCannotBeReplayed) {
+    std::string path = tape_path("autodiff_tape_io_statements.bin");
+
+    Tape<double> recorded;
+    {
+        ActiveTape<double> active(recorded);
+        Var a = 1.0, b = 2.0, c = 3.0;
+        [[maybe_unused]] Var z = a*b + c;
+    }
+    save_tape(recorded, path);
+
+    Tape<double> loaded;
+    load_tape(loaded, path);
+    ASSERT_THROW(loaded.forward(), std::logic_error);
+
+    std::remove(path.c_str());
+}
+
+TEST(TapeIOTest, BlocksCannotBeSaved) {
+    std::string path = tape_path("autodiff_tape_io_blocks.bin");
+
+    Tape<double> recorded;
+    {
+        ActiveTape<double> active(recorded);
+        autodiff::reverse::VarVector<Var> v(3);
+        v << Var(1.0), Var(2.0), Var(3.0);
+        [[maybe_unused]] Var n = autodiff::reverse::squared_norm(v);
+    }
+    ASSERT_THROW(save_tape(recorded, path), std::runtime_error);
+
+    std::remove(path.c_str());
+}
+
+// overwrites a byte of a file
+static void patch_file(std::string const & path, size_t offset, char byte) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.put(byte);
+}
+
+TEST(TapeIOTest, CorruptedFiles) {
+    using autodiff::reverse::TapeFileHeader;
+    using autodiff::reverse::OpCode;
+    using autodiff::reverse::NodeIdx;
+
+    std::string path = tape_path("autodiff_tape_io_corrupted.bin");
+
+    // dummy node, x, sin(x)
+    Tape<double> recorded;
+    size_t z_idx;
+    {
+        ActiveTape<double> active(recorded);
+        Var x = 1.0;
+        Var z = sin(x);
+        z_idx = z.index();
+    }
+    ASSERT_EQ(recorded.size(), 3);
+    size_t ops_offset = sizeof(TapeFileHeader);
+    size_t first_offset = ops_offset + 8;
+
+    // the argument of sin(x) is no longer a previous node
+    save_tape(recorded, path);
+    patch_file(path, first_offset + z_idx * sizeof(NodeIdx), static_cast<char>(0xFF));
+    Tape<double> loaded;
+    ASSERT_THROW(load_tape(loaded, path), std::runtime_error);
+    ASSERT_EQ(loaded.size(), 1);
+
+    // node types which can't be saved or don't exist
+    for(auto op: {static_cast<char>(OpCode::Block), static_cast<char>(OpCode::Output), static_cast<char>(0x7F)}) {
+        save_tape(recorded, path);
+        patch_file(path, ops_offset + z_idx, op);
+        ASSERT_THROW(load_tape(loaded, path), std::runtime_error);
+    }
+
+    // the untouched file still loads
+    save_tape(recorded, path);
+    load_tape(loaded, path);
+    ASSERT_EQ(loaded.size(), 3);
+
+    std::remove(path.c_str());
+}
+
+TEST(TapeIOTest, InvalidFiles) {
+    Tape<double> tape;
+    ASSERT_THROW(load_tape(tape, tape_path("autodiff_tape_io_missing.bin")), std::runtime_error);
+
+    std::string path = tape_path("autodiff_tape_io_invalid.bin");
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "not a tape";
+    }
+    ASSERT_THROW(load_tape(tape, path), std::runtime_error);
+
+    // truncated file
+    {
+        ActiveTape<double> active(tape);
+        tape.clear();
+        Var x = 1.0;
+        [[maybe_unused]] Var z = sin(x);
+    }
+    save_tape(tape, path);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    ASSERT_THROW(load_tape(tape, path), std::runtime_error);
+
+    // a Tape of a different type
+    Tape<float> other;
+    save_tape(other, path);
+    ASSERT_THROW(load_tape(tape, path), std::runtime_error);
+
+    std::remove(path.c_str());
+}
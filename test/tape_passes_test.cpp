@@ -0,0 +1,178 @@
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <Eigen/Dense>
+#include "Var.hpp"
+#include "NodeManager.hpp"
+#include "MatrixFunctions.hpp"
+#include "TapePasses.hpp"
+
+/**
+ * Unit tests for the functionalities exposed by
+ *  TapePasses.hpp
+ */
+
+using Var = autodiff::reverse::Var<double>;
+using autodiff::reverse::Tape;
+using autodiff::reverse::ActiveTape;
+using autodiff::reverse::TapeOptimization;
+using autodiff::reverse::PassManager;
+
+/**
+ * Records f(x, y) with dead nodes, constant subexpressions, identities,
+ * statements and a guard. Returns the indices of x, y (inputs) and f (output).
+ */
+static void record(Tape<double> & tape, double x0, double y0, std::vector<size_t> & inputs, std::vector<size_t> & outputs) {
+    ActiveTape<double> active(tape);
+    Var x = x0;
+    Var y = y0;
+
+    Var c = 2.0;
+    Var k = sin(c) * exp(c) + 1.0;          // constant subexpression
+    Var unused = cos(x) * tanh(y);          // dead
+    (void)unused;
+
+    Var acc = 0.0;                          // accumulator: acc + t => t
+    for(int i = 0; i < 3; ++i) {
+        Var t = x * y + k * sin(x);         // statement
+        acc = acc + t;
+    }
+    Var minus = -acc;
+    Var f = -minus;                         // -(-acc) => acc
+    f = f + pow(y, c);
+    if(f > 0.0) {                           // guard
+        f = f + log(x);
+    }
+
+    inputs = {x.index(), y.index()};
+    outputs = {f.index()};
+}
+
+TEST(TapePassesTest, DefaultPipeline) {
+    Tape<double> reference, optimized;
+    std::vector<size_t> inputs, outputs;
+    record(reference, 0.7, 1.3, inputs, outputs);
+    record(optimized, 0.7, 1.3, inputs, outputs);
+
+    TapeOptimization<double> opt(optimized, inputs, outputs);
+    auto reports = PassManager<double>::default_pipeline().run(opt);
+    ASSERT_EQ(reports.size(), 4);
+    for(auto const & report: reports) {
+        ASSERT_GT(report.n_changed, 0) << report.name;
+    }
+    ASSERT_LT(optimized.size(), reference.size());
+    ASSERT_EQ(optimized.n_guards(), reference.n_guards());
+
+    for(double shift: {0.0, 0.25, -0.1}) {
+        for(size_t k = 0; k < 2; ++k) {
+            reference.set_node_value(inputs[k], reference.get_node_value(inputs[k]) + shift);
+            optimized.set_node_value(opt.inputs[k], optimized.get_node_value(opt.inputs[k]) + shift);
+        }
+        ASSERT_TRUE(reference.forward());
+        ASSERT_TRUE(optimized.forward());
+        ASSERT_DOUBLE_EQ(optimized.get_node_value(opt.outputs[0]), reference.get_node_value(outputs[0]));
+
+        reference.clear_grad();
+        optimized.clear_grad();
+        reference.backward(outputs[0]);
+        optimized.backward(opt.outputs[0]);
+        for(size_t k = 0; k < 2; ++k) {
+            ASSERT_NEAR(optimized.get_node_grad(opt.inputs[k]), reference.get_node_grad(inputs[k]), 1e-12);
+        }
+    }
+}
+
+TEST(TapePassesTest, Identities) {
+    Tape<double> tape;
+    size_t x_idx, y_idx;
+    {
+        ActiveTape<double> active(tape);
+        Var x = 1.5;
+        Var one = 1.0;
+        Var zero = 0.0;
+        Var t1 = x * one;
+        Var t2 = t1 + zero;
+        Var t3 = t2 / one;
+        Var t4 = t3 - zero;
+        Var t5 = -t4;
+        Var y = -t5;
+        x_idx = x.index();
+        y_idx = y.index();
+    }
+
+    TapeOptimization<double> opt(tape, {x_idx}, {y_idx});
+    ASSERT_EQ(TapeOptimization<double>::simplify_identities(opt), 5);
+    // y is x itself
+    ASSERT_EQ(opt.outputs[0], x_idx);
+
+    TapeOptimization<double>::eliminate_dead_nodes(opt);
+    TapeOptimization<double>::compact(opt);
+    // the dummy node and x
+    ASSERT_EQ(tape.size(), 2);
+    ASSERT_EQ(opt.inputs[0], opt.outputs[0]);
+}
+
+TEST(TapePassesTest, ConstantFolding) {
+    Tape<double> tape;
+    size_t x_idx, y_idx, k_idx;
+    {
+        ActiveTape<double> active(tape);
+        Var x = 0.5;
+        Var a = 3.0;
+        Var k = exp(a) * a - 1.0;
+        Var y = k * x;
+        x_idx = x.index();
+        y_idx = y.index();
+        k_idx = k.index();
+    }
+
+    TapeOptimization<double> opt(tape, {x_idx}, {y_idx});
+    ASSERT_GT(TapeOptimization<double>::fold_constants(opt), 0);
+    TapeOptimization<double>::eliminate_dead_nodes(opt);
+    ASSERT_EQ(opt.n_live(), 4);     // dummy node, x, k and y
+    TapeOptimization<double>::compact(opt);
+    ASSERT_EQ(tape.size(), 4);
+
+    double k = std::exp(3.0) * 3.0 - 1.0;
+    tape.set_node_value(opt.inputs[0], 2.0);
+    ASSERT_TRUE(tape.forward());
+    ASSERT_DOUBLE_EQ(tape.get_node_value(opt.outputs[0]), 2.0 * k);
+    tape.backward(opt.outputs[0]);
+    ASSERT_DOUBLE_EQ(tape.get_node_grad(opt.inputs[0]), k);
+    (void)k_idx;
+}
+
+TEST(TapePassesTest, Blocks) {
+    Tape<double> reference, optimized;
+    std::vector<size_t> inputs, outputs;
+    auto record_blocks = [&](Tape<double> & tape) {
+        ActiveTape<double> active(tape);
+        autodiff::reverse::VarVector<Var> v(3);
+        v << Var(1.0), Var(2.0), Var(3.0);
+        Var dead = autodiff::reverse::squared_norm(v);
+        (void)dead;
+        Var n = autodiff::reverse::squared_norm(v);
+        n = n * 1.0;
+        inputs = {v(0).index(), v(1).index(), v(2).index()};
+        outputs = {n.index()};
+    };
+    record_blocks(reference);
+    record_blocks(optimized);
+
+    TapeOptimization<double> opt(optimized, inputs, outputs);
+    PassManager<double>::default_pipeline().run(opt);
+    ASSERT_LT(optimized.size(), reference.size());
+
+    for(size_t k = 0; k < 3; ++k) {
+        reference.set_node_value(inputs[k], 0.5 * k);
+        optimized.set_node_value(opt.inputs[k], 0.5 * k);
+    }
+    reference.forward();
+    optimized.forward();
+    ASSERT_DOUBLE_EQ(optimized.get_node_value(opt.outputs[0]), reference.get_node_value(outputs[0]));
+    reference.backward(outputs[0]);
+    optimized.backward(opt.outputs[0]);
+    for(size_t k = 0; k < 3; ++k) {
+        ASSERT_DOUBLE_EQ(optimized.get_node_grad(opt.inputs[k]), reference.get_node_grad(inputs[k]));
+    }
+}